@@ -19,6 +19,12 @@
 /* extra error code for `luaL_load' */
 #define LUA_ERRFILE (LUA_ERRERR + 1)
 
+enum luaL_Allocator {
+    LUAL_ALLOCPOOL, /* size-class pools in page-sized arenas (the default) */
+    LUAL_ALLOCHUGEPOOL, /* as above, advising the system to use huge pages */
+    LUAL_ALLOCSYSTEM, /* realloc and free from the C library */
+};
+
 typedef struct luaL_Reg {
     const char *name;
     lua_CFunction func;
@@ -58,6 +64,7 @@ LUALIB_API int luaL_loadbuffer (lua_State *L, const char *buff, size_t sz, const
 LUALIB_API int luaL_loadstring (lua_State *L, const char *s);
 
 LUALIB_API lua_State *luaL_newstate (void);
+LUALIB_API lua_State *luaL_newstatex (int allocator);
 
 LUALIB_API const char *luaL_gsub (lua_State *L, const char *s, const char *p, const char *r);
 
@@ -98,6 +98,7 @@ typedef LUA_INTEGER lua_Integer;
 ** state manipulation
 */
 LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud);
+LUA_API lua_State *lua_newpoolstate (int hugepages);
 LUA_API void lua_close (lua_State *L);
 LUA_API lua_State *lua_newthread (lua_State *L);
 
@@ -208,6 +209,10 @@ enum lua_GCOption {
     LUA_GCSTEP = 5,
     LUA_GCSETPAUSE = 6,
     LUA_GCSETSTEPMUL = 7,
+    LUA_GCGEN = 8,
+    LUA_GCINC = 9,
+    LUA_GCSTEPTIME = 10,
+    LUA_GCSETMARKTHREADS = 11,
 };
 
 LUA_API int lua_gc (lua_State *L, int what, int dat);
@@ -408,6 +413,13 @@ typedef int64_t lua_Clock;
 typedef struct lua_GlobalStats {
     size_t bytesused; /* total number of bytes in use */
     size_t bytesallocated; /* total number of bytes allocated */
+    size_t bytesreserved; /* bytes held by the pooled allocator for small blocks */
+    size_t bytesfree; /* bytes of `bytesreserved' not in any block in use */
+    size_t byteswasted; /* bytes lost rounding blocks in use up to their size class */
+    int samples; /* call stacks recorded since `lua_startsampling' */
+    int samplesdropped; /* call stacks lost to full sample buffers */
+    int allocsamples; /* allocations recorded since `lua_startallocsampling' */
+    int allocsamplesdropped; /* allocations lost to full sample buffers */
 } lua_GlobalStats;
 
 typedef struct lua_SourceStats {
@@ -415,6 +427,21 @@ typedef struct lua_SourceStats {
     size_t bytesowned; /* total byte size owned objects */
 } lua_SourceStats;
 
+typedef struct lua_LineStats {
+    int line; /* source line */
+    uint64_t hits; /* number of times this line was executed */
+    lua_Clock ticks; /* sampled ticks spent executing this line */
+} lua_LineStats;
+
+typedef struct lua_AllocStats {
+    const char *type; /* type of the allocated objects, or "memory" */
+    const char *taint; /* taint of the allocated objects, or NULL */
+    lua_Number allocbytes; /* estimated bytes allocated */
+    lua_Number allocobjects; /* estimated number of allocations */
+    lua_Number livebytes; /* estimated bytes not yet freed */
+    lua_Number liveobjects; /* estimated number of allocations not yet freed */
+} lua_AllocStats;
+
 typedef struct lua_FunctionStats {
     int calls; /* number of calls */
     lua_Clock ownticks; /* ticks spent executing this function */
@@ -427,12 +454,35 @@ LUA_API lua_Clock lua_clockrate (lua_State *L);
 LUA_API int lua_isprofilingenabled (lua_State *L);
 LUA_API void lua_setprofilingenabled (lua_State *L, int enable);
 
+LUA_API int lua_islineprofilingenabled (lua_State *L);
+LUA_API void lua_setlineprofilingenabled (lua_State *L, int enable);
+
+LUA_API int lua_isclosureprofilingenabled (lua_State *L);
+LUA_API void lua_setclosureprofilingenabled (lua_State *L, int enable);
+
+LUA_API int lua_iscallgraphenabled (lua_State *L);
+LUA_API void lua_setcallgraphenabled (lua_State *L, int enable);
+LUA_API int lua_getcallgraph (lua_State *L, int edge, lua_FunctionStats *stats);
+LUA_API int lua_dumpcallgraph (lua_State *L, lua_Writer writer, void *data);
+
 LUA_API void lua_collectstats (lua_State *L);
 LUA_API void lua_resetstats (lua_State *L);
 
 LUA_API void lua_getglobalstats (lua_State *L, lua_GlobalStats *stats);
 LUA_API void lua_getsourcestats (lua_State *L, const char *source, lua_SourceStats *stats);
 LUA_API void lua_getfunctionstats (lua_State *L, int funcindex, lua_FunctionStats *stats);
+LUA_API int lua_getlinestats (lua_State *L, int funcindex, lua_LineStats *stats, int size);
+
+LUA_API int lua_startsampling (lua_State *L, int hz);
+LUA_API int lua_stopsampling (lua_State *L, lua_Writer writer, void *data);
+
+LUA_API int lua_starttracing (lua_State *L, int size);
+LUA_API int lua_stoptracing (lua_State *L, lua_Writer writer, void *data);
+
+LUA_API int lua_startallocsampling (lua_State *L, size_t interval);
+LUA_API void lua_stopallocsampling (lua_State *L);
+LUA_API int lua_getallocstats (lua_State *L, int site, lua_AllocStats *stats);
+LUA_API int lua_dumpallocprofile (lua_State *L, lua_Writer writer, void *data);
 
 /**
  * Debugging and Exception APIs
@@ -444,9 +494,14 @@ enum lua_ExceptMask {
     LUA_EXCEPTOVERFLOW = (1 << 2),
 };
 
+enum lua_InterruptReason {
+    LUA_INTERRUPTBREAK = (1 << 0), /* Raise an error in the running script. */
+    LUA_INTERRUPTHOOK = (1 << 1), /* Call the hook with a count event. */
+};
+
 typedef struct lua_ScriptTimeout {
     lua_Clock ticks; /* how long to allow execution before timing out? */
-    int instructions; /* how many instructions between each check? */
+    int safepoints; /* how many safepoints (calls and loops) between each check? */
 } lua_ScriptTimeout;
 
 LUA_API int lua_getexceptmask (lua_State *L);
@@ -455,6 +510,8 @@ LUA_API void lua_setexceptmask (lua_State *L, int mask);
 LUA_API void lua_getscripttimeout (lua_State *L, lua_ScriptTimeout *timeout);
 LUA_API void lua_setscripttimeout (lua_State *L, const lua_ScriptTimeout *timeout);
 
+LUA_API void lua_interrupt (lua_State *L, int reason);
+
 LUA_API int lua_ishookallowed (lua_State *L);
 
 /**
@@ -893,13 +893,20 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
             }
             while (g->GCthreshold <= g->totalbytes) {
                 luaC_step(L);
-                if (g->gcstate == GCSpause) { /* end of cycle? */
+                if (g->gcstate == GCSpause || isgenerational(g)) { /* end of cycle? */
                     res = 1; /* signal it */
                     break;
                 }
             }
             break;
         }
+        case LUA_GCSTEPTIME: {
+            /* budget is given in microseconds; a negative one runs a single step */
+            double us = (data > 0) ? cast(double, data) : 0.0;
+            lua_Clock ticks = cast(lua_Clock, us * cast(double, luaG_clockrate(g)) / 1e6);
+            res = luaC_steptime(L, ticks);
+            break;
+        }
         case LUA_GCSETPAUSE: {
             res = g->gcpause;
             g->gcpause = data;
@@ -910,6 +917,24 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
             g->gcstepmul = data;
             break;
         }
+        case LUA_GCSETMARKTHREADS: {
+            res = g->gcmarkthreads;
+            g->gcmarkthreads = data;
+            break;
+        }
+        case LUA_GCGEN: {
+            res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC; /* previous mode */
+            if (data > 0) {
+                g->genminormul = data;
+            }
+            luaC_changemode(L, KGC_GEN);
+            break;
+        }
+        case LUA_GCINC: {
+            res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC; /* previous mode */
+            luaC_changemode(L, KGC_INC);
+            break;
+        }
         default:
             res = -1; /* invalid option */
     }
@@ -1144,7 +1169,9 @@ LUA_API void lua_upvaluejoin (lua_State *L, int fidx1, int n1, int fidx2, int n2
  * Core Security APIs
  */
 
-static const char *gettaint (const TString *ts) {
+static const char *gettaint (lua_State *L, TaintRef taint) {
+    TString *ts = luaR_gettaintname(G(L), taint);
+
     if (ts != NULL) {
         return getstr(ts);
     } else {
@@ -1152,17 +1179,6 @@ static const char *gettaint (const TString *ts) {
     }
 }
 
-static TString *newtaint (lua_State *L, const char *name) {
-    TString *taint = NULL;
-
-    if (name != NULL) {
-        taint = luaS_new(L, name);
-        luaS_fix(taint);
-    }
-
-    return taint;
-}
-
 LUA_API int lua_gettaintmode (lua_State *L) {
     return cast_int(luaR_gettaintmode(L));
 }
@@ -1174,7 +1190,7 @@ LUA_API void lua_settaintmode (lua_State *L, int mode) {
 LUA_API void lua_taintstack (lua_State *L, const char *name) {
     lua_lock(L);
     luaC_checkGC(L);
-    luaR_taintstack(L, newtaint(L, name));
+    luaR_taintstack(L, luaR_newtaint(L, name));
     lua_unlock(L);
 }
 
@@ -1205,53 +1221,53 @@ LUA_API void lua_tainttop (lua_State *L, int n) {
 }
 
 LUA_API const char *lua_getstacktaint (lua_State *L) {
-    return gettaint(L->stacktaint);
+    return gettaint(L, luaR_getstacktaint(L));
 }
 
 LUA_API const char *lua_getvaluetaint (lua_State *L, int idx) {
     StkId o = index2adr(L, idx);
     api_checkvalidindex(L, o);
-    return gettaint(o->taint);
+    return gettaint(L, luaR_getvaluetaint(o));
 }
 
 LUA_API const char *lua_getobjecttaint (lua_State *L, int idx) {
     StkId o;
-    TString *ts;
+    TaintRef taint;
 
     lua_lock(L);
     o = index2adr(L, idx);
     api_checkvalidindex(L, o);
-    ts = (iscollectable(o) ? gcvalue(o)->gch.taint : NULL);
+    taint = (iscollectable(o) ? luaR_getobjecttaint(gcvalue(o)) : 0);
     lua_unlock(L);
 
-    return gettaint(ts);
+    return gettaint(L, taint);
 }
 
 LUA_API const char *lua_getnewobjecttaint (lua_State *L) {
-    return gettaint(L->newgctaint);
+    return gettaint(L, luaR_getnewgctaint(L));
 }
 
 LUA_API const char *lua_getnewclosuretaint (lua_State *L) {
-    return gettaint(L->newcltaint);
+    return gettaint(L, luaR_getnewcltaint(L));
 }
 
 LUA_API const char *lua_getcalltaint (lua_State *L, const lua_Debug *ar) {
     CallInfo *ci = (L->base_ci + ar->i_ci);
-    TString *ts;
+    TaintRef taint;
 
     if (ci == L->ci) {
-        ts = L->stacktaint;
+        taint = luaR_getstacktaint(L);
     } else {
-        ts = ci->savedtaint;
+        taint = luaR_getcalltaint(ci);
     }
 
-    return gettaint(ts);
+    return gettaint(L, taint);
 }
 
 LUA_API void lua_setstacktaint (lua_State *L, const char *name) {
     lua_lock(L);
     luaC_checkGC(L);
-    luaR_setstacktaint(L, newtaint(L, name));
+    luaR_setstacktaint(L, luaR_newtaint(L, name));
     lua_unlock(L);
 }
 
@@ -1260,7 +1276,7 @@ LUA_API void lua_setvaluetaint (lua_State *L, int idx, const char *name) {
     api_checkvalidindex(L, o);
     lua_lock(L);
     luaC_checkGC(L);
-    o->taint = newtaint(L, name);
+    luaR_setvaluetaint(o, luaR_newtaint(L, name));
     lua_unlock(L);
 }
 
@@ -1274,7 +1290,7 @@ LUA_API void lua_setobjecttaint (lua_State *L, int idx, const char *name) {
     if (iscollectable(o)) {
         lua_lock(L);
         luaC_checkGC(L);
-        luaR_setobjecttaint(L, gcvalue(o), newtaint(L, name));
+        luaR_setobjecttaint(L, gcvalue(o), luaR_newtaint(L, name));
         lua_unlock(L);
     }
 
@@ -1283,16 +1299,16 @@ LUA_API void lua_setobjecttaint (lua_State *L, int idx, const char *name) {
 
 LUA_API void lua_settoptaint (lua_State *L, int n, const char *name) {
     StkId o;
-    TString *ts;
+    TaintRef taint;
 
     api_checknelems(L, n);
 
     lua_lock(L);
     luaC_checkGC(L);
-    ts = newtaint(L, name);
+    taint = luaR_newtaint(L, name);
 
     for (o = (L->top - n); o < L->top; ++o) {
-        o->taint = ts;
+        luaR_setvaluetaint(o, taint);
     }
 
     lua_unlock(L);
@@ -1301,14 +1317,14 @@ LUA_API void lua_settoptaint (lua_State *L, int n, const char *name) {
 LUA_API void lua_setnewobjecttaint (lua_State *L, const char *name) {
     lua_lock(L);
     luaC_checkGC(L);
-    luaR_setnewgctaint(L, newtaint(L, name));
+    luaR_setnewgctaint(L, luaR_newtaint(L, name));
     lua_unlock(L);
 }
 
 LUA_API void lua_setnewclosuretaint (lua_State *L, const char *name) {
     lua_lock(L);
     luaC_checkGC(L);
-    luaR_setnewcltaint(L, newtaint(L, name));
+    luaR_setnewcltaint(L, luaR_newtaint(L, name));
     lua_unlock(L);
 }
 
@@ -1318,18 +1334,18 @@ LUA_API void lua_copytaint (lua_State *from, lua_State *to) {
 
 LUA_API void lua_savetaint (lua_State *L, lua_TaintState *ts) {
     ts->mode = cast_int(luaR_gettaintmode(L));
-    ts->stacktaint = gettaint(L->stacktaint);
-    ts->newobjecttaint = gettaint(L->newgctaint);
-    ts->newclosuretaint = gettaint(L->newcltaint);
+    ts->stacktaint = gettaint(L, luaR_getstacktaint(L));
+    ts->newobjecttaint = gettaint(L, luaR_getnewgctaint(L));
+    ts->newclosuretaint = gettaint(L, luaR_getnewcltaint(L));
 }
 
 LUA_API void lua_restoretaint (lua_State *L, const lua_TaintState *ts) {
     lua_lock(L);
     luaC_checkGC(L);
     luaR_settaintmode(L, cast_byte(ts->mode));
-    luaR_setstacktaint(L, newtaint(L, ts->stacktaint));
-    luaR_setnewgctaint(L, newtaint(L, ts->newobjecttaint));
-    luaR_setnewcltaint(L, newtaint(L, ts->newclosuretaint));
+    luaR_setstacktaint(L, luaR_newtaint(L, ts->stacktaint));
+    luaR_setnewgctaint(L, luaR_newtaint(L, ts->newobjecttaint));
+    luaR_setnewcltaint(L, luaR_newtaint(L, ts->newclosuretaint));
     lua_unlock(L);
 }
 
@@ -1368,7 +1384,7 @@ LUA_API void lua_protecttaint (lua_State *L, lua_PFunction func, void *ud) {
          * catches this error is expected to unwind them instead. */
 
         StkId err = L->top - 1;
-        err->taint = NULL;
+        luaR_setvaluetaint(err, 0);
 
         luaR_loadtaint(L, &savedts);
         luaD_throw(L, status);
@@ -1381,12 +1397,12 @@ LUA_API void lua_cleartaint (lua_State *L, int n) {
     StkId o;
     api_checknelems(L, n);
 
-    luaR_setstacktaint(L, NULL);
-    luaR_setnewgctaint(L, NULL);
-    luaR_setnewcltaint(L, NULL);
+    luaR_setstacktaint(L, 0);
+    luaR_setnewgctaint(L, 0);
+    luaR_setnewcltaint(L, 0);
 
     for (o = L->top - n; o < L->top; o++) {
-        o->taint = NULL;
+        luaR_setvaluetaint(o, 0);
     }
 }
 
@@ -1395,18 +1411,18 @@ LUA_API void lua_resettaint (lua_State *L) {
     StkId o;
 
     luaR_settaintmode(L, LUA_TAINTDISABLED);
-    luaR_setstacktaint(L, NULL);
-    luaR_setnewgctaint(L, NULL);
-    luaR_setnewcltaint(L, NULL);
+    luaR_setstacktaint(L, 0);
+    luaR_setnewgctaint(L, 0);
+    luaR_setnewcltaint(L, 0);
 
     /* Clear saved taint of all stack frames. */
     for (ci = L->base_ci; ci <= L->ci; ci++) {
-        ci->savedtaint = NULL;
+        luaR_setcalltaint(ci, 0);
     }
 
     /* Clear taint of all stack values for all stack frames. */
     for (o = L->stack; o < L->top; o++) {
-        o->taint = NULL;
+        luaR_setvaluetaint(o, 0);
     }
 }
 
@@ -1430,133 +1446,112 @@ LUA_API lua_Clock lua_clockrate (lua_State *L) {
     return rate;
 }
 
-static SourceStats *getsourcestats (global_State *g, TString *owner) {
-    SourceStats *st = g->sourcestats;
-    SourceStats *pt = NULL;
-
-    while (st != NULL && st->owner != owner) {
-        pt = st;
-        st = st->next;
-    }
+LUA_API int lua_isprofilingenabled (lua_State *L) {
+    int enabled;
 
-    if (st != NULL && pt != NULL) {
-        /* Re-link to place this object at the head of stats list. */
-        pt->next = st->next;
-        st->next = g->sourcestats;
-        g->sourcestats = st;
-    }
+    lua_lock(L);
+    enabled = G(L)->enablestats;
+    lua_unlock(L);
 
-    return st;
+    return enabled;
 }
 
-static SourceStats *newsourcestats (global_State *g, TString *owner) {
-    SourceStats *st = getsourcestats(g, owner);
-
-    if (st == NULL) {
-        st = luaM_new(g->mainthread, SourceStats);
-        st->owner = owner;
-        st->execticks = 0;
-        st->bytesowned = 0;
-        st->next = g->sourcestats;
-        g->sourcestats = st;
-    }
-
-    return st;
+LUA_API void lua_setprofilingenabled (lua_State *L, int enable) {
+    /* Function statistics are allocated on the first profiled call. */
+    lua_lock(L);
+    G(L)->enablestats = cast_byte(enable);
+    lua_unlock(L);
 }
 
-static void resetsourcestats (global_State *g) {
-    SourceStats *st;
-
-    /* Reset source-owned statistics */
-    for (st = g->sourcestats; st != NULL; st = st->next) {
-        st->execticks = 0;
-        st->bytesowned = 0;
-    }
-}
+LUA_API int lua_isclosureprofilingenabled (lua_State *L) {
+    int enabled;
 
-static void resetfunctionstats (global_State *g) {
-    GCObject *o;
+    lua_lock(L);
+    enabled = G(L)->enableclosurestats;
+    lua_unlock(L);
 
-    for (o = g->rootgc; o != NULL; o = o->gch.next) {
-        if (ttisfunction(&o->gch)) {
-            ClosureStats *cs = gco2cl(o)->c.stats;
+    return enabled;
+}
 
-            if (cs != NULL) {
-                cs->calls = 0;
-                cs->ownticks = 0;
-                cs->subticks = 0;
-            }
-        }
-    }
+LUA_API void lua_setclosureprofilingenabled (lua_State *L, int enable) {
+    /* Closures share the statistics of their function unless enabled. */
+    lua_lock(L);
+    G(L)->enableclosurestats = cast_byte(enable);
+    lua_unlock(L);
 }
 
-LUA_API int lua_isprofilingenabled (lua_State *L) {
+LUA_API int lua_iscallgraphenabled (lua_State *L) {
     int enabled;
 
     lua_lock(L);
-    enabled = G(L)->enablestats;
+    enabled = G(L)->enablecallgraph;
     lua_unlock(L);
 
     return enabled;
 }
 
-LUA_API void lua_setprofilingenabled (lua_State *L, int enable) {
-    global_State *g;
-
+LUA_API void lua_setcallgraphenabled (lua_State *L, int enable) {
     lua_lock(L);
-    g = G(L);
-
-    if (enable && !g->enablestats) { /* Enabling? */
-        GCObject *o;
-        luaC_checkGC(L);
 
-        /* Allocate closure statistics */
-        for (o = g->rootgc; o != NULL; o = o->gch.next) {
-            if (ttisfunction(&o->gch)) {
-                Closure *cl = gco2cl(o);
-
-                if (cl->c.stats == NULL) {
-                    cl->c.stats = luaF_newclosurestats(g->mainthread);
-                }
-            }
-        }
+    if (enable) {
+        luaG_startcallgraph(L);
     }
 
-    g->enablestats = cast_byte(enable);
+    G(L)->enablecallgraph = cast_byte(enable);
     lua_unlock(L);
 }
 
-LUA_API void lua_collectstats (lua_State *L) {
-    global_State *g;
-    GCObject *o;
+LUA_API int lua_getcallgraph (lua_State *L, int edge, lua_FunctionStats *stats) {
+    int found;
+    lua_lock(L);
+    found = luaG_getcallgraph(L, edge, stats);
+    lua_unlock(L);
+    return found;
+}
 
+LUA_API int lua_dumpcallgraph (lua_State *L, lua_Writer writer, void *data) {
+    int status;
     lua_lock(L);
-    g = G(L);
+    status = luaG_dumpcallgraph(L, writer, data);
+    lua_unlock(L);
+    return status;
+}
 
-    luaC_checkGC(L);
-    resetsourcestats(g);
+LUA_API int lua_islineprofilingenabled (lua_State *L) {
+    int enabled;
 
-    for (o = g->rootgc; o != NULL; o = o->gch.next) {
-        SourceStats *st = newsourcestats(g, o->gch.taint);
+    lua_lock(L);
+    enabled = G(L)->enablelinestats;
+    lua_unlock(L);
 
-        st->bytesowned += luaC_objectsize(o);
+    return enabled;
+}
 
-        if (ttisfunction(&o->gch)) {
-            ClosureStats *cs = gco2cl(o)->c.stats;
+LUA_API void lua_setlineprofilingenabled (lua_State *L, int enable) {
+    global_State *g;
 
-            if (cs != NULL) {
-                st->execticks += cs->ownticks;
-            }
-        }
+    lua_lock(L);
+    g = G(L);
+
+    if (enable && !g->enablelinestats) { /* Enabling? counters are allocated as functions run */
+        g->lineticks = luaG_clocktime(g);
+        g->linecount = LUAI_LINESAMPLE;
     }
 
+    g->enablelinestats = cast_byte(enable);
+    luai_atomicor(&g->interrupt, LUAI_INTERRUPTRESELECT); /* switch to or from the tracing interpreter */
     lua_unlock(L);
 }
 
+LUA_API void lua_collectstats (lua_State *L) {
+    /* No-op: source statistics are maintained incrementally. */
+    lua_unused(L);
+}
+
 LUA_API void lua_resetstats (lua_State *L) {
+    /* Counters of the previous epoch are cleared as they are next used. */
     lua_lock(L);
-    resetsourcestats(G(L));
-    resetfunctionstats(G(L));
+    G(L)->statsepoch++;
     lua_unlock(L);
 }
 
@@ -1566,20 +1561,36 @@ LUA_API void lua_getglobalstats (lua_State *L, lua_GlobalStats *stats) {
     g = G(L);
     stats->bytesused = g->totalbytes;
     stats->bytesallocated = g->bytesallocated;
+    if (g->pool != NULL) {
+        luaM_poolstats(g->pool, stats);
+    } else { /* no insight into other allocators */
+        stats->bytesreserved = 0;
+        stats->bytesfree = 0;
+        stats->byteswasted = 0;
+    }
+    stats->samples = (g->sampler != NULL) ? g->sampler->nsamples : 0;
+    stats->samplesdropped = (g->sampler != NULL) ? g->sampler->ndropped : 0;
+    stats->allocsamples = (g->allocsampler != NULL) ? g->allocsampler->nsamples : 0;
+    stats->allocsamplesdropped = (g->allocsampler != NULL) ? g->allocsampler->ndropped : 0;
     lua_unlock(L);
 }
 
 LUA_API void lua_getsourcestats (lua_State *L, const char *source, lua_SourceStats *stats) {
     TString *ts;
-    SourceStats *st;
+    SourceStats *st = NULL;
 
     lua_lock(L);
     luaC_checkGC(L);
     ts = ((source != NULL) ? luaS_new(L, source) : NULL);
-    st = getsourcestats(G(L), ts);
+
+    if (ts == NULL) {
+        st = luaR_getsourcestats(G(L), 0);
+    } else if (luaR_gettaintref(ts) != 0) {
+        st = luaR_getsourcestats(G(L), luaR_gettaintref(ts));
+    }
 
     if (st != NULL) {
-        stats->execticks = st->execticks;
+        stats->execticks = (iscurrentstats(G(L), st) ? st->execticks : 0);
         stats->bytesowned = st->bytesowned;
     } else {
         stats->execticks = 0;
@@ -1597,9 +1608,9 @@ LUA_API void lua_getfunctionstats (lua_State *L, int funcindex, lua_FunctionStat
     o = index2adr(L, funcindex);
     api_checkvalidindex(L, o);
     api_check(L, ttisfunction(o));
-    cs = clvalue(o)->c.stats;
+    cs = luaG_getclosurestats(L, clvalue(o));
 
-    if (cs != NULL) {
+    if (cs != NULL && iscurrentstats(G(L), cs)) {
         stats->calls = cs->calls;
         stats->ownticks = cs->ownticks;
         stats->subticks = cs->subticks;
@@ -1612,6 +1623,128 @@ LUA_API void lua_getfunctionstats (lua_State *L, int funcindex, lua_FunctionStat
     lua_unlock(L);
 }
 
+LUA_API int lua_startsampling (lua_State *L, int hz) {
+    int started;
+    lua_lock(L);
+    started = luaG_startsampling(L, hz);
+    lua_unlock(L);
+    return started;
+}
+
+LUA_API int lua_stopsampling (lua_State *L, lua_Writer writer, void *data) {
+    int status;
+    lua_lock(L);
+    status = luaG_dumpsamples(L, writer, data);
+    luaG_freesampler(L);
+    lua_unlock(L);
+    return status;
+}
+
+LUA_API int lua_starttracing (lua_State *L, int size) {
+    int started;
+    lua_lock(L);
+    started = luaG_starttracing(L, size);
+    lua_unlock(L);
+    return started;
+}
+
+LUA_API int lua_stoptracing (lua_State *L, lua_Writer writer, void *data) {
+    int status;
+    lua_lock(L);
+    status = luaG_dumptrace(L, writer, data);
+    luaG_freetracer(L);
+    lua_unlock(L);
+    return status;
+}
+
+LUA_API int lua_startallocsampling (lua_State *L, size_t interval) {
+    int started;
+    lua_lock(L);
+    started = luaG_startallocsampling(L, interval);
+    lua_unlock(L);
+    return started;
+}
+
+LUA_API void lua_stopallocsampling (lua_State *L) {
+    lua_lock(L);
+    luaG_freeallocsampler(L);
+    lua_unlock(L);
+}
+
+LUA_API int lua_getallocstats (lua_State *L, int site, lua_AllocStats *stats) {
+    int found;
+    lua_lock(L);
+    found = luaG_getallocstats(L, site, stats);
+    lua_unlock(L);
+    return found;
+}
+
+LUA_API int lua_dumpallocprofile (lua_State *L, lua_Writer writer, void *data) {
+    int status;
+    lua_lock(L);
+    status = luaG_dumpallocprofile(L, writer, data);
+    lua_unlock(L);
+    return status;
+}
+
+LUA_API int lua_getlinestats (lua_State *L, int funcindex, lua_LineStats *stats, int size) {
+    StkId o;
+    const Proto *p;
+    int minline = 1;
+    int maxline = 0;
+    int nlines = 0;
+    int pc;
+
+    lua_lock(L);
+    o = index2adr(L, funcindex);
+    api_checkvalidindex(L, o);
+    api_check(L, ttisfunction(o));
+    p = (clvalue(o)->c.isC ? NULL : clvalue(o)->l.p);
+
+    if (p != NULL && p->linestats != NULL && p->lineinfo != NULL && p->lineepoch == G(L)->statsepoch) {
+        minline = maxline = p->lineinfo[0];
+
+        for (pc = 1; pc < p->sizelinestats; pc++) {
+            minline = (p->lineinfo[pc] < minline) ? p->lineinfo[pc] : minline;
+            maxline = (p->lineinfo[pc] > maxline) ? p->lineinfo[pc] : maxline;
+        }
+    }
+
+    if (maxline >= minline) {
+        /* Merge the counters of all instructions on each line; a line runs
+         * as many times as its most executed instruction. */
+        lua_LineStats *lines = luaM_newvector(L, maxline - minline + 1, lua_LineStats);
+        int line;
+
+        for (line = minline; line <= maxline; line++) {
+            lines[line - minline].line = line;
+            lines[line - minline].hits = 0;
+            lines[line - minline].ticks = 0;
+        }
+
+        for (pc = 0; pc < p->sizelinestats; pc++) {
+            lua_LineStats *ls = &lines[p->lineinfo[pc] - minline];
+            ls->hits = (p->linestats[pc].hits > ls->hits) ? p->linestats[pc].hits : ls->hits;
+            ls->ticks += p->linestats[pc].ticks;
+        }
+
+        for (line = minline; line <= maxline; line++) {
+            if (lines[line - minline].hits != 0) {
+                if (nlines < size) {
+                    stats[nlines] = lines[line - minline];
+                }
+
+                nlines++;
+            }
+        }
+
+        luaM_freearray(L, lines, maxline - minline + 1, lua_LineStats);
+    }
+
+    lua_unlock(L);
+    return nlines;
+}
+
 /**
  * Core Debugging and Exception APIs
  */
@@ -1627,24 +1760,29 @@ LUA_API void lua_setexceptmask (lua_State *L, int mask) {
 LUA_API void lua_getscripttimeout (lua_State *L, lua_ScriptTimeout *timeout) {
     lua_lock(L);
     timeout->ticks = L->baseexeclimit;
-    timeout->instructions = L->baseexeccount;
+    timeout->safepoints = L->baseexeccount;
     lua_unlock(L);
 }
 
 LUA_API void lua_setscripttimeout (lua_State *L, const lua_ScriptTimeout *timeout) {
     lua_lock(L);
 
-    if (timeout->ticks == 0 || timeout->instructions == 0) {
+    if (timeout->ticks == 0 || timeout->safepoints == 0) {
         L->baseexeclimit = 0;
         L->baseexeccount = L->execcount = 0;
     } else {
         L->baseexeclimit = timeout->ticks;
-        L->baseexeccount = L->execcount = timeout->instructions;
+        L->baseexeccount = L->execcount = timeout->safepoints;
     }
 
     lua_unlock(L);
 }
 
+LUA_API void lua_interrupt (lua_State *L, int reason) {
+    /* no locking; this may be called from any thread or signal handler */
+    luai_atomicor(&G(L)->interrupt, reason & (LUA_INTERRUPTBREAK | LUA_INTERRUPTHOOK));
+}
+
 LUA_API int lua_ishookallowed (lua_State *L) {
     return cast_int(L->allowhook);
 }
@@ -551,7 +551,16 @@ static int panic (lua_State *L) {
 }
 
 LUALIB_API lua_State *luaL_newstate (void) {
-    lua_State *L = lua_newstate(l_alloc, NULL);
+    return luaL_newstatex(LUAL_ALLOCPOOL);
+}
+
+LUALIB_API lua_State *luaL_newstatex (int allocator) {
+    lua_State *L;
+    if (allocator == LUAL_ALLOCSYSTEM) {
+        L = lua_newstate(l_alloc, NULL);
+    } else {
+        L = lua_newpoolstate(allocator == LUAL_ALLOCHUGEPOOL);
+    }
     if (L) {
         lua_atpanic(L, &panic);
     }
@@ -188,22 +188,33 @@ static int luaB_gcinfo (lua_State *L) {
 }
 
 static int luaB_collectgarbage (lua_State *L) {
-    static const char *const opts[] = { "stop", "restart", "collect", "count", "step", "setpause", "setstepmul", NULL };
-    static const int optsnum[] = { LUA_GCSTOP, LUA_GCRESTART,  LUA_GCCOLLECT,   LUA_GCCOUNT,
-                                   LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL };
+    static const char *const opts[] = { "stop",       "restart",      "collect",      "count",       "step",
+                                        "setpause",   "setstepmul",   "generational", "incremental", "steptime",
+                                        "setmarkthreads", NULL };
+    static const int optsnum[] = { LUA_GCSTOP,     LUA_GCRESTART,    LUA_GCCOLLECT, LUA_GCCOUNT, LUA_GCSTEP,
+                                   LUA_GCSETPAUSE, LUA_GCSETSTEPMUL, LUA_GCGEN,     LUA_GCINC,   LUA_GCSTEPTIME,
+                                   LUA_GCSETMARKTHREADS };
     int o = luaL_checkoption(L, 1, "collect", opts);
     int ex = luaL_optint(L, 2, 0);
-    int res = lua_gc(L, optsnum[o], ex);
+    int res;
+    luaL_argcheck(L, optsnum[o] != LUA_GCSTEPTIME || ex >= 0, 2, "budget must be non-negative");
+    res = lua_gc(L, optsnum[o], ex);
     switch (optsnum[o]) {
         case LUA_GCCOUNT: {
             int b = lua_gc(L, LUA_GCCOUNTB, 0);
             lua_pushnumber(L, res + ((lua_Number) b / 1024));
             return 1;
         }
-        case LUA_GCSTEP: {
+        case LUA_GCSTEP:
+        case LUA_GCSTEPTIME: {
             lua_pushboolean(L, res);
             return 1;
         }
+        case LUA_GCGEN:
+        case LUA_GCINC: {
+            lua_pushstring(L, (res == LUA_GCGEN) ? "generational" : "incremental"); /* previous mode */
+            return 1;
+        }
         default: {
             lua_pushnumber(L, res);
             return 1;
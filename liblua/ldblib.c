@@ -465,14 +465,14 @@ static int db_getscripttimeout (lua_State *L) {
     lua_getscripttimeout(L, &timeout);
 
     lua_pushnumber(L, (lua_Number) timeout.ticks / lua_clockrate(L));
-    lua_pushinteger(L, timeout.instructions);
+    lua_pushinteger(L, timeout.safepoints);
     return 2;
 }
 
 static int db_setscripttimeout (lua_State *L) {
     lua_ScriptTimeout timeout;
     timeout.ticks = (lua_Clock) (luaL_checknumber(L, 1) * lua_clockrate(L));
-    timeout.instructions = luaL_checkint(L, 2);
+    timeout.safepoints = luaL_checkint(L, 2);
     lua_setscripttimeout(L, &timeout);
     return 0;
 }
@@ -13,16 +13,21 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lmanip.h"
+#include "lmem.h"
 #include "lobject.h"
 #include "lopcodes.h"
+#include "lsec.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
 #include "lvm.h"
+#include "lzio.h"
 
+#include <math.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
 
@@ -30,7 +35,18 @@
 #include <windows.h>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define LUAI_HAVETSC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#define LUAI_HAVETSC
+#endif
+
 #if defined(LUA_USE_POSIX)
+#include <signal.h>
+#include <sys/time.h>
 #include <unistd.h>
 #endif
 
@@ -67,6 +83,7 @@ LUA_API int lua_sethook (lua_State *L, lua_Hook func, int mask, int count) {
     L->basehookcount = count;
     resethookcount(L);
     L->hookmask = cast_byte(mask);
+    luai_atomicor(&G(L)->interrupt, LUAI_INTERRUPTRESELECT);
     return 1;
 }
 
@@ -319,6 +336,19 @@ static int checkArgMode (const Proto *pt, int r, enum OpArgMask mode) {
     return 1;
 }
 
+/* check that a superinstruction is followed by the instruction it was made from */
+static int checkfused (const Proto *pt, int pc) {
+    Instruction i = pt->code[pc];
+    OpCode op = GET_OPCODE(i);
+    if (op < OP_GETGLOBALTABLE || op > OP_LOADKCALL) {
+        return 1; /* not a superinstruction */
+    }
+    check(pc + 1 < pt->sizecode && GET_OPCODE(pt->code[pc + 1]) < NUM_OPCODES);
+    SET_OPCODE(i, GET_GENERICOP(i));
+    check(luaP_fusedop(i, pt->code[pc + 1]) == op);
+    return 1;
+}
+
 static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
     int pc;
     int last; /* stores position of last instruction that changed `reg' */
@@ -331,6 +361,10 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
         int b = 0;
         int c = 0;
         check(op < NUM_OPCODES);
+        if (op != GET_GENERICOP(i)) { /* specialized or superinstruction? */
+            check(checkfused(pt, pc));
+            op = GET_GENERICOP(i); /* otherwise behaves as the generic instruction */
+        }
         checkreg(pt, a);
         switch (getOpMode(op)) {
             case iABC: {
@@ -525,7 +559,7 @@ static const char *getobjname (lua_State *L, CallInfo *ci, int stackpos, const c
         }
         i = symbexec(p, pc, stackpos); /* try symbolic execution */
         lua_assert(pc != -1);
-        switch (GET_OPCODE(i)) {
+        switch (GET_GENERICOP(i)) {
             case OP_GETGLOBAL: {
                 int g = GETARG_Bx(i); /* global index */
                 lua_assert(ttisstring(&p->k[g]));
@@ -691,9 +725,7 @@ void luaG_runerror (lua_State *L, const char *fmt, ...) {
     luaG_errormsg(L);
 }
 
-static lua_Clock sys_clocktime (lua_State *L) {
-    lua_unused(L);
-
+static lua_Clock sys_clocktime (void) {
 #if defined(LUA_USE_POSIX)
     struct timespec ts;
     lua_Clock ticks;
@@ -713,9 +745,7 @@ static lua_Clock sys_clocktime (lua_State *L) {
 #endif
 }
 
-static lua_Clock sys_clockrate (lua_State *L) {
-    lua_unused(L);
-
+static lua_Clock sys_clockrate (void) {
 #if defined(LUA_USE_POSIX)
     return (uint_least64_t) 1e9;
 #elif defined(LUA_USE_WINDOWS)
@@ -727,32 +757,413 @@ static lua_Clock sys_clockrate (lua_State *L) {
 #endif
 }
 
+/*
+** The time stamp counter is read without a system call, unlike the clocks
+** above on some kernels. It's only used if the processor reports that it
+** runs at a constant rate regardless of power states, and its rate is then
+** measured against the system clock once per process. The measurement spins
+** for `TSCCALIBRATION' when the first state is created; states created
+** concurrently may each measure it, and keep whichever result is stored last.
+*/
+#if defined(LUAI_HAVETSC)
+
+/* duration of the measurement of the counter rate, in microseconds */
+#define TSCCALIBRATION 2000
+
+static lua_Clock tsc_clocktime (void) {
+    return cast(lua_Clock, __rdtsc());
+}
+
+static int tsc_isinvariant (void) {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0x80000000);
+    if (cast(unsigned int, regs[0]) < 0x80000007) {
+        return 0;
+    }
+    __cpuid(regs, 0x80000007);
+    return (regs[3] & (1 << 8)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) { /* leaf not supported */
+        return 0;
+    }
+    return (edx & (1 << 8)) != 0;
+#endif
+}
+
+static lua_Clock tsc_clockrate (void) {
+    static lua_Clock cachedrate = -1; /* 0 if the counter can't be used */
+    lua_Clock rate = luai_atomicload64(&cachedrate);
+
+    if (rate < 0) {
+        lua_Clock sysrate = sys_clockrate();
+        lua_Clock sysstart = sys_clocktime();
+        lua_Clock tscstart = tsc_clocktime();
+        lua_Clock sysend;
+        lua_Clock tscend;
+
+        if (!tsc_isinvariant() || sysrate < 1000000) {
+            rate = 0; /* too coarse to calibrate against quickly */
+        } else {
+            do {
+                sysend = sys_clocktime();
+            } while ((sysend - sysstart) < (sysrate / 1000000) * TSCCALIBRATION);
+
+            tscend = tsc_clocktime();
+            rate = cast(lua_Clock, cast(double, tscend - tscstart) * cast(double, sysrate) /
+                                   cast(double, sysend - sysstart));
+            rate = (rate > 0) ? rate : 0;
+        }
+
+        luai_atomicstore64(&cachedrate, rate);
+    }
+
+    return rate;
+}
+
+#endif
+
 void luaG_init (global_State *g) {
-    g->startticks = sys_clocktime(g->mainthread);
-    g->tickfreq = sys_clockrate(g->mainthread);
+    g->clocktime = sys_clocktime;
+    g->tickfreq = sys_clockrate();
+
+#if defined(LUAI_HAVETSC)
+    {
+        lua_Clock rate = tsc_clockrate();
+
+        if (rate > 0) {
+            g->clocktime = tsc_clocktime;
+            g->tickfreq = rate;
+        }
+    }
+#endif
+
+    g->startticks = (*g->clocktime)();
 }
 
 lua_Clock luaG_clocktime (const global_State *g) {
-    return (sys_clocktime(g->mainthread) - g->startticks);
+    return ((*g->clocktime)() - g->startticks);
 }
 
 lua_Clock luaG_clockrate (const global_State *g) {
     return g->tickfreq;
 }
 
+/*
+** Both sampling profilers and the call graph identify calls by their function
+** and a line. Calls are recorded with their current line if `lines' is set,
+** or else with the line of their definition.
+*/
+static void getframe (lua_State *L, CallInfo *ci, SampleFrame *fr, int lines) {
+    Closure *cl = ci_func(ci);
+    fr->p = (cl->c.isC ? NULL : cl->l.p);
+    fr->f = (cl->c.isC ? cl->c.f : NULL);
+    fr->line = (cl->c.isC ? 0 : cl->l.p->linedefined);
+
+    if (lines && !cl->c.isC) {
+        const Instruction *savedpc = (ci == L->ci) ? L->savedpc : ci->savedpc;
+        int pc = pcRel(savedpc, cl->l.p);
+
+        if (pc >= 0 && pc < cl->l.p->sizelineinfo) {
+            fr->line = getfuncline(cl->l.p, pc);
+        }
+    }
+}
+
+static unsigned int hashframe (unsigned int h, const SampleFrame *fr) {
+    size_t id = (fr->p != NULL) ? cast(size_t, fr->p) : cast(size_t, fr->f);
+    return h ^ ((h << 5) + (h >> 2) + cast(unsigned int, id) + cast(unsigned int, fr->line));
+}
+
+static int equalframes (const SampleFrame *a, const SampleFrame *b, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        if (a[i].p != b[i].p || a[i].f != b[i].f || a[i].line != b[i].line) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+** The call graph counts the calls made from each call site to each function,
+** and the time spent in the callee by itself and including its subroutines,
+** as the function statistics do. Edges are kept in the order they were first
+** seen with a chained hash table of their positions.
+*/
+#define MINCALLGRAPH 64
+
+static void rehashedges (lua_State *L, CallGraph *cg, int sizebuckets) {
+    int i;
+
+    luaM_reallocvector(L, cg->buckets, cg->sizebuckets, sizebuckets, int);
+    cg->sizebuckets = sizebuckets;
+
+    for (i = 0; i < sizebuckets; i++) {
+        cg->buckets[i] = -1;
+    }
+
+    for (i = 0; i < cg->nedges; i++) {
+        int b = cast_int(cg->edges[i].hash & cast(unsigned int, sizebuckets - 1));
+        cg->edges[i].next = cg->buckets[b];
+        cg->buckets[b] = i;
+    }
+}
+
+/* get the call graph of the current stats epoch */
+static CallGraph *getcallgraph (lua_State *L) {
+    global_State *g = G(L);
+    CallGraph *cg = g->callgraph;
+
+    if (cg != NULL && !iscurrentstats(g, cg)) {
+        int i;
+
+        for (i = 0; i < cg->sizebuckets; i++) {
+            cg->buckets[i] = -1;
+        }
+
+        cg->nedges = 0;
+        cg->epoch = g->statsepoch;
+    }
+
+    return cg;
+}
+
+static CallEdge *findedge (lua_State *L, CallGraph *cg, CallInfo *ci) {
+    SampleFrame caller;
+    SampleFrame callee;
+    CallEdge *e;
+    unsigned int h;
+    int i;
+
+    if (ci - 1 > L->base_ci && ttisfunction((ci - 1)->func)) {
+        getframe(L, ci - 1, &caller, 1);
+    } else { /* called by the host */
+        caller.p = NULL;
+        caller.f = NULL;
+        caller.line = 0;
+    }
+
+    getframe(L, ci, &callee, 0);
+    h = hashframe(hashframe(0, &caller), &callee);
+
+    for (i = cg->buckets[h & cast(unsigned int, cg->sizebuckets - 1)]; i >= 0; i = cg->edges[i].next) {
+        e = &cg->edges[i];
+
+        if (e->hash == h && equalframes(&e->caller, &caller, 1) && equalframes(&e->callee, &callee, 1)) {
+            return e;
+        }
+    }
+
+    luaM_growvector(L, cg->edges, cg->nedges, cg->sizeedges, CallEdge, LUA_INT_MAX, "call graph overflow");
+
+    if (cg->nedges >= cg->sizebuckets) {
+        rehashedges(L, cg, cg->sizebuckets * 2);
+    }
+
+    i = cg->nedges++;
+    e = &cg->edges[i];
+    e->caller = caller;
+    e->callee = callee;
+    e->hash = h;
+    e->calls = 0;
+    e->ownticks = 0;
+    e->subticks = 0;
+    e->next = cg->buckets[h & cast(unsigned int, cg->sizebuckets - 1)];
+    cg->buckets[h & cast(unsigned int, cg->sizebuckets - 1)] = i;
+    return e;
+}
+
+void luaG_startcallgraph (lua_State *L) {
+    global_State *g = G(L);
+
+    if (g->callgraph == NULL) {
+        CallGraph *cg = luaM_new(L, CallGraph);
+        cg->edges = NULL;
+        cg->sizeedges = 0;
+        cg->nedges = 0;
+        cg->buckets = NULL;
+        cg->sizebuckets = 0;
+        cg->epoch = g->statsepoch;
+        g->callgraph = cg;
+        rehashedges(L, cg, MINCALLGRAPH);
+    }
+}
+
+static void freecallgraph (lua_State *L) {
+    CallGraph *cg = G(L)->callgraph;
+
+    if (cg != NULL) {
+        luaM_freearray(L, cg->edges, cg->sizeedges, CallEdge);
+        luaM_freearray(L, cg->buckets, cg->sizebuckets, int);
+        luaM_free(L, cg);
+        G(L)->callgraph = NULL;
+    }
+}
+
+/* clear counters last updated before the stats were reset */
+static void renewclosurestats (const global_State *g, ClosureStats *cs) {
+    if (!iscurrentstats(g, cs)) {
+        cs->calls = 0;
+        cs->ownticks = 0;
+        cs->subticks = 0;
+        cs->epoch = g->statsepoch;
+    }
+}
+
+static void renewsourcestats (const global_State *g, SourceStats *st) {
+    if (!iscurrentstats(g, st)) {
+        st->execticks = 0;
+        st->epoch = g->statsepoch;
+    }
+}
+
+/*
+** Unless closure statistics are enabled, the profiling counters of a call are
+** shared by all closures of its function: they are kept on the prototype of
+** Lua functions and in a hash table keyed by the function pointer for C
+** functions. Counters are allocated on the first profiled call.
+*/
+#define MINCFUNCSTATS 32
+
+static unsigned int hashcfunction (lua_CFunction f) {
+    size_t id = cast(size_t, f);
+    return cast(unsigned int, id ^ (id >> 4));
+}
+
+static void resizecfuncstats (lua_State *L, int newsize) {
+    global_State *g = G(L);
+    CFunctionStats **buckets = luaM_newvector(L, newsize, CFunctionStats *);
+    int i;
+
+    for (i = 0; i < newsize; i++) {
+        buckets[i] = NULL;
+    }
+
+    for (i = 0; i < g->sizecfuncstats; i++) {
+        CFunctionStats *e = g->cfuncstats[i];
+
+        while (e != NULL) { /* rehash */
+            CFunctionStats *next = e->next;
+            unsigned int h = hashcfunction(e->f) & cast(unsigned int, newsize - 1);
+            e->next = buckets[h];
+            buckets[h] = e;
+            e = next;
+        }
+    }
+
+    luaM_freearray(L, g->cfuncstats, g->sizecfuncstats, CFunctionStats *);
+    g->cfuncstats = buckets;
+    g->sizecfuncstats = newsize;
+}
+
+static ClosureStats *findcfuncstats (lua_State *L, lua_CFunction f, int create) {
+    global_State *g = G(L);
+    CFunctionStats *e;
+    unsigned int h;
+
+    if (g->sizecfuncstats > 0) {
+        h = hashcfunction(f) & cast(unsigned int, g->sizecfuncstats - 1);
+
+        for (e = g->cfuncstats[h]; e != NULL; e = e->next) {
+            if (e->f == f) {
+                return &e->s;
+            }
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    if (g->ncfuncstats >= g->sizecfuncstats) {
+        resizecfuncstats(L, (g->sizecfuncstats > 0) ? g->sizecfuncstats * 2 : MINCFUNCSTATS);
+    }
+
+    e = luaM_new(L, CFunctionStats);
+    e->s.calls = 0;
+    e->s.ownticks = 0;
+    e->s.subticks = 0;
+    e->s.epoch = g->statsepoch;
+    e->f = f;
+    h = hashcfunction(f) & cast(unsigned int, g->sizecfuncstats - 1);
+    e->next = g->cfuncstats[h];
+    g->cfuncstats[h] = e;
+    g->ncfuncstats++;
+    return &e->s;
+}
+
+static ClosureStats *findstats (lua_State *L, Closure *cl, int create) {
+    if (G(L)->enableclosurestats) {
+        if (cl->c.stats == NULL && create) {
+            cl->c.stats = luaF_newclosurestats(L);
+        }
+
+        return cl->c.stats;
+    } else if (!cl->c.isC) {
+        Proto *p = cl->l.p;
+
+        if (p->stats == NULL && create) {
+            p->stats = luaF_newclosurestats(L);
+        }
+
+        return p->stats;
+    } else {
+        return findcfuncstats(L, cl->c.f, create);
+    }
+}
+
+ClosureStats *luaG_getclosurestats (lua_State *L, Closure *cl) {
+    return findstats(L, cl, 0);
+}
+
+void luaG_freestats (lua_State *L) {
+    global_State *g = G(L);
+    int i;
+
+    for (i = 0; i < g->sizecfuncstats; i++) {
+        CFunctionStats *e = g->cfuncstats[i];
+
+        while (e != NULL) {
+            CFunctionStats *next = e->next;
+            luaM_free(L, e);
+            e = next;
+        }
+    }
+
+    luaM_freearray(L, g->cfuncstats, g->sizecfuncstats, CFunctionStats *);
+    g->cfuncstats = NULL;
+    g->ncfuncstats = 0;
+    g->sizecfuncstats = 0;
+    freecallgraph(L);
+}
+
 void luaG_profileenter (lua_State *L) {
     const global_State *g = G(L);
     CallInfo *ci = L->ci;
     Closure *cl = ci_func(ci);
-    ClosureStats *cs = cl->c.stats;
 
-    if (g->enablestats && cs != NULL) {
-        lua_Clock now = luaG_clocktime(g);
+    if (g->enablestats) {
+        ClosureStats *cs = findstats(L, cl, 1);
+        lua_Clock now;
+
+        renewclosurestats(g, cs);
+        now = luaG_clocktime(g);
 
         /* Are we starting profiling on a new call? */
         if (ci->entryticks == 0) {
             cs->calls++;
             ci->entryticks = now;
+
+            if (ci->stats == NULL) {
+                cs->nopencalls++;
+                ci->stats = cs;
+            }
+
+            if (g->enablecallgraph) {
+                findedge(L, getcallgraph(L), ci)->calls++;
+            }
         }
 
         ci->startticks = now;
@@ -763,31 +1174,1191 @@ void luaG_profileleave (lua_State *L) {
     const global_State *g = G(L);
     CallInfo *ci = L->ci;
     Closure *cl = ci_func(ci);
-    ClosureStats *cs = cl->c.stats;
+    ClosureStats *cs = (g->enablestats ? findstats(L, cl, 0) : NULL);
 
-    if (g->enablestats && ci->entryticks != 0 && cs != NULL) {
+    lua_assert(ci->entryticks == 0 || ci->stats != NULL);
+
+    if (cs != NULL && ci->entryticks != 0) {
         lua_Clock now = luaG_clocktime(g);
+        lua_Clock ownticks = (now - ci->startticks);
+        lua_Clock subticks = 0;
+        SourceStats *st = luaR_getsourcestats(G(L), luaR_getobjecttaint(obj2gco(cl)));
+        /* open calls are counted on the counters shared by all closures */
+        int outermost = (ci->stats->nopencalls == 1);
+
+        if (outermost) {
+            subticks = (now - ci->entryticks);
+        }
 
-        /* Commit the current execution time of this call. */
-        cs->ownticks += (now - ci->startticks);
+        /* Counters may have been reset while the call was running. */
+        renewclosurestats(g, cs);
+        renewsourcestats(g, st);
+
+        /* Commit the current execution time of this call and its owner. */
+        cs->ownticks += ownticks;
+        st->execticks += ownticks;
         ci->startticks = now;
 
-        /* Commit subexecution time if this is the top call for this closure. */
-        if (cl->c.nopencalls == 1) {
-            cs->subticks += (now - ci->entryticks);
+        /* Commit subexecution time if this is the top call for this function. */
+        if (outermost) {
+            cs->subticks += subticks;
             ci->entryticks = now;
         }
+
+        if (g->enablecallgraph) {
+            CallEdge *e = findedge(L, getcallgraph(L), ci);
+            e->ownticks += ownticks;
+            e->subticks += subticks;
+        }
     }
 }
 
 void luaG_profileresume (lua_State *L) {
     const global_State *g = G(L);
     CallInfo *ci = L->ci;
-    Closure *cl = ci_func(ci);
-    ClosureStats *cs = cl->c.stats;
 
-    if (g->enablestats && ci->entryticks != 0 && cs != NULL) {
+    luaG_trace(L, TRACE_RESUME, NULL, 0);
+
+    if (g->enablestats && ci->entryticks != 0) {
         /* Reset entry time upon thread resumption for the current call only. */
         ci->entryticks = luaG_clocktime(g);
     }
 }
+
+/*
+** The sampling profiler is driven by a timer that raises an interrupt; the
+** call stack of the running thread is then recorded at the next safepoint.
+** Identical stacks are merged as they are recorded, so the buffers allocated
+** when sampling starts bound the memory used regardless of its duration.
+*/
+
+#if defined(LUA_USE_POSIX)
+
+static global_State *volatile samplingstate = NULL; /* state sampled on SIGPROF */
+static struct sigaction oldsigprof;
+
+static void sampletick (int sig) {
+    global_State *g = samplingstate;
+    lua_unused(sig);
+
+    if (g != NULL) {
+        luai_atomicor(&g->interrupt, LUAI_INTERRUPTSAMPLE);
+    }
+}
+
+static int starttimer (global_State *g, int hz) {
+    struct sigaction sa;
+    struct itimerval tv;
+    long period = 1000000L / hz;
+
+    if (samplingstate != NULL) {
+        return -1; /* the profiling timer is shared by the whole process */
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sampletick;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    memset(&tv, 0, sizeof(tv));
+    tv.it_interval.tv_sec = period / 1000000L;
+    tv.it_interval.tv_usec = (period > 0) ? (period % 1000000L) : 1;
+    tv.it_value = tv.it_interval;
+
+    samplingstate = g;
+
+    if (sigaction(SIGPROF, &sa, &oldsigprof) != 0) {
+        samplingstate = NULL;
+        return 0;
+    } else if (setitimer(ITIMER_PROF, &tv, NULL) != 0) {
+        sigaction(SIGPROF, &oldsigprof, NULL);
+        samplingstate = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+static void stoptimer (global_State *g) {
+    struct itimerval tv;
+    memset(&tv, 0, sizeof(tv));
+    setitimer(ITIMER_PROF, &tv, NULL);
+    sigaction(SIGPROF, &oldsigprof, NULL);
+    samplingstate = NULL;
+    luai_atomicand(&g->interrupt, ~LUAI_INTERRUPTSAMPLE);
+}
+
+#elif defined(LUA_USE_WINDOWS)
+
+static VOID CALLBACK sampletick (PVOID param, BOOLEAN fired) {
+    global_State *g = (global_State *) param;
+    lua_unused(fired);
+    luai_atomicor(&g->interrupt, LUAI_INTERRUPTSAMPLE);
+}
+
+static int starttimer (global_State *g, int hz) {
+    HANDLE timer;
+    DWORD period = (hz < 1000) ? (DWORD) (1000 / hz) : 1;
+
+    if (!CreateTimerQueueTimer(&timer, NULL, sampletick, g, period, period, WT_EXECUTEDEFAULT)) {
+        return 0;
+    }
+
+    g->sampler->timer = timer;
+    return 1;
+}
+
+static void stoptimer (global_State *g) {
+    /* waits for any running callback to complete */
+    DeleteTimerQueueTimer(NULL, (HANDLE) g->sampler->timer, INVALID_HANDLE_VALUE);
+    luai_atomicand(&g->interrupt, ~LUAI_INTERRUPTSAMPLE);
+}
+
+#else
+
+static int starttimer (global_State *g, int hz) {
+    lua_unused(g);
+    lua_unused(hz);
+    return 0; /* no timer available */
+}
+
+static void stoptimer (global_State *g) {
+    lua_unused(g);
+}
+
+#endif
+
+/*
+** Both profilers record call stacks into a `SampleTable'. The calls of a new
+** stack are written past the end of the known ones, and are only kept if no
+** identical stack (with the same tag) was recorded before.
+*/
+
+static void inittable (lua_State *L, SampleTable *t, int sizeframes, int sizestacks) {
+    t->frames = NULL;
+    t->stacks = NULL;
+    t->sizeframes = 0;
+    t->sizestacks = 0;
+    t->nframes = 0;
+    t->nstacks = 0;
+    t->frames = luaM_newvector(L, sizeframes, SampleFrame);
+    t->sizeframes = sizeframes;
+    t->stacks = luaM_newvector(L, sizestacks, SampleStack);
+    t->sizestacks = sizestacks;
+    memset(t->stacks, 0, sizeof(SampleStack) * sizestacks);
+}
+
+static void freetable (lua_State *L, SampleTable *t) {
+    luaM_freearray(L, t->frames, t->sizeframes, SampleFrame);
+    luaM_freearray(L, t->stacks, t->sizestacks, SampleStack);
+}
+
+/*
+** record the calls of the running thread after the known stacks; returns the
+** number of calls, or -1 if they don't fit
+*/
+static int recordstack (lua_State *L, SampleTable *t, int lines) {
+    SampleFrame *frames = t->frames + t->nframes;
+    CallInfo *ci;
+    int depth = 0;
+
+    for (ci = L->ci; ci > L->base_ci; ci--) {
+        if (!ttisfunction(ci->func)) {
+            continue; /* call being set up */
+        } else if (t->nframes + depth >= t->sizeframes) {
+            return -1;
+        }
+
+        getframe(L, ci, &frames[depth++], lines);
+    }
+
+    return depth;
+}
+
+/*
+** count a sample of the stack recorded by `recordstack'; returns its slot in
+** `stacks', or -1 if it's a new stack and the table is full
+*/
+static int countstack (SampleTable *t, int depth, unsigned int tag) {
+    const SampleFrame *frames = t->frames + t->nframes;
+    unsigned int h = tag;
+    unsigned int mask = cast(unsigned int, t->sizestacks - 1);
+    int i;
+
+    for (i = 0; i < depth; i++) {
+        h = hashframe(h, &frames[i]);
+    }
+
+    for (i = cast_int(h & mask); t->stacks[i].count != 0; i = cast_int((i + 1) & mask)) {
+        SampleStack *st = &t->stacks[i];
+
+        if (st->hash == h && st->tag == tag && st->depth == depth &&
+            equalframes(t->frames + st->start, frames, depth)) {
+            st->count++;
+            return i;
+        }
+    }
+
+    if (t->nstacks >= t->sizestacks - (t->sizestacks / 4)) { /* keep the table sparse */
+        return -1;
+    }
+
+    t->stacks[i].hash = h;
+    t->stacks[i].tag = tag;
+    t->stacks[i].start = t->nframes;
+    t->stacks[i].depth = depth;
+    t->stacks[i].count = 1;
+    t->nframes += depth;
+    t->nstacks++;
+    return i;
+}
+
+static void framename (char *buff, const SampleFrame *fr) {
+    char *c;
+
+    if (fr->p != NULL) {
+        char source[LUA_IDSIZE];
+        luaO_chunkid(source, (fr->p->source != NULL) ? getstr(fr->p->source) : "=?", LUA_IDSIZE);
+        snprintf(buff, LUA_IDSIZE + LUAI_MAXNUMBER2STR, "%s:%d", source, fr->line);
+    } else {
+        snprintf(buff, LUA_IDSIZE + LUAI_MAXNUMBER2STR, "[C]:%p", cast(void *, cast(size_t, fr->f)));
+    }
+
+    for (c = buff; *c != '\0'; c++) { /* semicolons separate frames */
+        if (*c == ';') {
+            *c = ',';
+        }
+    }
+}
+
+static int writestring (lua_State *L, lua_Writer writer, void *data, const char *str) {
+    return (*writer)(L, str, strlen(str), data);
+}
+
+/* write the calls of a stack in folded form, outermost first */
+static int writefolded (lua_State *L, const SampleTable *t, const SampleStack *st, lua_Writer writer, void *data) {
+    char buff[LUA_IDSIZE + LUAI_MAXNUMBER2STR];
+    int status = 0;
+    int n;
+
+    for (n = st->depth - 1; n >= 0 && status == 0; n--) {
+        framename(buff, &t->frames[st->start + n]);
+        status = writestring(L, writer, data, buff);
+
+        if (status == 0 && n > 0) {
+            status = writestring(L, writer, data, ";");
+        }
+    }
+
+    return status;
+}
+
+/*
+** CPU sampling
+*/
+
+static void freesampler (lua_State *L, Sampler *s) {
+    freetable(L, &s->t);
+    luaM_free(L, s);
+}
+
+/*
+** returns 1 if sampling started, 0 if this state is sampling already or there
+** is no profiling timer, and -1 if another state is using the timer
+*/
+int luaG_startsampling (lua_State *L, int hz) {
+    global_State *g = G(L);
+    Sampler *s;
+    int started;
+
+    if (g->sampler != NULL || hz <= 0) {
+        return 0;
+    }
+
+    s = luaM_new(L, Sampler);
+    s->t.frames = NULL;
+    s->t.stacks = NULL;
+    s->t.sizeframes = 0;
+    s->t.sizestacks = 0;
+    s->nsamples = 0;
+    s->ndropped = 0;
+    s->timer = NULL;
+    g->sampler = s; /* freed by `lua_close' if an allocation below fails */
+    inittable(L, &s->t, LUAI_SAMPLEFRAMES, LUAI_SAMPLESTACKS);
+    started = starttimer(g, hz);
+
+    if (started <= 0) {
+        g->sampler = NULL;
+        freesampler(L, s);
+    }
+
+    return started;
+}
+
+void luaG_freesampler (lua_State *L) {
+    global_State *g = G(L);
+    Sampler *s = g->sampler;
+
+    if (s != NULL) {
+        if (s->t.frames != NULL && s->t.stacks != NULL) {
+            stoptimer(g);
+        }
+
+        g->sampler = NULL;
+        freesampler(L, s);
+    }
+}
+
+void luaG_sample (lua_State *L) {
+    Sampler *s = G(L)->sampler;
+    int depth;
+
+    if (s == NULL) {
+        return;
+    }
+
+    depth = recordstack(L, &s->t, 0);
+
+    if (depth < 0 || countstack(&s->t, depth, 0) < 0) {
+        s->ndropped++;
+    } else {
+        s->nsamples++;
+    }
+}
+
+int luaG_dumpsamples (lua_State *L, lua_Writer writer, void *data) {
+    const Sampler *s = G(L)->sampler;
+    char buff[LUAI_MAXNUMBER2STR];
+    int status = 0;
+    int i;
+
+    if (s == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < s->t.sizestacks && status == 0; i++) {
+        const SampleStack *st = &s->t.stacks[i];
+
+        if (st->count != 0) {
+            status = writefolded(L, &s->t, st, writer, data);
+
+            if (status == 0) {
+                snprintf(buff, sizeof(buff), " %d\n", st->count);
+                status = writestring(L, writer, data, buff);
+            }
+        }
+    }
+
+    return status;
+}
+
+/*
+** Allocation sampling
+**
+** Allocations are sampled as a Poisson process over the allocated bytes: the
+** number of bytes between two samples is drawn from an exponential
+** distribution with a mean of `interval'. A sample of `size' bytes then
+** stands for `size / (1 - exp(-size / interval))' bytes. The call stack is
+** recorded before the block is allocated, as the allocation may move the
+** stack itself; the sample is completed once the block is known to hold a
+** new object (whose type and taint then tag the stack) or on the next
+** allocation otherwise.
+*/
+
+#define ALLOCTAG(tt, taint) ((cast(unsigned int, (tt) + 1)) | (cast(unsigned int, (taint)) << 8))
+#define ALLOCTAGTYPE(tag) (cast_int((tag) & 0xff) - 1)
+#define ALLOCTAGTAINT(tag) (cast(TaintRef, (tag) >> 8))
+
+static size_t nextinterval (AllocSampler *s) {
+    uint_least64_t x = s->seed;
+    double u;
+    double n;
+
+    x ^= x << 13; /* xorshift64 */
+    x ^= x >> 7;
+    x ^= x << 17;
+    s->seed = x;
+
+    u = cast(double, x >> 11) * (1.0 / 9007199254740992.0); /* [0, 1) */
+    n = -log(1.0 - u) * cast(double, s->interval);
+    return (n < 1.0) ? 1 : (n > cast(double, LUA_SIZE_MAX / 2)) ? LUA_SIZE_MAX / 2 : cast(size_t, n);
+}
+
+static void freeallocsampler (lua_State *L, AllocSampler *s) {
+    freetable(L, &s->t);
+    luaM_freearray(L, s->sites, s->t.sizestacks, AllocSite);
+    luaM_freearray(L, s->order, s->t.sizestacks, int);
+    luaM_freearray(L, s->blocks, s->sizeblocks, AllocBlock);
+    luaZ_freebuffer(L, &s->out);
+    luaZ_freebuffer(L, &s->msg);
+    luaZ_freebuffer(L, &s->ids);
+    luaM_free(L, s);
+}
+
+/*
+** run `f' with the allocations it makes left out of the samples; `busy' is
+** cleared again before any error raised by `f' propagates
+*/
+static int runbusy (lua_State *L, AllocSampler *s, Pfunc f, void *ud) {
+    int status;
+
+    s->busy = 1;
+    status = luaD_rawrunprotected(L, f, ud);
+    s->busy = 0;
+    return status;
+}
+
+static void f_initallocsampler (lua_State *L, void *ud) {
+    AllocSampler *s = cast(AllocSampler *, ud);
+
+    inittable(L, &s->t, LUAI_SAMPLEFRAMES, LUAI_SAMPLESTACKS);
+    s->sites = luaM_newvector(L, s->t.sizestacks, AllocSite);
+    s->order = luaM_newvector(L, s->t.sizestacks, int);
+    s->blocks = luaM_newvector(L, LUAI_SAMPLEBLOCKS, AllocBlock);
+    s->sizeblocks = LUAI_SAMPLEBLOCKS;
+    memset(s->blocks, 0, sizeof(AllocBlock) * s->sizeblocks);
+}
+
+int luaG_startallocsampling (lua_State *L, size_t interval) {
+    global_State *g = G(L);
+    AllocSampler *s;
+    int status;
+
+    if (g->allocsampler != NULL || interval == 0) {
+        return 0;
+    }
+
+    s = luaM_new(L, AllocSampler);
+    s->t.frames = NULL;
+    s->t.stacks = NULL;
+    s->t.sizeframes = 0;
+    s->t.sizestacks = 0;
+    s->sites = NULL;
+    s->order = NULL;
+    s->blocks = NULL;
+    s->sizeblocks = 0;
+    s->nblocks = 0;
+    s->interval = interval;
+    s->seed = cast(uint_least64_t, luaG_clocktime(g)) | 1;
+    s->countdown = nextinterval(s);
+    s->pending = NULL;
+    s->pendingsize = 0;
+    s->pendingdepth = 0;
+    s->nsamples = 0;
+    s->ndropped = 0;
+    s->busy = 0;
+    luaZ_initbuffer(L, &s->out);
+    luaZ_initbuffer(L, &s->msg);
+    luaZ_initbuffer(L, &s->ids);
+    g->allocsampler = s;
+    status = runbusy(L, s, f_initallocsampler, s);
+
+    if (status != 0) { /* not usable; drop it before passing the error on */
+        luaG_freeallocsampler(L);
+        luaD_throw(L, status);
+    }
+
+    return 1;
+}
+
+void luaG_freeallocsampler (lua_State *L) {
+    global_State *g = G(L);
+    AllocSampler *s = g->allocsampler;
+
+    if (s != NULL) {
+        g->allocsampler = NULL;
+        freeallocsampler(L, s);
+    }
+}
+
+static int findblock (const AllocSampler *s, const void *block) {
+    int mask = s->sizeblocks - 1;
+    int i;
+
+    for (i = cast_int((cast(size_t, block) >> 4) & mask); s->blocks[i].block != NULL; i = (i + 1) & mask) {
+        if (s->blocks[i].block == block) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* returns 0 if the table is full, in which case the block can't be reported as live */
+static int trackblock (AllocSampler *s, void *block, int site, lua_Number bytes, lua_Number objects) {
+    int mask = s->sizeblocks - 1;
+    int i;
+
+    if (s->nblocks >= s->sizeblocks - (s->sizeblocks / 4)) {
+        return 0;
+    }
+
+    for (i = cast_int((cast(size_t, block) >> 4) & mask); s->blocks[i].block != NULL; i = (i + 1) & mask) {
+    }
+
+    s->blocks[i].block = block;
+    s->blocks[i].site = site;
+    s->blocks[i].bytes = bytes;
+    s->blocks[i].objects = objects;
+    s->nblocks++;
+    return 1;
+}
+
+static void untrackblock (AllocSampler *s, int i) {
+    int mask = s->sizeblocks - 1;
+    int j;
+    AllocSite *site = &s->sites[s->blocks[i].site];
+
+    site->livebytes -= s->blocks[i].bytes;
+    site->liveobjects -= s->blocks[i].objects;
+    s->blocks[i].block = NULL;
+    s->nblocks--;
+
+    /* move back any following entries that can't be found past the hole */
+    for (j = (i + 1) & mask; s->blocks[j].block != NULL; j = (j + 1) & mask) {
+        int home = cast_int((cast(size_t, s->blocks[j].block) >> 4) & mask);
+
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            s->blocks[i] = s->blocks[j];
+            s->blocks[j].block = NULL;
+            i = j;
+        }
+    }
+}
+
+/* complete the pending sample; `o' is the object it holds, if any */
+static void finishsample (AllocSampler *s, GCObject *o) {
+    unsigned int tag = (o != NULL) ? ALLOCTAG(o->gch.tt, luaR_getobjecttaint(o)) : 0;
+    int slot = countstack(&s->t, s->pendingdepth, tag);
+
+    if (slot < 0) {
+        s->ndropped++;
+    } else {
+        AllocSite *site = &s->sites[slot];
+        lua_Number size = cast_num(s->pendingsize);
+        lua_Number objects = 1 / (1 - exp(-size / cast_num(s->interval)));
+
+        s->nsamples++;
+
+        if (s->t.stacks[slot].count == 1) { /* new stack? */
+            s->order[s->t.nstacks - 1] = slot;
+            site->allocbytes = site->allocobjects = 0;
+            site->livebytes = site->liveobjects = 0;
+        }
+
+        site->allocbytes += size * objects;
+        site->allocobjects += objects;
+
+        if (trackblock(s, s->pending, slot, size * objects, objects)) {
+            site->livebytes += size * objects;
+            site->liveobjects += objects;
+        }
+    }
+
+    s->pending = NULL;
+}
+
+int luaG_allocsample (lua_State *L, void *block, size_t osize, size_t nsize) {
+    AllocSampler *s = G(L)->allocsampler;
+    int depth;
+
+    if (s->pending != NULL) {
+        finishsample(s, NULL); /* wasn't an object */
+    }
+
+    if (osize > 0 && s->nblocks > 0) {
+        int i = findblock(s, block);
+
+        if (i >= 0) {
+            untrackblock(s, i); /* freed or moved */
+        }
+    }
+
+    if (nsize == 0 || s->busy) {
+        return 0;
+    } else if (nsize < s->countdown) {
+        s->countdown -= nsize;
+        return 0;
+    }
+
+    s->countdown = nextinterval(s);
+    depth = recordstack(L, &s->t, 1);
+
+    if (depth < 0) {
+        s->ndropped++;
+        return 0;
+    }
+
+    s->pendingdepth = depth;
+    return 1;
+}
+
+void luaG_allocsampled (lua_State *L, void *block, size_t nsize) {
+    AllocSampler *s = G(L)->allocsampler;
+    s->pending = block;
+    s->pendingsize = nsize;
+}
+
+void luaG_sampleobject (lua_State *L, GCObject *o) {
+    AllocSampler *s = G(L)->allocsampler;
+
+    if (s->pending == o) {
+        finishsample(s, o);
+    }
+}
+
+static int writebuffer (lua_State *L, const void *p, size_t sz, void *ud) {
+    Mbuffer *b = cast(Mbuffer *, ud);
+
+    if (luaZ_bufflen(b) + sz > luaZ_sizebuffer(b)) {
+        size_t size = luaZ_sizebuffer(b) * 2;
+        luaZ_resizebuffer(L, b, (size < luaZ_bufflen(b) + sz) ? luaZ_bufflen(b) + sz : size);
+    }
+
+    memcpy(luaZ_buffer(b) + luaZ_bufflen(b), p, sz);
+    b->n += sz;
+    return 0;
+}
+
+static void f_pushsitestack (lua_State *L, void *ud) {
+    AllocSampler *s = G(L)->allocsampler;
+    TString *ts;
+
+    luaZ_resetbuffer(&s->out);
+    writefolded(L, &s->t, cast(const SampleStack *, ud), writebuffer, &s->out);
+
+    if (luaZ_bufflen(&s->out) == 0) { /* sampled with no frames; the buffer may not exist */
+        ts = luaS_newliteral(L, "");
+    } else {
+        ts = luaS_newlstr(L, luaZ_buffer(&s->out), luaZ_bufflen(&s->out));
+    }
+
+    setsvalue2s(L, L->top, ts);
+    incr_top(L);
+}
+
+int luaG_getallocstats (lua_State *L, int site, lua_AllocStats *stats) {
+    AllocSampler *s = G(L)->allocsampler;
+    const SampleStack *st;
+    const AllocSite *as;
+    TString *taint;
+    int status;
+
+    if (s == NULL || site < 1 || site > s->t.nstacks) {
+        return 0;
+    }
+
+    if (s->pending != NULL) {
+        finishsample(s, NULL);
+    }
+
+    st = &s->t.stacks[s->order[site - 1]];
+    as = &s->sites[s->order[site - 1]];
+    taint = luaR_gettaintname(G(L), ALLOCTAGTAINT(st->tag));
+    stats->type = (ALLOCTAGTYPE(st->tag) >= 0) ? luaT_typenames[ALLOCTAGTYPE(st->tag)] : "memory";
+    stats->taint = (taint != NULL) ? getstr(taint) : NULL;
+    stats->allocbytes = as->allocbytes;
+    stats->allocobjects = as->allocobjects;
+    stats->livebytes = (as->livebytes > 0) ? as->livebytes : 0; /* may drift below 0 */
+    stats->liveobjects = (as->liveobjects > 0) ? as->liveobjects : 0;
+
+    status = runbusy(L, s, f_pushsitestack, cast(void *, st));
+
+    if (status != 0) {
+        luaD_throw(L, status);
+    }
+
+    return 1;
+}
+
+/*
+** The allocation profile is dumped in the protocol buffer format read by
+** pprof (`profile.proto'), with an allocation and an in-use count and size
+** for each site, and the type and taint of its allocations as labels.
+*/
+
+/* fields of the messages in `profile.proto' */
+#define PB_PROFILE_SAMPLETYPE 1
+#define PB_PROFILE_SAMPLE 2
+#define PB_PROFILE_LOCATION 4
+#define PB_PROFILE_FUNCTION 5
+#define PB_PROFILE_STRINGTABLE 6
+#define PB_PROFILE_PERIODTYPE 11
+#define PB_PROFILE_PERIOD 12
+#define PB_VALUETYPE_TYPE 1
+#define PB_VALUETYPE_UNIT 2
+#define PB_SAMPLE_LOCATIONID 1
+#define PB_SAMPLE_VALUE 2
+#define PB_SAMPLE_LABEL 3
+#define PB_LABEL_KEY 1
+#define PB_LABEL_STR 2
+#define PB_LOCATION_ID 1
+#define PB_LOCATION_LINE 4
+#define PB_LINE_FUNCTIONID 1
+#define PB_LINE_LINE 2
+#define PB_FUNCTION_ID 1
+#define PB_FUNCTION_NAME 2
+#define PB_FUNCTION_SYSTEMNAME 3
+#define PB_FUNCTION_FILENAME 4
+#define PB_FUNCTION_STARTLINE 5
+
+/* fixed entries of the string table */
+enum {
+    PB_STR_EMPTY,
+    PB_STR_ALLOCOBJECTS,
+    PB_STR_COUNT,
+    PB_STR_ALLOCSPACE,
+    PB_STR_BYTES,
+    PB_STR_INUSEOBJECTS,
+    PB_STR_INUSESPACE,
+    PB_STR_SPACE,
+    PB_STR_TYPE,
+    PB_STR_TAINT,
+    PB_NSTRINGS
+};
+
+static const char *const pbstrings[PB_NSTRINGS] = {
+    "", "alloc_objects", "count", "alloc_space", "bytes", "inuse_objects", "inuse_space", "space", "type", "taint",
+};
+
+static void pbvarint (lua_State *L, Mbuffer *b, uint_least64_t v) {
+    char buff[10];
+    int n = 0;
+
+    do {
+        buff[n++] = cast(char, (v & 0x7f) | ((v > 0x7f) ? 0x80 : 0));
+        v >>= 7;
+    } while (v != 0);
+
+    writebuffer(L, buff, n, b);
+}
+
+static void pbint (lua_State *L, Mbuffer *b, int field, uint_least64_t v) {
+    pbvarint(L, b, cast(uint_least64_t, field) << 3); /* varint */
+    pbvarint(L, b, v);
+}
+
+static void pbbytes (lua_State *L, Mbuffer *b, int field, const void *p, size_t sz) {
+    pbvarint(L, b, (cast(uint_least64_t, field) << 3) | 2); /* length-delimited */
+    pbvarint(L, b, sz);
+    writebuffer(L, p, sz, b);
+}
+
+/* append the message built in `msg' to `out' */
+static void pbmessage (lua_State *L, AllocSampler *s, int field) {
+    pbbytes(L, &s->out, field, luaZ_buffer(&s->msg), luaZ_bufflen(&s->msg));
+    luaZ_resetbuffer(&s->msg);
+}
+
+static int pbstring (lua_State *L, AllocSampler *s, const char *str, int *nstrings) {
+    pbbytes(L, &s->out, PB_PROFILE_STRINGTABLE, str, strlen(str));
+    return (*nstrings)++;
+}
+
+static void pbvaluetype (lua_State *L, AllocSampler *s, int field, int type, int unit) {
+    pbint(L, &s->msg, PB_VALUETYPE_TYPE, type);
+    pbint(L, &s->msg, PB_VALUETYPE_UNIT, unit);
+    pbmessage(L, s, field);
+}
+
+/* small submessages are built on the C stack; `size' must fit the message */
+static void pbinitbuffer (Mbuffer *b, char *buff, size_t size) {
+    b->buffer = buff;
+    b->buffsize = size;
+    b->n = 0;
+}
+
+static void pblabel (lua_State *L, Mbuffer *b, int key, int str) {
+    char buff[24];
+    Mbuffer label;
+    pbinitbuffer(&label, buff, sizeof(buff));
+    pbint(L, &label, PB_LABEL_KEY, key);
+    pbint(L, &label, PB_LABEL_STR, str);
+    pbbytes(L, b, PB_SAMPLE_LABEL, luaZ_buffer(&label), luaZ_bufflen(&label));
+}
+
+/*
+** functions are written once for each distinct Lua prototype or C function;
+** `ids' maps the calls of all stacks to their function id, followed by a
+** hash table of the first call of each function
+*/
+static void pbfunctions (lua_State *L, AllocSampler *s, int *nstrings) {
+    int *ids;
+    int *first;
+    int sizefirst = 1;
+    int nfunctions = 0;
+    int i;
+
+    while (sizefirst < s->t.nframes * 2) {
+        sizefirst *= 2;
+    }
+
+    luaZ_resetbuffer(&s->ids);
+    luaZ_resizebuffer(L, &s->ids, sizeof(int) * (s->t.nframes + sizefirst));
+    ids = cast(int *, luaZ_buffer(&s->ids));
+    first = ids + s->t.nframes;
+
+    for (i = 0; i < sizefirst; i++) {
+        first[i] = -1;
+    }
+
+    for (i = 0; i < s->t.nframes; i++) {
+        const SampleFrame *fr = &s->t.frames[i];
+        size_t id = (fr->p != NULL) ? cast(size_t, fr->p) : cast(size_t, fr->f);
+        int h = cast_int((id >> 4) & cast(size_t, sizefirst - 1));
+        char name[LUA_IDSIZE + LUAI_MAXNUMBER2STR];
+        char source[LUA_IDSIZE];
+        SampleFrame def = *fr;
+        int namestring;
+
+        while (first[h] >= 0 && (s->t.frames[first[h]].p != fr->p || s->t.frames[first[h]].f != fr->f)) {
+            h = (h + 1) & (sizefirst - 1);
+        }
+
+        if (first[h] >= 0) { /* seen before? */
+            ids[i] = ids[first[h]];
+            continue;
+        }
+
+        first[h] = i;
+        ids[i] = ++nfunctions;
+        def.line = (fr->p != NULL) ? fr->p->linedefined : 0;
+        framename(name, &def);
+
+        if (fr->p != NULL) {
+            luaO_chunkid(source, (fr->p->source != NULL) ? getstr(fr->p->source) : "=?", LUA_IDSIZE);
+        } else {
+            strcpy(source, "[C]");
+        }
+
+        namestring = pbstring(L, s, name, nstrings);
+        pbint(L, &s->msg, PB_FUNCTION_ID, ids[i]);
+        pbint(L, &s->msg, PB_FUNCTION_NAME, namestring);
+        pbint(L, &s->msg, PB_FUNCTION_SYSTEMNAME, namestring);
+        pbint(L, &s->msg, PB_FUNCTION_FILENAME, pbstring(L, s, source, nstrings));
+        pbint(L, &s->msg, PB_FUNCTION_STARTLINE, def.line);
+        pbmessage(L, s, PB_PROFILE_FUNCTION);
+    }
+}
+
+/* encode the profile into `s->out' */
+static void f_encodeallocprofile (lua_State *L, void *ud) {
+    AllocSampler *s = cast(AllocSampler *, ud);
+    int typestrings[LUA_TUPVAL + 1];
+    int nstrings = 0;
+    int i;
+    int n;
+
+    luaZ_resetbuffer(&s->out);
+    luaZ_resetbuffer(&s->msg);
+
+    for (i = 0; i < PB_NSTRINGS; i++) {
+        pbstring(L, s, pbstrings[i], &nstrings);
+    }
+
+    for (i = 0; i <= LUA_TUPVAL; i++) {
+        typestrings[i] = -1;
+    }
+
+    pbvaluetype(L, s, PB_PROFILE_SAMPLETYPE, PB_STR_ALLOCOBJECTS, PB_STR_COUNT);
+    pbvaluetype(L, s, PB_PROFILE_SAMPLETYPE, PB_STR_ALLOCSPACE, PB_STR_BYTES);
+    pbvaluetype(L, s, PB_PROFILE_SAMPLETYPE, PB_STR_INUSEOBJECTS, PB_STR_COUNT);
+    pbvaluetype(L, s, PB_PROFILE_SAMPLETYPE, PB_STR_INUSESPACE, PB_STR_BYTES);
+    pbvaluetype(L, s, PB_PROFILE_PERIODTYPE, PB_STR_SPACE, PB_STR_BYTES);
+    pbint(L, &s->out, PB_PROFILE_PERIOD, s->interval);
+    pbfunctions(L, s, &nstrings);
+
+    /* each call has its own location, identified by its index in `frames' */
+    for (i = 0; i < s->t.nframes; i++) {
+        char buff[32];
+        Mbuffer line;
+        pbinitbuffer(&line, buff, sizeof(buff));
+        pbint(L, &line, PB_LINE_FUNCTIONID, cast(int *, luaZ_buffer(&s->ids))[i]);
+        pbint(L, &line, PB_LINE_LINE, cast(uint_least64_t, (s->t.frames[i].line > 0) ? s->t.frames[i].line : 0));
+        pbint(L, &s->msg, PB_LOCATION_ID, i + 1);
+        pbbytes(L, &s->msg, PB_LOCATION_LINE, luaZ_buffer(&line), luaZ_bufflen(&line));
+        pbmessage(L, s, PB_PROFILE_LOCATION);
+    }
+
+    for (n = 0; n < s->t.nstacks; n++) {
+        const SampleStack *st = &s->t.stacks[s->order[n]];
+        const AllocSite *as = &s->sites[s->order[n]];
+        int type = ALLOCTAGTYPE(st->tag);
+        TString *taint = luaR_gettaintname(G(L), ALLOCTAGTAINT(st->tag));
+        Mbuffer *b = &s->ids; /* reused for the packed fields */
+        int taintstring = (taint != NULL) ? pbstring(L, s, getstr(taint), &nstrings) : -1;
+
+        if (type >= 0 && typestrings[type] < 0) {
+            typestrings[type] = pbstring(L, s, luaT_typenames[type], &nstrings);
+        }
+
+        luaZ_resetbuffer(b);
+
+        for (i = 0; i < st->depth; i++) {
+            pbvarint(L, b, cast(uint_least64_t, st->start + i + 1));
+        }
+
+        pbbytes(L, &s->msg, PB_SAMPLE_LOCATIONID, luaZ_buffer(b), luaZ_bufflen(b));
+        luaZ_resetbuffer(b);
+        pbvarint(L, b, cast(uint_least64_t, as->allocobjects + 0.5));
+        pbvarint(L, b, cast(uint_least64_t, as->allocbytes + 0.5));
+        pbvarint(L, b, cast(uint_least64_t, (as->liveobjects > 0) ? as->liveobjects + 0.5 : 0));
+        pbvarint(L, b, cast(uint_least64_t, (as->livebytes > 0) ? as->livebytes + 0.5 : 0));
+        pbbytes(L, &s->msg, PB_SAMPLE_VALUE, luaZ_buffer(b), luaZ_bufflen(b));
+
+        if (type >= 0) {
+            pblabel(L, &s->msg, PB_STR_TYPE, typestrings[type]);
+        }
+
+        if (taintstring >= 0) {
+            pblabel(L, &s->msg, PB_STR_TAINT, taintstring);
+        }
+
+        pbmessage(L, s, PB_PROFILE_SAMPLE);
+    }
+}
+
+int luaG_dumpallocprofile (lua_State *L, lua_Writer writer, void *data) {
+    AllocSampler *s = G(L)->allocsampler;
+    int status;
+
+    if (s == NULL) {
+        return 0;
+    }
+
+    if (s->pending != NULL) {
+        finishsample(s, NULL);
+    }
+
+    status = runbusy(L, s, f_encodeallocprofile, s);
+
+    if (status != 0) {
+        luaD_throw(L, status);
+    }
+
+    return (*writer)(L, luaZ_buffer(&s->out), luaZ_bufflen(&s->out), data);
+}
+
+/*
+** Call graph reports
+**
+** Calls are named by their function and line as written by `framename'. The
+** call graph is dumped in the callgrind format read by KCachegrind, with the
+** time spent in each function counted on the line where it's defined and the
+** time of each call counted on the line of the call.
+*/
+
+static void pushframename (lua_State *L, const SampleFrame *fr) {
+    if (fr->p != NULL || fr->f != NULL) {
+        char buff[LUA_IDSIZE + LUAI_MAXNUMBER2STR];
+        framename(buff, fr);
+        setsvalue2s(L, L->top, luaS_new(L, buff));
+    } else {
+        setnilvalue(L, L->top);
+    }
+
+    incr_top(L);
+}
+
+int luaG_getcallgraph (lua_State *L, int edge, lua_FunctionStats *stats) {
+    const CallGraph *cg = getcallgraph(L);
+    const CallEdge *e;
+
+    if (cg == NULL || edge < 1 || edge > cg->nedges) {
+        return 0;
+    }
+
+    e = &cg->edges[edge - 1];
+    stats->calls = cast_int(e->calls);
+    stats->ownticks = e->ownticks;
+    stats->subticks = e->subticks;
+    pushframename(L, &e->caller);
+    pushframename(L, &e->callee);
+    return 1;
+}
+
+/* write the `fl=' and `fn=' lines (or `cfl=' and `cfn=') of a function */
+static int writefunction (lua_State *L, const SampleFrame *fr, const char *prefix, lua_Writer writer, void *data) {
+    char buff[LUA_IDSIZE + LUAI_MAXNUMBER2STR];
+    char source[LUA_IDSIZE];
+    SampleFrame def = *fr;
+    int status;
+
+    def.line = (fr->p != NULL) ? fr->p->linedefined : 0;
+    luaO_chunkid(source, (fr->p == NULL) ? "=[C]" : (fr->p->source != NULL) ? getstr(fr->p->source) : "=?", LUA_IDSIZE);
+    framename(buff, &def);
+
+    status = writestring(L, writer, data, prefix);
+    status = status || writestring(L, writer, data, "fl=");
+    status = status || writestring(L, writer, data, source);
+    status = status || writestring(L, writer, data, "\n");
+    status = status || writestring(L, writer, data, prefix);
+    status = status || writestring(L, writer, data, "fn=");
+    status = status || writestring(L, writer, data, buff);
+    status = status || writestring(L, writer, data, "\n");
+    return status;
+}
+
+int luaG_dumpcallgraph (lua_State *L, lua_Writer writer, void *data) {
+    const CallGraph *cg = getcallgraph(L);
+    char buff[4 * LUAI_MAXNUMBER2STR];
+    int status;
+    int i;
+
+    status = writestring(L, writer, data, "# callgrind format\nversion: 1\ncreator: " LUA_RELEASE "\n");
+    status = status || writestring(L, writer, data, "positions: line\nevents: Ticks\n");
+
+    for (i = 0; cg != NULL && i < cg->nedges && status == 0; i++) {
+        const CallEdge *e = &cg->edges[i];
+
+        /* time spent in the callee itself */
+        snprintf(buff, sizeof(buff), "%d %lld\n", e->callee.line, cast(long long, e->ownticks));
+        status = writestring(L, writer, data, "\n");
+        status = status || writefunction(L, &e->callee, "", writer, data);
+        status = status || writestring(L, writer, data, buff);
+
+        /* and the call, including time spent in subroutines */
+        if (status == 0 && (e->caller.p != NULL || e->caller.f != NULL)) {
+            snprintf(buff, sizeof(buff), "calls=%lu %d\n%d %lld\n", cast(unsigned long, e->calls), e->callee.line,
+                     e->caller.line, cast(long long, e->subticks));
+            status = writestring(L, writer, data, "\n");
+            status = status || writefunction(L, &e->caller, "", writer, data);
+            status = status || writefunction(L, &e->callee, "c", writer, data);
+            status = status || writestring(L, writer, data, buff);
+        }
+    }
+
+    return status;
+}
+
+/*
+** Timeline tracing
+**
+** Events are recorded into a ring buffer allocated when tracing starts, so
+** recording never allocates and only the most recent events are kept. They
+** are written in the Chrome trace event format read by Perfetto, with one
+** track for each thread; calls and collector work are written as nested
+** durations and coroutine switches and stack taint changes as instants.
+*/
+
+int luaG_starttracing (lua_State *L, int size) {
+    global_State *g = G(L);
+    Tracer *t;
+
+    if (g->tracer != NULL) {
+        return 0;
+    }
+
+    t = luaM_new(L, Tracer);
+    t->events = NULL;
+    t->sizeevents = 0;
+    t->nevents = 0;
+    g->tracer = t;
+    t->events = luaM_newvector(L, (size > 0) ? size : LUAI_TRACEEVENTS, TraceEvent);
+    t->sizeevents = (size > 0) ? size : LUAI_TRACEEVENTS;
+    memset(t->events, 0, sizeof(TraceEvent) * t->sizeevents);
+    return 1;
+}
+
+void luaG_traceevent (lua_State *L, int type, const Closure *cl, int arg) {
+    Tracer *t = G(L)->tracer;
+    TraceEvent *ev = &t->events[t->nevents++ % cast(size_t, t->sizeevents)];
+    ev->ticks = luaG_clocktime(G(L));
+    ev->thread = L;
+    ev->p = (cl != NULL && !cl->c.isC) ? cl->l.p : NULL;
+    ev->f = (cl != NULL && cl->c.isC) ? cl->c.f : NULL;
+    ev->arg = arg;
+    ev->type = cast_byte(type);
+}
+
+void luaG_freetracer (lua_State *L) {
+    Tracer *t = G(L)->tracer;
+
+    if (t != NULL) {
+        G(L)->tracer = NULL;
+        luaM_freearray(L, t->events, t->sizeevents, TraceEvent);
+        luaM_free(L, t);
+    }
+}
+
+static int writejsonstring (lua_State *L, lua_Writer writer, void *data, const char *str) {
+    char buff[8];
+    int status = writestring(L, writer, data, "\"");
+
+    for (; *str != '\0' && status == 0; str++) {
+        if (*str == '"' || *str == '\\') {
+            snprintf(buff, sizeof(buff), "\\%c", *str);
+        } else if (cast(unsigned char, *str) < 0x20) {
+            snprintf(buff, sizeof(buff), "\\u%04x", cast(unsigned int, cast(unsigned char, *str)));
+        } else {
+            buff[0] = *str;
+            buff[1] = '\0';
+        }
+
+        status = writestring(L, writer, data, buff);
+    }
+
+    return status || writestring(L, writer, data, "\"");
+}
+
+static int writeevent (lua_State *L, const TraceEvent *ev, lua_Writer writer, void *data) {
+    static const char *const phases[] = { "B", "E", "i", "i", "B", "E", "B", "E", "i" };
+    static const char *const categories[] = { "call", "call", "coroutine", "coroutine", "gc", "gc", "gc", "gc", "taint" };
+    static const char *const names[] = { "", "", "resume", "yield", "step", "step", "__gc", "__gc", "" };
+    const global_State *g = G(L);
+    char name[LUA_IDSIZE + LUAI_MAXNUMBER2STR];
+    char buff[128];
+    double ts = cast(double, ev->ticks) * 1e6 / cast(double, g->tickfreq);
+    int status;
+
+    switch (ev->type) {
+        case TRACE_CALL:
+        case TRACE_RETURN: {
+            SampleFrame fr;
+            fr.p = ev->p;
+            fr.f = ev->f;
+            fr.line = (ev->p != NULL) ? ev->p->linedefined : 0;
+            framename(name, &fr);
+            break;
+        }
+        case TRACE_TAINT: {
+            TString *taint = luaR_gettaintname(G(L), cast(TaintRef, ev->arg));
+            snprintf(name, sizeof(name), "%s", (taint != NULL) ? getstr(taint) : "(secure)");
+            break;
+        }
+        default: {
+            snprintf(name, sizeof(name), "%s", names[ev->type]);
+            break;
+        }
+    }
+
+    snprintf(buff, sizeof(buff), "{\"ph\":\"%s\",\"cat\":\"%s\",\"name\":", phases[ev->type], categories[ev->type]);
+    status = writestring(L, writer, data, buff);
+    status = status || writejsonstring(L, writer, data, name);
+    snprintf(buff, sizeof(buff), ",\"ts\":%.3f,\"pid\":1,\"tid\":%lu%s}", ts, cast(unsigned long, cast(size_t, ev->thread)),
+             (phases[ev->type][0] == 'i') ? ",\"s\":\"t\"" : ""); /* instants are scoped to their thread */
+    return status || writestring(L, writer, data, buff);
+}
+
+int luaG_dumptrace (lua_State *L, lua_Writer writer, void *data) {
+    const Tracer *t = G(L)->tracer;
+    char buff[128];
+    size_t i;
+    int status;
+
+    snprintf(buff, sizeof(buff),
+             "{\"traceEvents\":[\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"main\"}}",
+             cast(unsigned long, cast(size_t, G(L)->mainthread)));
+    status = writestring(L, writer, data, buff);
+
+    if (t != NULL) {
+        size_t sizeevents = cast(size_t, t->sizeevents);
+
+        for (i = (t->nevents > sizeevents) ? t->nevents - sizeevents : 0; i < t->nevents && status == 0; i++) {
+            status = writestring(L, writer, data, ",\n");
+            status = status || writeevent(L, &t->events[i % sizeevents], writer, data);
+        }
+    }
+
+    return status || writestring(L, writer, data, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
@@ -12,6 +12,20 @@
 
 #define resethookcount(L) (L->hookcount = L->basehookcount)
 
+/* tag a sampled allocation with the type and taint of the object it holds */
+#define luaG_allocobject(L, o)                                                                                         \
+    {                                                                                                                  \
+        if (G(L)->allocsampler != NULL)                                                                                \
+            luaG_sampleobject(L, o);                                                                                   \
+    }
+
+/* record an event on the timeline */
+#define luaG_trace(L, type, cl, arg)                                                                                   \
+    {                                                                                                                  \
+        if (G(L)->tracer != NULL)                                                                                      \
+            luaG_traceevent(L, type, cl, arg);                                                                         \
+    }
+
 LUAI_FUNC LUA_NORETURN void luaG_typeerror (lua_State *L, const TValue *o, const char *opname);
 LUAI_FUNC LUA_NORETURN void luaG_concaterror (lua_State *L, StkId p1, StkId p2);
 LUAI_FUNC LUA_NORETURN void luaG_aritherror (lua_State *L, const TValue *p1, const TValue *p2);
@@ -27,7 +41,27 @@ LUAI_FUNC void luaG_init (global_State *g);
 LUAI_FUNC void luaG_profileenter (lua_State *L);
 LUAI_FUNC void luaG_profileleave (lua_State *L);
 LUAI_FUNC void luaG_profileresume (lua_State *L);
+LUAI_FUNC ClosureStats *luaG_getclosurestats (lua_State *L, Closure *cl);
+LUAI_FUNC void luaG_freestats (lua_State *L);
+LUAI_FUNC void luaG_startcallgraph (lua_State *L);
+LUAI_FUNC int luaG_getcallgraph (lua_State *L, int edge, lua_FunctionStats *stats);
+LUAI_FUNC int luaG_dumpcallgraph (lua_State *L, lua_Writer writer, void *data);
+LUAI_FUNC int luaG_starttracing (lua_State *L, int size);
+LUAI_FUNC void luaG_traceevent (lua_State *L, int type, const Closure *cl, int arg);
+LUAI_FUNC int luaG_dumptrace (lua_State *L, lua_Writer writer, void *data);
+LUAI_FUNC void luaG_freetracer (lua_State *L);
 LUAI_FUNC lua_Clock luaG_clocktime (const global_State *g);
 LUAI_FUNC lua_Clock luaG_clockrate (const global_State *g);
+LUAI_FUNC int luaG_startsampling (lua_State *L, int hz);
+LUAI_FUNC void luaG_sample (lua_State *L);
+LUAI_FUNC int luaG_dumpsamples (lua_State *L, lua_Writer writer, void *data);
+LUAI_FUNC void luaG_freesampler (lua_State *L);
+LUAI_FUNC int luaG_startallocsampling (lua_State *L, size_t interval);
+LUAI_FUNC int luaG_allocsample (lua_State *L, void *block, size_t osize, size_t nsize);
+LUAI_FUNC void luaG_allocsampled (lua_State *L, void *block, size_t nsize);
+LUAI_FUNC void luaG_sampleobject (lua_State *L, GCObject *o);
+LUAI_FUNC int luaG_getallocstats (lua_State *L, int site, lua_AllocStats *stats);
+LUAI_FUNC int luaG_dumpallocprofile (lua_State *L, lua_Writer writer, void *data);
+LUAI_FUNC void luaG_freeallocsampler (lua_State *L);
 
 #endif
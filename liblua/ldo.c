@@ -19,6 +19,7 @@
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lparser.h"
+#include "lsec.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
@@ -142,12 +143,15 @@ CallInfo *luaD_unwindci (lua_State *L, CallInfo *newci, CallInfo *oldci) {
 
     /* Unwind the cis from top-to-bottom stopping at one above the base. */
     for (ci = citop; ci != cibase; --ci) {
-        Closure *cl = ci_func(ci);
-        lua_assert(cl->c.nopencalls > 0);
-        cl->c.nopencalls--;
+        if (ci->stats != NULL) {
+            lua_assert(ci->stats->nopencalls > 0);
+            ci->stats->nopencalls--;
+            ci->stats = NULL;
+        }
+        luaG_trace(L, TRACE_RETURN, ci_func(ci), 0);
     }
 
-    L->fixedtaint = NULL;
+    luaR_setfixedtaint(L, 0);
     return newci;
 }
 
@@ -198,6 +202,7 @@ void luaD_reallocstack (lua_State *L, int newsize) {
     int realsize = newsize + 1 + EXTRA_STACK;
     lua_assert(L->stack_last - L->stack == L->stacksize - EXTRA_STACK - 1);
     luaM_reallocvector(L, L->stack, L->stacksize, realsize, TValue);
+    luaR_resizeowned(L, obj2gco(L), sizeof(TValue) * L->stacksize, sizeof(TValue) * realsize);
     L->stacksize = realsize;
     L->stack_last = L->stack + newsize;
     correctstack(L, oldstack);
@@ -206,6 +211,7 @@ void luaD_reallocstack (lua_State *L, int newsize) {
 void luaD_reallocCI (lua_State *L, int newsize) {
     CallInfo *oldci = L->base_ci;
     luaM_reallocvector(L, L->base_ci, L->size_ci, newsize, CallInfo);
+    luaR_resizeowned(L, obj2gco(L), sizeof(CallInfo) * L->size_ci, sizeof(CallInfo) * newsize);
     L->size_ci = newsize;
     L->ci = (L->ci - oldci) + L->base_ci;
     L->end_ci = L->base_ci + L->size_ci - 1;
@@ -236,7 +242,7 @@ void luaD_callhook (lua_State *L, int event, int line) {
     if (hook && L->allowhook) {
         ptrdiff_t top = savestack(L, L->top);
         ptrdiff_t ci_top = savestack(L, L->ci->top);
-        TString *fixedtaint = L->fixedtaint;
+        TaintRef fixedtaint = luaR_getfixedtaint(L);
         lua_Debug ar;
         ar.event = event;
         ar.currentline = line;
@@ -249,12 +255,12 @@ void luaD_callhook (lua_State *L, int event, int line) {
         L->ci->top = L->top + LUA_MINSTACK;
         lua_assert(L->ci->top <= L->stack_last);
         L->allowhook = 0; /* cannot call hooks inside a hook */
-        L->fixedtaint = NULL; /* about to call into C */
+        luaR_setfixedtaint(L, 0); /* about to call into C */
         lua_unlock(L);
         (*hook)(L, &ar);
         lua_lock(L);
         lua_assert(!L->allowhook);
-        L->fixedtaint = fixedtaint;
+        luaR_setfixedtaint(L, fixedtaint);
         L->allowhook = 1;
         L->ci->top = restorestack(L, ci_top);
         L->top = restorestack(L, top);
@@ -313,8 +319,8 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
     funcr = savestack(L, func);
     cl = &clvalue(func)->l;
     L->ci->savedpc = L->savedpc;
-    L->ci->savedtaint = L->stacktaint;
-    L->fixedtaint = NULL;
+    luaR_setcalltaint(L->ci, luaR_getstacktaint(L));
+    luaR_setfixedtaint(L, 0);
     if (!cl->isC) { /* Lua function? prepare its call */
         CallInfo *ci;
         StkId st;
@@ -341,12 +347,13 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
         ci->entryticks = 0;
         ci->startticks = 0;
         ci->tailcalls = 0;
+        ci->stats = NULL;
         ci->nresults = nresults;
         for (st = L->top; st < ci->top; st++) {
             setnilvalue(L, st);
         }
         L->top = ci->top;
-        cl->nopencalls++;
+        luaG_trace(L, TRACE_CALL, clvalue(func), 0);
         if (L->hookmask & LUA_MASKCALL) {
             L->savedpc++; /* hooks assume 'pc' is already incremented */
             luaD_callhook(L, LUA_HOOKCALL, -1);
@@ -364,8 +371,9 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
         lua_assert(ci->top <= L->stack_last);
         ci->entryticks = 0;
         ci->startticks = 0;
+        ci->stats = NULL;
         ci->nresults = nresults;
-        cl->nopencalls++;
+        luaG_trace(L, TRACE_CALL, ci_func(ci), 0);
         if (L->hookmask & LUA_MASKCALL) {
             luaD_callhook(L, LUA_HOOKCALL, -1);
         }
@@ -520,6 +528,7 @@ LUA_API int lua_yield (lua_State *L, int nresults) {
     }
     L->base = L->top - nresults; /* protect stack slots below */
     L->status = LUA_YIELD;
+    luaG_trace(L, TRACE_YIELD, NULL, 0);
     lua_unlock(L);
     return -1;
 }
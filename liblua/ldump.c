@@ -9,6 +9,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -60,7 +61,15 @@ static void DumpString (const TString *s, DumpState *D) {
     }
 }
 
-#define DumpCode(f, D) DumpVector(f->code, f->sizecode, sizeof(Instruction), D)
+static void DumpCode (const Proto *f, DumpState *D) {
+    int pc;
+    DumpInt(f->sizecode, D);
+    for (pc = 0; pc < f->sizecode; pc++) {
+        Instruction i = f->code[pc];
+        SET_OPCODE(i, GET_GENERICOP(i)); /* dump specialized instructions as generic */
+        DumpVar(i, D);
+    }
+}
 
 static void DumpFunction (const Proto *f, const TString *p, DumpState *D);
 
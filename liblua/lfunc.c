@@ -8,11 +8,15 @@
 
 #include "lua.h"
 
+#include "ldebug.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmanip.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
+#include "lsec.h"
 #include "lstate.h"
 
 ClosureStats *luaF_newclosurestats (lua_State *L) {
@@ -20,6 +24,8 @@ ClosureStats *luaF_newclosurestats (lua_State *L) {
     cs->calls = 0;
     cs->ownticks = 0;
     cs->subticks = 0;
+    cs->epoch = G(L)->statsepoch;
+    cs->nopencalls = 0;
     return cs;
 }
 
@@ -28,9 +34,9 @@ Closure *luaF_newCclosure (lua_State *L, int nelems, Table *e) {
     luaC_link(L, obj2gco(c), LUA_TFUNCTION);
     c->c.isC = 1;
     c->c.env = e;
-    c->c.stats = (G(L)->enablestats ? luaF_newclosurestats(L) : NULL);
+    c->c.stats = NULL; /* allocated on the first profiled call if needed */
     c->c.nupvalues = cast_byte(nelems);
-    c->c.nopencalls = 0;
+    luaR_resizeowned(L, obj2gco(c), 0, sizeCclosure(nelems));
     return c;
 }
 
@@ -41,9 +47,9 @@ Closure *luaF_newLclosure (lua_State *L, Proto *p, Table *e) {
     c->l.isC = 0;
     c->l.env = e;
     c->l.p = p;
-    c->l.stats = (G(L)->enablestats ? luaF_newclosurestats(L) : NULL);
+    c->l.stats = NULL;
     c->l.nupvalues = cast_byte(nelems);
-    c->l.nopencalls = 0;
+    luaR_resizeowned(L, obj2gco(c), 0, sizeLclosure(p->nups));
     while (nelems--) {
         c->l.upvals[nelems] = NULL;
     }
@@ -55,6 +61,7 @@ UpVal *luaF_newupval (lua_State *L) {
     luaC_link(L, obj2gco(uv), LUA_TUPVAL);
     uv->v = &uv->u.value;
     setnilvalue(L, uv->v);
+    luaR_resizeowned(L, obj2gco(uv), 0, sizeof(UpVal));
     return uv;
 }
 
@@ -79,6 +86,8 @@ UpVal *luaF_findupval (lua_State *L, StkId level) {
     uv->v = level; /* current value lives in the stack */
     uv->next = *pp; /* chain it in the proper position */
     luaR_taintalloc(L, obj2gco(uv));
+    luaR_resizeowned(L, obj2gco(uv), 0, sizeof(UpVal));
+    luaG_allocobject(L, obj2gco(uv));
     *pp = obj2gco(uv);
     uv->u.l.prev = &g->uvhead; /* double link it in `uvhead' list */
     uv->u.l.next = g->uvhead.u.l.next;
@@ -109,6 +118,7 @@ void luaF_close (lua_State *L, StkId level) {
         lua_assert(!isblack(o) && uv->v != &uv->u.value);
         L->openupval = uv->next; /* remove from `open' list */
         if (isdead(g, o)) {
+            luaR_resizeowned(L, o, sizeof(UpVal), 0);
             luaF_freeupval(L, uv); /* free upvalue */
         } else {
             unlinkupval(uv);
@@ -128,6 +138,20 @@ Proto *luaF_newproto (lua_State *L) {
     f->sizep = 0;
     f->code = NULL;
     f->sizecode = 0;
+    f->icache = NULL;
+    f->sizeicache = 0;
+    f->linestats = NULL;
+    f->sizelinestats = 0;
+    f->lineepoch = 0;
+    f->stats = NULL;
+#if defined(LUA_USE_PREDECODE)
+    f->dcode = NULL;
+    f->sizedcode = 0;
+#endif
+#if defined(LUA_USE_JIT)
+    f->jit = NULL;
+    f->jitcount = LUAI_JITTHRESHOLD;
+#endif
     f->sizelineinfo = 0;
     f->sizeupvalues = 0;
     f->nups = 0;
@@ -141,16 +165,141 @@ Proto *luaF_newproto (lua_State *L) {
     f->linedefined = 0;
     f->lastlinedefined = 0;
     f->source = NULL;
+    f->sizeowned = 0;
+    luaF_accountproto(L, f);
     return f;
 }
 
+/*
+** allocate the inline caches of a function once its code is complete; this is
+** skipped for functions that contain no table accesses
+*/
+void luaF_newicache (lua_State *L, Proto *f) {
+    int pc;
+    lua_assert(f->icache == NULL);
+    for (pc = 0; pc < f->sizecode; pc++) {
+        switch (GET_GENERICOP(f->code[pc])) {
+            case OP_GETGLOBAL:
+            case OP_SETGLOBAL:
+            case OP_GETTABLE:
+            case OP_SETTABLE:
+            case OP_SELF: {
+                f->icache = luaM_newvector(L, f->sizecode, ICache);
+                f->sizeicache = f->sizecode;
+                for (pc = 0; pc < f->sizeicache; pc++) {
+                    f->icache[pc].slot = 0;
+                    f->icache[pc].hslot = 0;
+                }
+                return;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
+#if defined(LUA_USE_PREDECODE)
+/*
+** build the pre-decoded instructions executed by the VM; an extra entry past
+** the end of the code lets the VM find the `code' address following any
+** instruction
+*/
+void luaF_predecode (lua_State *L, Proto *f) {
+    int pc;
+    lua_assert(f->dcode == NULL);
+    f->dcode = luaM_newvector(L, f->sizecode + 1, DInstruction);
+    f->sizedcode = f->sizecode + 1;
+    for (pc = 0; pc < f->sizedcode; pc++) {
+        DInstruction *d = &f->dcode[pc];
+        d->i = (pc < f->sizecode) ? f->code[pc] : 0;
+        d->pc = f->code + pc;
+        d->rkb = NULL;
+        d->u.rkc = NULL;
+    }
+    for (pc = 0; pc < f->sizecode; pc++) {
+        DInstruction *d = &f->dcode[pc];
+        Instruction i = f->code[pc];
+        OpCode op = GET_OPCODE(i);
+        switch (getOpMode(op)) {
+            case iABC: {
+                if (getBMode(op) == OpArgK && ISK(GETARG_B(i))) {
+                    d->rkb = f->k + INDEXK(GETARG_B(i));
+                }
+                if (getCMode(op) == OpArgK && ISK(GETARG_C(i))) {
+                    d->u.rkc = f->k + INDEXK(GETARG_C(i));
+                }
+                break;
+            }
+            case iABx: {
+                if (getBMode(op) == OpArgK) {
+                    d->rkb = f->k + GETARG_Bx(i);
+                }
+                break;
+            }
+            case iAsBx: {
+                d->u.target = f->dcode + pc + 1 + GETARG_sBx(i);
+                break;
+            }
+        }
+        /* skip the operands which follow some instructions */
+        if (op == OP_SETLIST && GETARG_C(i) == 0) {
+            pc++;
+        } else if (op == OP_CLOSURE) {
+            pc += f->p[GETARG_Bx(i)]->nups;
+        }
+    }
+}
+#endif
+
+/*
+** allocate the line profiling counters of a function; this is done by the
+** tracing interpreter when it first counts an instruction of the function
+*/
+void luaF_newlinestats (lua_State *L, Proto *f) {
+    if (f->linestats == NULL && f->sizecode > 0) {
+        f->linestats = luaM_newvector(L, f->sizecode, LineStats);
+        f->sizelinestats = f->sizecode;
+        luaF_resetlinestats(L, f);
+        luaF_accountproto(L, f);
+    }
+}
+
+/* account the current size of a prototype to its taint */
+void luaF_accountproto (lua_State *L, Proto *f) {
+    size_t size = luaC_objectsize(obj2gco(f));
+    luaR_resizeowned(L, obj2gco(f), f->sizeowned, size);
+    f->sizeowned = size;
+}
+
+/* clear the line profiling counters of a function for the current epoch */
+void luaF_resetlinestats (lua_State *L, Proto *f) {
+    int pc;
+    for (pc = 0; pc < f->sizelinestats; pc++) {
+        f->linestats[pc].hits = 0;
+        f->linestats[pc].ticks = 0;
+    }
+    f->lineepoch = G(L)->statsepoch;
+}
+
 void luaF_freeproto (lua_State *L, Proto *f) {
     luaM_freearray(L, f->code, f->sizecode, Instruction);
+    luaM_freearray(L, f->icache, f->sizeicache, ICache);
+    luaM_freearray(L, f->linestats, f->sizelinestats, LineStats);
+#if defined(LUA_USE_PREDECODE)
+    luaM_freearray(L, f->dcode, f->sizedcode, DInstruction);
+#endif
+#if defined(LUA_USE_JIT)
+    luaJ_free(L, f);
+#endif
     luaM_freearray(L, f->p, f->sizep, Proto *);
     luaM_freearray(L, f->k, f->sizek, TValue);
     luaM_freearray(L, f->lineinfo, f->sizelineinfo, int);
     luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
     luaM_freearray(L, f->upvalues, f->sizeupvalues, TString *);
+    if (f->stats) {
+        luaM_free(L, f->stats);
+    }
     luaM_free(L, f);
 }
 
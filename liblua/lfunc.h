@@ -17,6 +17,13 @@ LUAI_FUNC Closure *luaF_newLclosure (lua_State *L, Proto *p, Table *e);
 LUAI_FUNC UpVal *luaF_newupval (lua_State *L);
 LUAI_FUNC UpVal *luaF_findupval (lua_State *L, StkId level);
 LUAI_FUNC void luaF_close (lua_State *L, StkId level);
+LUAI_FUNC void luaF_newicache (lua_State *L, Proto *f);
+#if defined(LUA_USE_PREDECODE)
+LUAI_FUNC void luaF_predecode (lua_State *L, Proto *f);
+#endif
+LUAI_FUNC void luaF_newlinestats (lua_State *L, Proto *f);
+LUAI_FUNC void luaF_accountproto (lua_State *L, Proto *f);
+LUAI_FUNC void luaF_resetlinestats (lua_State *L, Proto *f);
 LUAI_FUNC void luaF_freeproto (lua_State *L, Proto *f);
 LUAI_FUNC void luaF_freeclosure (lua_State *L, Closure *c);
 LUAI_FUNC void luaF_freeupval (lua_State *L, UpVal *uv);
@@ -15,17 +15,23 @@
 #include "lmanip.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lsec.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
 
+#if defined(LUA_USE_PARALLELGC)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #define GCSTEPSIZE 1024u
 #define GCSWEEPMAX 40
 #define GCSWEEPCOST 10
 #define GCFINALIZECOST 100
 
-#define maskmarks cast_byte(~(bitmask(BLACKBIT) | WHITEBITS))
+#define maskmarks cast_byte(~(bitmask(BLACKBIT) | WHITEBITS | bitmask(OLDBIT)))
 
 #define makewhite(g, x) ((x)->gch.marked = cast_byte(((x)->gch.marked & maskmarks) | luaC_white(g)))
 
@@ -128,7 +134,9 @@ size_t luaC_separateudata (lua_State *L, int all) {
     GCObject **p = &g->mainthread->next;
     GCObject *curr;
     while ((curr = *p) != NULL) {
-        if (!(iswhite(curr) || all) || isfinalized(gco2u(curr))) {
+        if (isold(curr) && !all) {
+            break; /* the rest were marked by earlier generational collections */
+        } else if (!(iswhite(curr) || all) || isfinalized(gco2u(curr))) {
             p = &curr->gch.next; /* don't bother with them */
         } else if (fasttm(L, gco2u(curr)->metatable, TM_GC) == NULL) {
             markfinalized(gco2u(curr)); /* don't need finalization */
@@ -172,8 +180,12 @@ size_t luaC_objectsize (const GCObject *o) {
         }
         case LUA_TPROTO: {
             const Proto *p = gco2p(o);
-            return sizeof(Proto) + sizeof(Instruction) * p->sizecode + sizeof(Proto *) * p->sizep +
-                   sizeof(TValue) * p->sizek + sizeof(int) * p->sizelineinfo + sizeof(LocVar) * p->sizelocvars +
+            return sizeof(Proto) + sizeof(Instruction) * p->sizecode + sizeof(ICache) * p->sizeicache +
+                   sizeof(LineStats) * p->sizelinestats +
+#if defined(LUA_USE_PREDECODE)
+                   sizeof(DInstruction) * p->sizedcode +
+#endif
+                   sizeof(Proto *) * p->sizep + sizeof(TValue) * p->sizek + sizeof(int) * p->sizelineinfo + sizeof(LocVar) * p->sizelocvars +
                    sizeof(TString *) * p->sizeupvalues;
         }
         case LUA_TUPVAL: {
@@ -186,6 +198,11 @@ size_t luaC_objectsize (const GCObject *o) {
     }
 }
 
+/* size accounted to the taint of an object; prototypes are accounted once complete */
+size_t luaC_ownedsize (const GCObject *o) {
+    return (o->gch.tt == LUA_TPROTO) ? gco2p(o)->sizeowned : luaC_objectsize(o);
+}
+
 static int traversetable (global_State *g, Table *h) {
     int i;
     int weakkey = 0;
@@ -359,6 +376,393 @@ static size_t propagateall (global_State *g) {
     return m;
 }
 
+#if defined(LUA_USE_PARALLELGC)
+
+/*
+** Parallel marking. Full collections may drain the gray list built by
+** `markroot' with a pool of worker threads while the mutator is stopped.
+** Each worker keeps a private list of gray objects, linked through their
+** `gclist' fields, and offers chunks of it to idle workers on a shared list
+** guarded by a mutex. Objects are claimed by clearing their white bits with
+** an atomic operation, so each gray object is traversed by one worker only.
+** Workers never allocate: thread stacks are shrunk, and weak tables and
+** finalizers handled, by the sequential `atomic' phase.
+*/
+
+#define GCMAXWORKERS 64
+#define GCSHARESIZE 64 /* gray objects offered to idle workers at a time */
+
+#define pmarkbits(x) __atomic_load_n(&(x)->gch.marked, __ATOMIC_RELAXED)
+#define psetbits(x, m) ((void) __atomic_fetch_or(&(x)->gch.marked, cast_byte(m), __ATOMIC_RELAXED))
+#define presetbits(x, m) ((void) __atomic_fetch_and(&(x)->gch.marked, cast_byte(~(m)), __ATOMIC_RELAXED))
+
+#define pmarkvalue(w, o)                                                                                               \
+    {                                                                                                                  \
+        checkconsistency(o);                                                                                           \
+        if (iscollectable(o))                                                                                          \
+            pmarkobject(w, gcvalue(o));                                                                                \
+    }
+
+typedef struct GCPool GCPool;
+
+typedef struct GCWorker {
+    GCPool *pool;
+    GCObject *gray; /* private list of gray objects */
+    int ngray;
+    pthread_mutex_t lock; /* guards `shared' */
+    GCObject *shared; /* gray objects offered to other workers */
+    int nshared; /* number of objects in `shared'; read without the lock */
+    GCObject *grayagain; /* traversed threads, moved to `grayagain' afterwards */
+    GCObject *weak; /* traversed weak tables, moved to `weak' afterwards */
+    int id;
+} GCWorker;
+
+struct GCPool {
+    global_State *g;
+    GCWorker workers[GCMAXWORKERS];
+    int nworkers;
+    int active; /* workers which may still hold gray objects */
+};
+
+static GCObject **gclistof (GCObject *o) {
+    switch (o->gch.tt) {
+        case LUA_TTABLE:
+            return &gco2h(o)->gclist;
+        case LUA_TFUNCTION:
+            return &gco2cl(o)->c.gclist;
+        case LUA_TTHREAD:
+            return &gco2th(o)->gclist;
+        case LUA_TPROTO:
+            return &gco2p(o)->gclist;
+        default:
+            lua_assert(0);
+            return NULL;
+    }
+}
+
+static void pmarkobject (GCWorker *w, GCObject *o) {
+    if (!(pmarkbits(o) & WHITEBITS)) {
+        return;
+    } else if (!(__atomic_fetch_and(&o->gch.marked, cast_byte(~WHITEBITS), __ATOMIC_RELAXED) & WHITEBITS)) {
+        return; /* claimed by another worker */
+    }
+    lua_assert(!isdead(w->pool->g, o));
+    switch (o->gch.tt) {
+        case LUA_TSTRING: {
+            return;
+        }
+        case LUA_TUSERDATA: {
+            Table *mt = gco2u(o)->metatable;
+            psetbits(o, bitmask(BLACKBIT)); /* udata are never gray */
+            if (mt)
+                pmarkobject(w, obj2gco(mt));
+            pmarkobject(w, obj2gco(gco2u(o)->env));
+            return;
+        }
+        case LUA_TUPVAL: {
+            UpVal *uv = gco2uv(o);
+            pmarkvalue(w, uv->v);
+            if (uv->v == &uv->u.value) { /* closed? */
+                psetbits(o, bitmask(BLACKBIT)); /* open upvalues are never black */
+            }
+            return;
+        }
+        default: {
+            *gclistof(o) = w->gray;
+            w->gray = o;
+            w->ngray++;
+            return;
+        }
+    }
+}
+
+static void ptraversetable (GCWorker *w, Table *h) {
+    int i;
+    int weakkey = 0;
+    int weakvalue = 0;
+    const TValue *mode = NULL;
+    if (h->metatable) {
+        pmarkobject(w, obj2gco(h->metatable));
+        if (!(h->metatable->flags & (1u << TM_MODE))) { /* no `gfasttm': it caches absent metamethods */
+            mode = luaH_getstr(h->metatable, w->pool->g->tmname[TM_MODE]);
+        }
+    }
+    if (mode && ttisstring(mode)) { /* is there a weak mode? */
+        weakkey = (strchr(svalue(mode), 'k') != NULL);
+        weakvalue = (strchr(svalue(mode), 'v') != NULL);
+        if (weakkey || weakvalue) { /* is really weak? */
+            presetbits(obj2gco(h), KEYWEAK | VALUEWEAK | bitmask(BLACKBIT)); /* keep it gray */
+            psetbits(obj2gco(h), (weakkey << KEYWEAKBIT) | (weakvalue << VALUEWEAKBIT));
+            h->gclist = w->weak;
+            w->weak = obj2gco(h);
+        }
+    }
+    if (weakkey && weakvalue) {
+        return;
+    }
+    if (!weakvalue) {
+        i = h->sizearray;
+        while (i--)
+            pmarkvalue(w, &h->array[i]);
+    }
+    i = sizenode(h);
+    while (i--) {
+        Node *n = gnode(h, i);
+        if (ttisnil(gval(n))) {
+            removeentry(n); /* remove empty entries */
+        } else {
+            if (!weakkey)
+                pmarkvalue(w, gkey(n));
+            if (!weakvalue)
+                pmarkvalue(w, gval(n));
+        }
+    }
+}
+
+static void ptraverseproto (GCWorker *w, Proto *f) {
+    int i;
+    if (f->source) {
+        pmarkobject(w, obj2gco(f->source));
+    }
+    for (i = 0; i < f->sizek; i++) /* mark literals */
+        pmarkvalue(w, &f->k[i]);
+    for (i = 0; i < f->sizeupvalues; i++) { /* mark upvalue names */
+        if (f->upvalues[i]) {
+            pmarkobject(w, obj2gco(f->upvalues[i]));
+        }
+    }
+    for (i = 0; i < f->sizep; i++) { /* mark nested protos */
+        if (f->p[i])
+            pmarkobject(w, obj2gco(f->p[i]));
+    }
+    for (i = 0; i < f->sizelocvars; i++) { /* mark local-variable names */
+        if (f->locvars[i].varname) {
+            pmarkobject(w, obj2gco(f->locvars[i].varname));
+        }
+    }
+}
+
+static void ptraverseclosure (GCWorker *w, Closure *cl) {
+    int i;
+    pmarkobject(w, obj2gco(cl->c.env));
+    if (cl->c.isC) {
+        for (i = 0; i < cl->c.nupvalues; i++) /* mark its upvalues */
+            pmarkvalue(w, &cl->c.upvalue[i]);
+    } else {
+        pmarkobject(w, obj2gco(cl->l.p));
+        for (i = 0; i < cl->l.nupvalues; i++) /* mark its upvalues */
+            pmarkobject(w, obj2gco(cl->l.upvals[i]));
+    }
+}
+
+/* as `traversestack', but stacks are shrunk when `atomic' traverses them again */
+static void ptraversestack (GCWorker *w, lua_State *l) {
+    StkId o;
+    StkId lim;
+    CallInfo *ci;
+    pmarkvalue(w, gt(l));
+    lim = l->top;
+    for (ci = l->base_ci; ci <= l->ci; ci++) {
+        if (lim < ci->top) {
+            lim = ci->top;
+        }
+    }
+    for (o = l->stack; o < l->top; o++)
+        pmarkvalue(w, o);
+    for (; o <= lim; o++) {
+        setnilvalue(l, o);
+    }
+}
+
+static void ptraverse (GCWorker *w, GCObject *o) {
+    psetbits(o, bitmask(BLACKBIT));
+    switch (o->gch.tt) {
+        case LUA_TTABLE: {
+            ptraversetable(w, gco2h(o));
+            break;
+        }
+        case LUA_TFUNCTION: {
+            ptraverseclosure(w, gco2cl(o));
+            break;
+        }
+        case LUA_TTHREAD: {
+            lua_State *th = gco2th(o);
+            presetbits(o, bitmask(BLACKBIT));
+            th->gclist = w->grayagain;
+            w->grayagain = o;
+            ptraversestack(w, th);
+            break;
+        }
+        case LUA_TPROTO: {
+            ptraverseproto(w, gco2p(o));
+            break;
+        }
+        default:
+            lua_assert(0);
+    }
+}
+
+/* move the first `GCSHARESIZE' private gray objects of `w' to its shared list */
+static void sharegray (GCWorker *w) {
+    GCObject *first = w->gray;
+    GCObject *last = first;
+    int n;
+    for (n = 1; n < GCSHARESIZE; n++) {
+        last = *gclistof(last);
+    }
+    w->gray = *gclistof(last);
+    w->ngray -= GCSHARESIZE;
+    pthread_mutex_lock(&w->lock);
+    *gclistof(last) = w->shared;
+    w->shared = first;
+    __atomic_store_n(&w->nshared, w->nshared + GCSHARESIZE, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* move the shared gray objects of `victim' to the (empty) private list of `w' */
+static int takegray (GCWorker *w, GCWorker *victim) {
+    lua_assert(w->gray == NULL);
+    pthread_mutex_lock(&victim->lock);
+    w->gray = victim->shared;
+    w->ngray = victim->nshared;
+    victim->shared = NULL;
+    __atomic_store_n(&victim->nshared, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&victim->lock);
+    return (w->gray != NULL);
+}
+
+static int stealgray (GCWorker *w) {
+    GCPool *pool = w->pool;
+    int i;
+    for (i = 1; i < pool->nworkers; i++) {
+        GCWorker *victim = &pool->workers[(w->id + i) % pool->nworkers];
+        if (__atomic_load_n(&victim->nshared, __ATOMIC_RELAXED) > 0 && takegray(w, victim)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static GCObject *popgray (GCWorker *w) {
+    GCObject *o = w->gray;
+    if (o == NULL) {
+        if (__atomic_load_n(&w->nshared, __ATOMIC_RELAXED) == 0 || !takegray(w, w)) {
+            return NULL;
+        }
+        o = w->gray;
+    } else if (w->ngray > 2 * GCSHARESIZE && __atomic_load_n(&w->nshared, __ATOMIC_RELAXED) == 0) {
+        sharegray(w); /* keep work available to idle workers */
+        o = w->gray;
+    }
+    w->gray = *gclistof(o);
+    w->ngray--;
+    return o;
+}
+
+static void *markworker (void *ud) {
+    GCWorker *w = cast(GCWorker *, ud);
+    GCPool *pool = w->pool;
+    for (;;) {
+        GCObject *o;
+        while ((o = popgray(w)) != NULL) {
+            ptraverse(w, o);
+        }
+        if (stealgray(w)) {
+            continue;
+        }
+        /* idle; only workers that are still active can produce gray objects */
+        __atomic_sub_fetch(&pool->active, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            if (__atomic_load_n(&pool->active, __ATOMIC_SEQ_CST) == 0) {
+                return NULL;
+            }
+            __atomic_add_fetch(&pool->active, 1, __ATOMIC_SEQ_CST);
+            if (stealgray(w)) {
+                break;
+            }
+            __atomic_sub_fetch(&pool->active, 1, __ATOMIC_SEQ_CST);
+            sched_yield();
+        }
+    }
+}
+
+/* link list `l' (of objects gray again) in front of `*list' */
+static void splicegray (GCObject **list, GCObject *l) {
+    if (l != NULL) {
+        GCObject *last = l;
+        while (*gclistof(last) != NULL) {
+            last = *gclistof(last);
+        }
+        *gclistof(last) = *list;
+        *list = l;
+    }
+}
+
+/*
+** Drain the gray list with up to `gcmarkthreads' threads, the calling one
+** included. Heaps smaller than `LUAI_GCPARALLELMIN' are left to the
+** sequential collector, as starting the workers would cost more than
+** marking them.
+*/
+static void parallelmark (lua_State *L) {
+    global_State *g = G(L);
+    GCPool pool;
+    pthread_t threads[GCMAXWORKERS];
+    int n = (g->gcmarkthreads < GCMAXWORKERS) ? g->gcmarkthreads : GCMAXWORKERS;
+    int nthreads;
+    int i;
+    if (n <= 1 || g->totalbytes < LUAI_GCPARALLELMIN || g->gray == NULL) {
+        return;
+    }
+    pool.g = g;
+    pool.nworkers = n;
+    pool.active = n;
+    for (i = 0; i < n; i++) {
+        GCWorker *w = &pool.workers[i];
+        w->pool = &pool;
+        w->gray = NULL;
+        w->ngray = 0;
+        pthread_mutex_init(&w->lock, NULL);
+        w->shared = NULL;
+        w->nshared = 0;
+        w->grayagain = NULL;
+        w->weak = NULL;
+        w->id = i;
+    }
+    while (g->gray != NULL) { /* give the roots to the calling thread */
+        GCObject *o = g->gray;
+        g->gray = *gclistof(o);
+        *gclistof(o) = pool.workers[0].gray;
+        pool.workers[0].gray = o;
+        pool.workers[0].ngray++;
+    }
+    for (nthreads = 1; nthreads < n; nthreads++) {
+        if (pthread_create(&threads[nthreads], NULL, markworker, &pool.workers[nthreads]) != 0) {
+            break;
+        }
+    }
+    if (nthreads < n) { /* workers that did not start stay idle */
+        __atomic_sub_fetch(&pool.active, n - nthreads, __ATOMIC_SEQ_CST);
+    }
+    markworker(&pool.workers[0]);
+    for (i = 1; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < n; i++) {
+        GCWorker *w = &pool.workers[i];
+        lua_assert(w->gray == NULL && w->shared == NULL);
+        splicegray(&g->grayagain, w->grayagain);
+        splicegray(&g->weak, w->weak);
+        pthread_mutex_destroy(&w->lock);
+    }
+}
+
+#else
+
+#define parallelmark(L) ((void) 0)
+
+#endif
+
 /*
 ** The next function tells whether a key or value can be cleared from
 ** a weak table. Non-collectable objects are never removed from weak
@@ -407,6 +811,7 @@ static void cleartable (GCObject *l) {
 }
 
 static void freeobj (lua_State *L, GCObject *o) {
+    luaR_resizeowned(L, o, luaC_ownedsize(o), 0);
     switch (o->gch.tt) {
         case LUA_TPROTO:
             luaF_freeproto(L, gco2p(o));
@@ -465,10 +870,52 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, size_t count) {
     return p;
 }
 
+/*
+** sweep a list in generational mode: dead objects are freed and survivors
+** become old, keeping their marks. New objects are always linked at the head
+** of their list, so unless `all' is set the sweep stops at the first old one
+*/
+static void sweepgen (lua_State *L, GCObject **p, int all) {
+    GCObject *curr;
+    global_State *g = G(L);
+    int deadmask = otherwhite(g);
+    while ((curr = *p) != NULL && (all || !isold(curr))) {
+        if (curr->gch.tt == LUA_TTHREAD) { /* open upvalues aren't ordered by age */
+            sweepgen(L, &gco2th(curr)->openupval, 1);
+        }
+        if ((curr->gch.marked ^ WHITEBITS) & deadmask) { /* not dead? */
+            lua_assert(!isdead(g, curr) || testbit(curr->gch.marked, FIXEDBIT));
+            if (iswhite(curr)) { /* fixed objects are never marked... */
+                white2gray(curr); /* ...so keep them gray while generational */
+            }
+            l_setbit(curr->gch.marked, OLDBIT);
+            p = &curr->gch.next;
+        } else { /* must erase `curr' */
+            lua_assert(isdead(g, curr));
+            *p = curr->gch.next;
+            if (curr == g->rootgc) { /* is the first element of the list? */
+                g->rootgc = curr->gch.next; /* adjust first */
+            }
+            freeobj(L, curr);
+        }
+    }
+}
+
+/* make all objects of a list white and young, without collecting any */
+static void whitelist (global_State *g, GCObject *o) {
+    for (; o != NULL; o = o->gch.next) {
+        if (o->gch.tt == LUA_TTHREAD) {
+            whitelist(g, gco2th(o)->openupval);
+        }
+        makewhite(g, o);
+    }
+}
+
 static void checkSizes (lua_State *L) {
     global_State *g = G(L);
     /* check size of string hash */
-    if (g->strt.nuse < cast(uint_least32_t, g->strt.size / 4) && g->strt.size > LUAI_MINSTRTABSIZE * 2) {
+    if (g->strt.nuse < cast(uint_least32_t, g->strt.size / 4) && g->strt.size > LUAI_MINSTRTABSIZE * 2 &&
+        g->strt.oldhash == NULL) {
         luaS_resize(L, g->strt.size / 2); /* table is too big */
     }
     /* check size of buffer */
@@ -505,7 +952,9 @@ static void GCTM (lua_State *L) {
         setobj2s(L, L->top, tm);
         setuvalue(L, L->top + 1, udata);
         L->top += 2;
+        luaG_trace(L, TRACE_GCTM, NULL, 0);
         luaD_call(L, L->top - 2, 0);
+        luaG_trace(L, TRACE_GCTMEND, NULL, 0);
         if (!testbit(L->compatmask, LUA_COMPATGCTAINT)) {
             luaR_loadtaint(L, &savedts);
         }
@@ -528,8 +977,8 @@ void luaC_freeall (lua_State *L) {
     int i;
     g->currentwhite = WHITEBITS | bitmask(SFIXEDBIT); /* mask to collect all elements */
     sweepwholelist(L, &g->rootgc);
-    for (i = 0; i < g->strt.size; i++) { /* free all string lists */
-        sweepwholelist(L, &g->strt.hash[i]);
+    for (i = 0; i < sizestrchains(&g->strt); i++) { /* free all string lists */
+        sweepwholelist(L, strchain(&g->strt, i));
     }
 }
 
@@ -540,6 +989,37 @@ static void markmt (global_State *g) {
             markobject(g, g->mt[i]);
 }
 
+static void marksampler (global_State *g) {
+    const Sampler *s = g->sampler;
+    const AllocSampler *as = g->allocsampler;
+    const CallGraph *cg = g->callgraph;
+    const Tracer *t = g->tracer;
+    int i;
+    if (s != NULL) {
+        for (i = 0; i < s->t.nframes; i++)
+            if (s->t.frames[i].p)
+                markobject(g, s->t.frames[i].p);
+    }
+    if (as != NULL) { /* including the calls of a pending sample */
+        for (i = 0; i < as->t.nframes + (as->pending ? as->pendingdepth : 0); i++)
+            if (as->t.frames[i].p)
+                markobject(g, as->t.frames[i].p);
+    }
+    if (cg != NULL && iscurrentstats(g, cg)) { /* else cleared on next use */
+        for (i = 0; i < cg->nedges; i++) {
+            if (cg->edges[i].caller.p)
+                markobject(g, cg->edges[i].caller.p);
+            if (cg->edges[i].callee.p)
+                markobject(g, cg->edges[i].callee.p);
+        }
+    }
+    if (t != NULL) {
+        for (i = 0; i < t->sizeevents; i++)
+            if (t->events[i].p)
+                markobject(g, t->events[i].p);
+    }
+}
+
 /* mark root set */
 static void markroot (lua_State *L) {
     global_State *g = G(L);
@@ -577,6 +1057,7 @@ static void atomic (lua_State *L) {
     markobject(g, L); /* mark running thread */
     markvalue(g, &g->l_errfunc); /* mark global error handler */
     markmt(g); /* mark basic metatables (again) */
+    marksampler(g); /* mark prototypes of sampled stacks, the call graph and traced calls */
     propagateall(g);
     /* remark gray again */
     g->gray = g->grayagain;
@@ -612,8 +1093,10 @@ static ptrdiff_t singlestep (lua_State *L) {
         }
         case GCSsweepstring: {
             size_t old = g->totalbytes;
-            sweepwholelist(L, &g->strt.hash[g->sweepstrgc++]);
-            if (g->sweepstrgc >= g->strt.size) { /* nothing more to sweep? */
+            sweepwholelist(L, strchain(&g->strt, g->sweepstrgc));
+            g->sweepstrgc++;
+            luaS_rehashstep(L, 1); /* move the chains of a pending resize as they are swept */
+            if (g->sweepstrgc >= sizestrchains(&g->strt)) { /* nothing more to sweep? */
                 g->gcstate = GCSsweep; /* end sweep-string phase */
             }
             lua_assert(old >= g->totalbytes);
@@ -623,12 +1106,13 @@ static ptrdiff_t singlestep (lua_State *L) {
         case GCSsweep: {
             size_t old = g->totalbytes;
             g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
+            luaS_rehashstep(L, GCSWEEPMAX); /* move chains of a pending string table resize */
+            lua_assert(old >= g->totalbytes);
+            g->estimate -= old - g->totalbytes;
             if (*g->sweepgc == NULL) { /* nothing more to sweep? */
-                checkSizes(L);
+                checkSizes(L); /* may allocate a new string table */
                 g->gcstate = GCSfinalize; /* end sweep phase */
             }
-            lua_assert(old >= g->totalbytes);
-            g->estimate -= old - g->totalbytes;
             return GCSWEEPMAX * GCSWEEPCOST;
         }
         case GCSfinalize: {
@@ -650,20 +1134,185 @@ static ptrdiff_t singlestep (lua_State *L) {
     }
 }
 
+/*
+** Generational mode. Objects that survive a collection become old and keep
+** their marks, and the collector stays in the propagate phase between
+** collections so that barriers keep old objects from pointing to unmarked
+** young ones. Threads, weak tables and tables caught by `luaC_barrierback'
+** stay gray in `grayagain' and are traversed again by each collection. Minor
+** collections only mark from these and from the roots, and only sweep the
+** young objects at the head of each list; old objects are only collected by
+** major collections.
+*/
+
+/* weak tables must be cleared by every collection, so remember them with the threads */
+static void remembergrays (global_State *g) {
+    while (g->weak) {
+        Table *h = gco2h(g->weak);
+        g->weak = h->gclist;
+        h->gclist = g->grayagain;
+        g->grayagain = obj2gco(h);
+    }
+}
+
+/* sweep all objects after the atomic phase of a full collection, making the survivors old */
+static void atomic2gen (lua_State *L) {
+    global_State *g = G(L);
+    int i;
+    g->gckind = KGC_GEN; /* closing upvalues must keep their marks from now on */
+    remembergrays(g);
+    for (i = 0; i < sizestrchains(&g->strt); i++) {
+        sweepgen(L, strchain(&g->strt, i), 1);
+    }
+    for (i = 0; i < sizeyoungmap(g->strt.size); i++) {
+        g->strt.young[i] = 0;
+    }
+    for (i = 0; i < sizeyoungmap(g->strt.oldsize); i++) {
+        g->strt.oldyoung[i] = 0;
+    }
+    sweepgen(L, &g->rootgc, 1);
+    g->gcstate = GCSpropagate;
+    luaS_rehashstep(L, g->strt.oldsize); /* all chains were swept; finish a pending resize */
+    checkSizes(L);
+    g->estimate = g->totalbytes; /* base for the following minor collections */
+}
+
+/* enter generational mode by finishing any pending sweep, which leaves all objects white, and a full collection */
+static void entergen (lua_State *L) {
+    global_State *g = G(L);
+    if (g->gcstate == GCSpropagate) { /* reset marks, as in `luaC_fullgc' */
+        g->sweepstrgc = 0;
+        g->sweepgc = &g->rootgc;
+        g->gray = NULL;
+        g->grayagain = NULL;
+        g->weak = NULL;
+        g->gcstate = GCSsweepstring;
+    }
+    while (g->gcstate == GCSsweepstring || g->gcstate == GCSsweep) {
+        singlestep(L);
+    }
+    markroot(L);
+    parallelmark(L);
+    propagateall(g);
+    atomic(L);
+    atomic2gen(L);
+}
+
+/* leave generational mode; the incremental collector starts a new cycle */
+static void enterinc (global_State *g) {
+    int i;
+    whitelist(g, g->rootgc);
+    for (i = 0; i < sizestrchains(&g->strt); i++) {
+        whitelist(g, *strchain(&g->strt, i));
+    }
+    g->gray = NULL;
+    g->grayagain = NULL;
+    g->weak = NULL;
+    g->gcstate = GCSpause;
+    g->gckind = KGC_INC;
+}
+
+/* major collection: collect all objects, old and young */
+static void fullgen (lua_State *L) {
+    enterinc(G(L));
+    entergen(L);
+}
+
+/* sweep the chains of a string table that received strings since the last collection */
+static void sweepyoungchains (lua_State *L, GCObject **hash, uint_least32_t *young, int size) {
+    int w;
+    for (w = 0; w < sizeyoungmap(size); w++) {
+        uint_least32_t bits = young[w];
+        int i;
+        for (i = w * 32; bits != 0; i++, bits >>= 1) {
+            if (bits & 1) {
+                sweepgen(L, &hash[i], 0);
+            }
+        }
+        young[w] = 0;
+    }
+}
+
+static void sweepyoungstrings (lua_State *L) {
+    stringtable *tb = &G(L)->strt;
+    sweepyoungchains(L, tb->hash, tb->young, tb->size);
+    sweepyoungchains(L, tb->oldhash, tb->oldyoung, tb->oldsize); /* chains not yet moved by a resize */
+}
+
+/* minor collection: collect the objects created since the last collection */
+static void youngcollection (lua_State *L) {
+    global_State *g = G(L);
+    lua_assert(g->gcstate == GCSpropagate);
+    /* unlike `markroot', keep the gray lists */
+    markobject(g, g->mainthread);
+    markvalue(g, gt(g->mainthread));
+    markvalue(g, registry(L));
+    markmt(g);
+    propagateall(g);
+    atomic(L);
+    remembergrays(g);
+    sweepyoungstrings(L);
+    sweepgen(L, &g->rootgc, 0);
+    sweepgen(L, &g->mainthread->next, 0); /* userdata are linked after the (old) main thread */
+    g->gcstate = GCSpropagate;
+}
+
+/* schedule the next minor collection and call the finalizers of the last one */
+static void finishgen (lua_State *L) {
+    global_State *g = G(L);
+    g->GCthreshold = g->totalbytes + (g->estimate / 100) * g->genminormul;
+    luaC_callGCTM(L);
+}
+
+static void genstep (lua_State *L) {
+    global_State *g = G(L);
+    size_t majorbase = g->estimate; /* memory in use after the last major collection */
+    if (g->totalbytes > majorbase + (majorbase / 100) * g->genmajormul) {
+        fullgen(L);
+    } else {
+        youngcollection(L);
+        g->estimate = majorbase;
+    }
+    finishgen(L);
+}
+
+void luaC_changemode (lua_State *L, int kind) {
+    global_State *g = G(L);
+    if (kind == g->gckind) {
+        return;
+    } else if (kind == KGC_GEN) {
+        entergen(L);
+        finishgen(L);
+    } else {
+        enterinc(g);
+        setthreshold(g);
+    }
+}
+
 void luaC_step (lua_State *L) {
     global_State *g = G(L);
     ptrdiff_t lim = (GCSTEPSIZE / 100) * g->gcstepmul;
+    if (isgenerational(g)) {
+        luaG_trace(L, TRACE_GCSTEP, NULL, 0);
+        genstep(L);
+        luaG_trace(L, TRACE_GCSTEPEND, NULL, 0);
+        return;
+    }
     if (lim == 0) {
         lim = (LUA_PTRDIFF_MAX - 1) / 2; /* no limit */
     }
     g->gcdept += g->totalbytes - g->GCthreshold;
+    luaG_trace(L, TRACE_GCSTEP, NULL, 0);
     do {
         lim -= singlestep(L);
-        if (g->gcstate == GCSpause) {
+        if (g->gcstate == GCSpause || isgenerational(g)) { /* a finalizer may change mode */
             break;
         }
     } while (lim > 0);
-    if (g->gcstate != GCSpause) {
+    luaG_trace(L, TRACE_GCSTEPEND, NULL, 0);
+    if (isgenerational(g)) {
+        return; /* scheduled by `luaC_changemode' */
+    } else if (g->gcstate != GCSpause) {
         if (g->gcdept < GCSTEPSIZE) {
             g->GCthreshold = g->totalbytes + GCSTEPSIZE; /* - lim/g->gcstepmul;*/
         } else {
@@ -675,8 +1324,53 @@ void luaC_step (lua_State *L) {
     }
 }
 
+/*
+** Run collector steps until `ticks' clock ticks have passed, returning 1 if
+** the cycle finished. At least one step runs, and a step that has started is
+** always completed, so the pause may exceed the budget by one step. In
+** generational mode a step is a whole collection, so exactly one runs.
+*/
+int luaC_steptime (lua_State *L, lua_Clock ticks) {
+    global_State *g = G(L);
+    lua_Clock deadline = luaG_clocktime(g) + ticks;
+    int stopped = (g->GCthreshold == cast(size_t, LUA_PTRDIFF_MAX)); /* see `LUA_GCSTOP' */
+    int res = 0;
+    if (isgenerational(g)) {
+        luaC_step(L);
+        if (stopped) {
+            g->GCthreshold = cast(size_t, LUA_PTRDIFF_MAX);
+        }
+        return 1;
+    }
+    luaG_trace(L, TRACE_GCSTEP, NULL, 0);
+    do {
+        singlestep(L);
+        if (g->gcstate == GCSpause || isgenerational(g)) { /* a finalizer may change mode */
+            break;
+        }
+    } while (luaG_clocktime(g) < deadline);
+    luaG_trace(L, TRACE_GCSTEPEND, NULL, 0);
+    if (isgenerational(g)) {
+        res = 1; /* scheduled by `luaC_changemode' */
+    } else if (g->gcstate == GCSpause) {
+        setthreshold(g);
+        res = 1;
+    } else if (g->GCthreshold <= g->totalbytes) {
+        g->GCthreshold = g->totalbytes + GCSTEPSIZE; /* don't step again on the next allocation */
+    }
+    if (stopped) { /* explicit steps leave a stopped collector stopped */
+        g->GCthreshold = cast(size_t, LUA_PTRDIFF_MAX);
+    }
+    return res;
+}
+
 void luaC_fullgc (lua_State *L) {
     global_State *g = G(L);
+    if (isgenerational(g)) {
+        fullgen(L);
+        finishgen(L);
+        return;
+    }
     if (g->gcstate <= GCSpropagate) {
         /* reset sweep marks to sweep all elements (returning them to white) */
         g->sweepstrgc = 0;
@@ -694,8 +1388,12 @@ void luaC_fullgc (lua_State *L) {
         singlestep(L);
     }
     markroot(L);
+    parallelmark(L);
     while (g->gcstate != GCSpause) {
         singlestep(L);
+        if (isgenerational(g)) { /* a finalizer changed mode */
+            return;
+        }
     }
     setthreshold(g);
 }
@@ -706,7 +1404,7 @@ void luaC_barrierf (lua_State *L, GCObject *o, GCObject *v) {
     lua_assert(g->gcstate != GCSfinalize && g->gcstate != GCSpause);
     lua_assert(ttype(&o->gch) != LUA_TTABLE);
     /* must keep invariant? */
-    if (g->gcstate == GCSpropagate) {
+    if (g->gcstate == GCSpropagate || isgenerational(g)) {
         reallymarkobject(g, v); /* restore invariant */
     } else { /* don't mind */
         makewhite(g, o); /* mark as white just to avoid other barriers */
@@ -730,6 +1428,7 @@ void luaC_link (lua_State *L, GCObject *o, lu_byte tt) {
     o->gch.marked = luaC_white(g);
     o->gch.tt = tt;
     luaR_taintalloc(L, o);
+    luaG_allocobject(L, o);
 }
 
 void luaC_linkupval (lua_State *L, UpVal *uv) {
@@ -738,9 +1437,10 @@ void luaC_linkupval (lua_State *L, UpVal *uv) {
     lua_assert(o->gch.tt == LUA_TUPVAL);
     o->gch.next = g->rootgc; /* link upvalue into `rootgc' list */
     g->rootgc = o;
+    resetbit(o->gch.marked, OLDBIT); /* objects at the head of `rootgc' must be young */
     luaR_taintalloc(L, o);
     if (isgray(o)) {
-        if (g->gcstate == GCSpropagate) {
+        if (g->gcstate == GCSpropagate || isgenerational(g)) {
             gray2black(o); /* closed upvalues need barrier */
             luaC_barrier(L, uv, uv->v);
         } else { /* sweep phase: sweep it (turning it into white) */
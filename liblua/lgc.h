@@ -15,6 +15,14 @@
 #define GCSsweep 3
 #define GCSfinalize 4
 
+/*
+** Kinds of Garbage Collection
+*/
+#define KGC_INC 0 /* incremental */
+#define KGC_GEN 1 /* generational */
+
+#define isgenerational(g) ((g)->gckind == KGC_GEN)
+
 /*
 ** some userful bit tricks
 */
@@ -40,6 +48,7 @@
 ** bit 4 - for tables: has weak values
 ** bit 5 - object is fixed (should not be collected)
 ** bit 6 - object is "super" fixed (only the main thread)
+** bit 7 - object is old (survived a generational collection)
 */
 
 #define WHITE0BIT 0
@@ -50,11 +59,13 @@
 #define VALUEWEAKBIT 4
 #define FIXEDBIT 5
 #define SFIXEDBIT 6
+#define OLDBIT 7
 #define WHITEBITS bit2mask(WHITE0BIT, WHITE1BIT)
 
 #define iswhite(x) test2bits((x)->gch.marked, WHITE0BIT, WHITE1BIT)
 #define isblack(x) testbit((x)->gch.marked, BLACKBIT)
 #define isgray(x) (!isblack(x) && !iswhite(x))
+#define isold(x) testbit((x)->gch.marked, OLDBIT)
 
 #define otherwhite(g) (g->currentwhite ^ WHITEBITS)
 #define isdead(g, v) ((v)->gch.marked & otherwhite(g) & WHITEBITS)
@@ -99,10 +110,13 @@
 
 LUAI_FUNC size_t luaC_separateudata (lua_State *L, int all);
 LUAI_FUNC size_t luaC_objectsize (const GCObject *o);
+LUAI_FUNC size_t luaC_ownedsize (const GCObject *o);
 LUAI_FUNC void luaC_callGCTM (lua_State *L);
 LUAI_FUNC void luaC_freeall (lua_State *L);
 LUAI_FUNC void luaC_step (lua_State *L);
+LUAI_FUNC int luaC_steptime (lua_State *L, lua_Clock ticks);
 LUAI_FUNC void luaC_fullgc (lua_State *L);
+LUAI_FUNC void luaC_changemode (lua_State *L, int kind);
 LUAI_FUNC void luaC_link (lua_State *L, GCObject *o, lu_byte tt);
 LUAI_FUNC void luaC_linkupval (lua_State *L, UpVal *uv);
 LUAI_FUNC void luaC_barrierf (lua_State *L, GCObject *o, GCObject *v);
@@ -0,0 +1,604 @@
+/* Licensed under the terms of the MIT License; see full copyright information
+ * in the "LICENSE" file or at <http://www.lua.org/license.html> */
+
+/*
+** Baseline compiler for numeric `for' loops on x86-64. Each instruction of a
+** loop is translated by copying a fixed machine code template (a stencil) and
+** patching its holes with stack offsets, constant addresses and branch
+** displacements. Lua registers are kept in the stack rather than in machine
+** registers, so the interpreter can take over at any instruction: a guard
+** that fails (an operand of an unexpected type, or a table access that misses
+** the array part or may need a metamethod) returns the pc of its instruction,
+** which the interpreter then executes in the usual way. Loops containing
+** calls or any other instruction without a stencil are left to the
+** interpreter.
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define ljit_c
+#define LUA_CORE
+
+#include "lua.h"
+
+#include "ljit.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+
+#if defined(LUA_USE_JIT)
+
+/* upper bound on the size of the code for one instruction, with its exits */
+#define MAXSTENCIL 256
+/* upper bound on the number of branches in the code for one instruction */
+#define MAXBRANCHES 8
+/* limit on the registers cleared by a compiled OP_LOADNIL */
+#define MAXLOADNIL 8
+
+/* condition codes */
+#define CC_ALWAYS (-1)
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_A 0x7
+#define CC_P 0xA
+#define CC_LE 0xE
+
+/* machine registers; `base' is passed in RDI and the closure's upvalues in RSI */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RSI 6
+#define RDI 7
+
+#define VOFF(r) (cast_int(sizeof(TValue)) * (r))
+#define TTOFF(r) (VOFF(r) + cast_int(offsetof(TValue, tt)))
+
+typedef struct JitBranch {
+    int at; /* offset of the displacement to patch */
+    int target; /* destination pc */
+    int isexit; /* return `target' to the interpreter rather than jump to it */
+} JitBranch;
+
+typedef struct JitState {
+    lua_State *L;
+    const Proto *p;
+    lu_byte *mcode;
+    int size;
+    int *label; /* code offset of each instruction of the loop */
+    JitBranch *branches;
+    int nbranches;
+    int start; /* pc of the first instruction of the loop body */
+    int end; /* pc of the loop's OP_FORLOOP */
+} JitState;
+
+#define sizejitcode(n) (sizeof(JitCode) + sizeof(JitLoop) * ((n) -1))
+
+#define jitentry(jc, offset) cast(JitFunction, cast(lu_byte *, (jc)->mcode) + (offset))
+
+/*
+** Emitters
+*/
+
+static void emitb (JitState *J, int b) {
+    J->mcode[J->size++] = cast(lu_byte, b);
+}
+
+static void emit32 (JitState *J, int v) {
+    unsigned int u = cast(unsigned int, v);
+    emitb(J, u & 0xff);
+    emitb(J, (u >> 8) & 0xff);
+    emitb(J, (u >> 16) & 0xff);
+    emitb(J, (u >> 24) & 0xff);
+}
+
+static void emitptr (JitState *J, const void *p) {
+    memcpy(J->mcode + J->size, &p, sizeof(p));
+    J->size += cast_int(sizeof(p));
+}
+
+/* ModRM byte addressing `disp'(`rm') with a 32-bit displacement */
+static void emitmem (JitState *J, int reg, int rm, int disp) {
+    emitb(J, 0x80 | (reg << 3) | rm);
+    emit32(J, disp);
+}
+
+/* jump (if `cc' holds) to `target', or return it to the interpreter */
+static void emitbranch (JitState *J, int cc, int target, int isexit) {
+    JitBranch *b = &J->branches[J->nbranches++];
+    if (cc == CC_ALWAYS) {
+        emitb(J, 0xe9); /* jmp rel32 */
+    } else {
+        emitb(J, 0x0f); /* jcc rel32 */
+        emitb(J, 0x80 | cc);
+    }
+    b->at = J->size;
+    b->target = target;
+    b->isexit = isexit || target < J->start || target > J->end;
+    emit32(J, 0);
+}
+
+#define emitgoto(J, cc, target) emitbranch(J, cc, target, 0)
+#define emitexit(J, cc, pc) emitbranch(J, cc, pc, 1)
+
+/* mov rax, imm64 */
+static void emitloadptr (JitState *J, const void *p) {
+    emitb(J, 0x48);
+    emitb(J, 0xb8);
+    emitptr(J, p);
+}
+
+/* exit at `pc' unless register `r' has type `tt' */
+static void emitguard (JitState *J, int r, int tt, int pc) {
+    emitb(J, 0x80); /* cmp byte [rdi+tt], imm8 */
+    emitmem(J, 7, RDI, TTOFF(r));
+    emitb(J, tt);
+    emitexit(J, CC_NE, pc);
+}
+
+/* set the type of register `r' to `tt'; values written with taint disabled are secure */
+static void emitsettype (JitState *J, int r, int tt) {
+    emitb(J, 0xc6); /* mov byte [rdi+tt], imm8 */
+    emitmem(J, 0, RDI, TTOFF(r));
+    emitb(J, tt);
+#if defined(LUA_USE_TAINT)
+    emitb(J, 0xc7); /* mov dword [rdi+taint], 0 */
+    emitmem(J, 0, RDI, VOFF(r) + cast_int(offsetof(TValue, taint)));
+    emit32(J, 0);
+#endif
+}
+
+/* movsd xmm, [rm+disp] (op 0x10) or movsd [rm+disp], xmm (op 0x11) */
+static void emitmovsd (JitState *J, int op, int x, int rm, int disp) {
+    emitb(J, 0xf2);
+    emitb(J, 0x0f);
+    emitb(J, op);
+    emitmem(J, x, rm, disp);
+}
+
+/* copy a whole value from `src'(`rm') to register `r' through xmm0 */
+static void emitcopy (JitState *J, int rm, int src, int r) {
+    emitb(J, 0x0f); /* movups xmm0, [rm+src] */
+    emitb(J, 0x10);
+    emitmem(J, 0, rm, src);
+    emitb(J, 0x0f); /* movups [rdi+r], xmm0 */
+    emitb(J, 0x11);
+    emitmem(J, 0, RDI, VOFF(r));
+}
+
+/* sse operation on two xmm registers, `op' xmm`d', xmm`s' */
+static void emitsse (JitState *J, int prefix, int op, int d, int s) {
+    emitb(J, prefix);
+    emitb(J, 0x0f);
+    emitb(J, op);
+    emitb(J, 0xc0 | (d << 3) | s);
+}
+
+#define emitucomisd(J, a, b) emitsse(J, 0x66, 0x2e, a, b)
+
+/* load the number in RK(`rk') into xmm`x'; fails for non-number constants */
+static int emitloadnum (JitState *J, int x, int rk, int pc) {
+    if (ISK(rk)) {
+        const TValue *o = &J->p->k[INDEXK(rk)];
+        if (!ttisnumber(o)) {
+            return 0;
+        }
+        emitloadptr(J, o);
+        emitmovsd(J, 0x10, x, RAX, 0);
+    } else {
+        emitguard(J, rk, LUA_TNUMBER, pc);
+        emitmovsd(J, 0x10, x, RDI, VOFF(rk));
+    }
+    return 1;
+}
+
+static void emitsetnum (JitState *J, int x, int r) {
+    emitmovsd(J, 0x11, x, RDI, VOFF(r));
+    emitsettype(J, r, LUA_TNUMBER);
+}
+
+/*
+** leave the address of the array slot of table `t' for the number key in
+** xmm0 in RDX (and the table in RAX), exiting unless the key is an integer
+** within the array part and the slot is not nil; values in non-nil slots are
+** read and written without metamethods
+*/
+static void emitarrayslot (JitState *J, int t, int pc) {
+    emitguard(J, t, LUA_TTABLE, pc);
+    emitb(J, 0x48); /* mov rax, [rdi+t] */
+    emitb(J, 0x8b);
+    emitmem(J, RAX, RDI, VOFF(t));
+    emitsse(J, 0xf2, 0x2c, RCX, 0); /* cvttsd2si ecx, xmm0 */
+    emitsse(J, 0xf2, 0x2a, 1, RCX); /* cvtsi2sd xmm1, ecx */
+    emitucomisd(J, 0, 1);
+    emitexit(J, CC_NE, pc);
+    emitexit(J, CC_P, pc);
+    emitb(J, 0x83); /* sub ecx, 1 */
+    emitb(J, 0xe9);
+    emitb(J, 1);
+    emitb(J, 0x3b); /* cmp ecx, [rax+sizearray] */
+    emitmem(J, RCX, RAX, cast_int(offsetof(Table, sizearray)));
+    emitexit(J, CC_AE, pc);
+    emitb(J, 0x48); /* mov rdx, [rax+array] */
+    emitb(J, 0x8b);
+    emitmem(J, RDX, RAX, cast_int(offsetof(Table, array)));
+    emitb(J, 0x48); /* shl rcx, 4 */
+    emitb(J, 0xc1);
+    emitb(J, 0xe1);
+    emitb(J, 4);
+    emitb(J, 0x48); /* add rdx, rcx */
+    emitb(J, 0x01);
+    emitb(J, 0xca);
+    emitb(J, 0x80); /* cmp byte [rdx+tt], LUA_TNIL */
+    emitmem(J, 7, RDX, cast_int(offsetof(TValue, tt)));
+    emitb(J, LUA_TNIL);
+    emitexit(J, CC_E, pc);
+}
+
+/* destination of the OP_JMP following a test at `pc', or -1 if unsupported */
+static int condtarget (JitState *J, int pc) {
+    Instruction jmp = J->p->code[pc + 1];
+    int target = pc + 2 + GETARG_sBx(jmp);
+    lua_assert(GET_OPCODE(jmp) == OP_JMP);
+    if (pc + 1 >= J->end || target <= pc + 1 || target > J->end + 1) {
+        return -1; /* only forward jumps within the loop (or out of it) */
+    }
+    return target;
+}
+
+/*
+** Stencils
+*/
+
+static int compileinstr (JitState *J, int pc) {
+    Instruction i = J->p->code[pc];
+    int a = GETARG_A(i);
+    switch (GET_GENERICOP(i)) {
+        case OP_MOVE: {
+            emitcopy(J, RDI, VOFF(GETARG_B(i)), a);
+            return 1;
+        }
+        case OP_LOADK: {
+            emitloadptr(J, &J->p->k[GETARG_Bx(i)]);
+            emitcopy(J, RAX, 0, a);
+            return 1;
+        }
+        case OP_GETUPVAL: {
+            emitb(J, 0x48); /* mov rax, [rsi+b] */
+            emitb(J, 0x8b);
+            emitmem(J, RAX, RSI, cast_int(sizeof(UpVal *)) * GETARG_B(i));
+            emitb(J, 0x48); /* mov rax, [rax+v] */
+            emitb(J, 0x8b);
+            emitmem(J, RAX, RAX, cast_int(offsetof(UpVal, v)));
+            emitcopy(J, RAX, 0, a);
+            return 1;
+        }
+        case OP_SETUPVAL: {
+            emitb(J, 0x80); /* cmp byte [rdi+tt], LUA_TSTRING */
+            emitmem(J, 7, RDI, TTOFF(a));
+            emitb(J, LUA_TSTRING);
+            emitexit(J, CC_AE, pc); /* collectable values need a write barrier */
+            emitb(J, 0x48); /* mov rax, [rsi+b] */
+            emitb(J, 0x8b);
+            emitmem(J, RAX, RSI, cast_int(sizeof(UpVal *)) * GETARG_B(i));
+            emitb(J, 0x48); /* mov rax, [rax+v] */
+            emitb(J, 0x8b);
+            emitmem(J, RAX, RAX, cast_int(offsetof(UpVal, v)));
+            emitb(J, 0x0f); /* movups xmm0, [rdi+a] */
+            emitb(J, 0x10);
+            emitmem(J, 0, RDI, VOFF(a));
+            emitb(J, 0x0f); /* movups [rax], xmm0 */
+            emitb(J, 0x11);
+            emitmem(J, 0, RAX, 0);
+            return 1;
+        }
+        case OP_LOADBOOL: {
+            emitb(J, 0xc7); /* mov dword [rdi+a], imm32 */
+            emitmem(J, 0, RDI, VOFF(a));
+            emit32(J, GETARG_B(i));
+            emitsettype(J, a, LUA_TBOOLEAN);
+            if (GETARG_C(i)) {
+                if (pc + 2 > J->end + 1) {
+                    return 0;
+                }
+                emitgoto(J, CC_ALWAYS, pc + 2);
+            }
+            return 1;
+        }
+        case OP_LOADNIL: {
+            int r;
+            if (GETARG_B(i) - a >= MAXLOADNIL) {
+                return 0;
+            }
+            for (r = a; r <= GETARG_B(i); r++) {
+                emitsettype(J, r, LUA_TNIL);
+            }
+            return 1;
+        }
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV: {
+            static const lu_byte sseops[] = {0x58, 0x5c, 0x59, 0x5e}; /* addsd, subsd, mulsd, divsd */
+            if (!emitloadnum(J, 0, GETARG_B(i), pc) || !emitloadnum(J, 1, GETARG_C(i), pc)) {
+                return 0;
+            }
+            emitsse(J, 0xf2, sseops[GET_GENERICOP(i) - OP_ADD], 0, 1);
+            emitsetnum(J, 0, a);
+            return 1;
+        }
+        case OP_UNM: {
+            int b = GETARG_B(i);
+            emitguard(J, b, LUA_TNUMBER, pc);
+            emitb(J, 0x48); /* mov rax, [rdi+b] */
+            emitb(J, 0x8b);
+            emitmem(J, RAX, RDI, VOFF(b));
+            emitb(J, 0x48); /* btc rax, 63 */
+            emitb(J, 0x0f);
+            emitb(J, 0xba);
+            emitb(J, 0xf8);
+            emitb(J, 63);
+            emitb(J, 0x48); /* mov [rdi+a], rax */
+            emitb(J, 0x89);
+            emitmem(J, RAX, RDI, VOFF(a));
+            emitsettype(J, a, LUA_TNUMBER);
+            return 1;
+        }
+        case OP_JMP: {
+            int target = pc + 1 + GETARG_sBx(i);
+            if (target <= pc || target > J->end + 1) {
+                return 0; /* backward jumps would need a safepoint */
+            }
+            emitgoto(J, CC_ALWAYS, target);
+            return 1;
+        }
+        case OP_EQ:
+        case OP_LT:
+        case OP_LE: {
+            OpCode op = GET_GENERICOP(i);
+            int target = condtarget(J, pc);
+            int jump = (a ? target : pc + 2); /* destination if the comparison holds */
+            int skip = (a ? pc + 2 : target);
+            if (target < 0 || !emitloadnum(J, 0, GETARG_B(i), pc) || !emitloadnum(J, 1, GETARG_C(i), pc)) {
+                return 0;
+            }
+            if (op == OP_EQ) {
+                emitucomisd(J, 0, 1);
+                emitgoto(J, CC_NE, skip);
+                emitgoto(J, CC_P, skip);
+            } else {
+                emitucomisd(J, 1, 0); /* unordered operands compare false */
+                emitgoto(J, op == OP_LT ? CC_A : CC_AE, jump);
+            }
+            emitgoto(J, CC_ALWAYS, op == OP_EQ ? jump : skip);
+            return 1;
+        }
+        case OP_TEST: {
+            int target = condtarget(J, pc);
+            int onfalse = (GETARG_C(i) ? pc + 2 : target);
+            int ontrue = (GETARG_C(i) ? target : pc + 2);
+            if (target < 0) {
+                return 0;
+            }
+            emitb(J, 0x80); /* cmp byte [rdi+tt], LUA_TNIL */
+            emitmem(J, 7, RDI, TTOFF(a));
+            emitb(J, LUA_TNIL);
+            emitgoto(J, CC_E, onfalse);
+            emitb(J, 0x80); /* cmp byte [rdi+tt], LUA_TBOOLEAN */
+            emitmem(J, 7, RDI, TTOFF(a));
+            emitb(J, LUA_TBOOLEAN);
+            emitgoto(J, CC_NE, ontrue);
+            emitb(J, 0x83); /* cmp dword [rdi+a], 0 */
+            emitmem(J, 7, RDI, VOFF(a));
+            emitb(J, 0);
+            emitgoto(J, CC_E, onfalse);
+            emitgoto(J, CC_ALWAYS, ontrue);
+            return 1;
+        }
+        case OP_GETTABLE: {
+            if (!emitloadnum(J, 0, GETARG_C(i), pc)) {
+                return 0;
+            }
+            emitarrayslot(J, GETARG_B(i), pc);
+            emitcopy(J, RDX, 0, a);
+            return 1;
+        }
+        case OP_SETTABLE: {
+            int c = GETARG_C(i);
+            if (ISK(c) ? iscollectable(&J->p->k[INDEXK(c)]) : 0) {
+                return 0; /* would need a write barrier */
+            }
+            if (!emitloadnum(J, 0, GETARG_B(i), pc)) {
+                return 0;
+            }
+            if (!ISK(c)) {
+                emitb(J, 0x80); /* cmp byte [rdi+tt], LUA_TSTRING */
+                emitmem(J, 7, RDI, TTOFF(c));
+                emitb(J, LUA_TSTRING);
+                emitexit(J, CC_AE, pc); /* collectable values need a write barrier */
+            }
+            emitarrayslot(J, a, pc);
+            emitb(J, 0xc6); /* mov byte [rax+flags], 0 */
+            emitmem(J, 0, RAX, cast_int(offsetof(Table, flags)));
+            emitb(J, 0);
+            if (ISK(c)) {
+                emitloadptr(J, &J->p->k[INDEXK(c)]);
+            }
+            emitb(J, 0x0f); /* movups xmm0, [src] */
+            emitb(J, 0x10);
+            emitmem(J, 0, ISK(c) ? RAX : RDI, ISK(c) ? 0 : VOFF(c));
+            emitb(J, 0x0f); /* movups [rdx], xmm0 */
+            emitb(J, 0x11);
+            emitmem(J, 0, RDX, 0);
+            return 1;
+        }
+        case OP_FORLOOP: {
+            int neg, cont;
+            if (pc != J->end) {
+                return 0;
+            }
+            emitloadptr(J, cast(const void *, &G(J->L)->interrupt));
+            emitb(J, 0x83); /* cmp dword [rax], 0 */
+            emitmem(J, 7, RAX, 0);
+            emitb(J, 0);
+            emitexit(J, CC_NE, pc); /* the interpreter handles the interrupt */
+            emitloadptr(J, cast(const void *, &G(J->L)->jitbudget));
+            emitb(J, 0x83); /* sub dword [rax], 1 */
+            emitmem(J, 5, RAX, 0);
+            emitb(J, 1);
+            emitexit(J, CC_LE, pc); /* ...and checks the script timeout */
+            emitmovsd(J, 0x10, 0, RDI, VOFF(a)); /* index */
+            emitmovsd(J, 0x10, 1, RDI, VOFF(a + 2)); /* step */
+            emitsse(J, 0xf2, 0x58, 0, 1);
+            emitmovsd(J, 0x10, 2, RDI, VOFF(a + 1)); /* limit */
+            emitsse(J, 0x66, 0x57, 3, 3); /* xorpd xmm3, xmm3 */
+            emitucomisd(J, 1, 3);
+            emitb(J, 0x76); /* jbe neg */
+            neg = J->size;
+            emitb(J, 0);
+            emitucomisd(J, 2, 0);
+            emitexit(J, CC_B, pc + 1);
+            emitb(J, 0xeb); /* jmp cont */
+            cont = J->size;
+            emitb(J, 0);
+            J->mcode[neg] = cast(lu_byte, J->size - (neg + 1));
+            emitucomisd(J, 0, 2);
+            emitexit(J, CC_B, pc + 1);
+            J->mcode[cont] = cast(lu_byte, J->size - (cont + 1));
+            emitmovsd(J, 0x11, 0, RDI, VOFF(a));
+            emitsetnum(J, 0, a + 3);
+            emitgoto(J, CC_ALWAYS, J->start);
+            return 1;
+        }
+        default: {
+            return 0;
+        }
+    }
+}
+
+/* compile the loop from `start' to its OP_FORLOOP at `end', returning 0 on failure */
+static int compileloop (JitState *J, int start, int end) {
+    int mark = J->size;
+    int pc;
+    J->start = start;
+    J->end = end;
+    J->nbranches = 0;
+    for (pc = start; pc <= end; pc++) {
+        J->label[pc] = J->size;
+        if (!compileinstr(J, pc)) {
+            J->size = mark;
+            return 0;
+        }
+    }
+    for (pc = 0; pc < J->nbranches; pc++) {
+        JitBranch *b = &J->branches[pc];
+        int dest = J->label[b->target];
+        int rel;
+        if (b->isexit) {
+            dest = J->size;
+            emitb(J, 0xb8); /* mov eax, target */
+            emit32(J, b->target);
+            emitb(J, 0xc3); /* ret */
+        }
+        rel = dest - (b->at + 4);
+        memcpy(J->mcode + b->at, &rel, sizeof(rel));
+    }
+    return 1;
+}
+
+void luaJ_compile (lua_State *L, Proto *p) {
+    JitCode *jc;
+    JitState J;
+    lu_byte *buff;
+    size_t sizebuff;
+    int nforprep = 0;
+    int pc;
+    p->jitcount = 0; /* never try again */
+    if (sizeof(TValue) != 16) {
+        return; /* stencils index arrays with a shift */
+    }
+    for (pc = 0; pc < p->sizecode; pc++) {
+        if (GET_OPCODE(p->code[pc]) == OP_FORPREP) {
+            nforprep++;
+        }
+    }
+    if (nforprep == 0) {
+        return;
+    }
+    /* attach the loop table first so that it is freed with the prototype on errors */
+    jc = cast(JitCode *, luaM_malloc(L, sizejitcode(nforprep)));
+    jc->mcode = NULL;
+    jc->sizemcode = 0;
+    jc->sizeloops = nforprep;
+    jc->nloops = 0;
+    p->jit = jc;
+    sizebuff = sizeof(int) * (p->sizecode + 1) + sizeof(JitBranch) * MAXBRANCHES * (p->sizecode + 1) +
+               MAXSTENCIL * (p->sizecode + 1);
+    buff = cast(lu_byte *, luaM_malloc(L, sizebuff));
+    J.L = L;
+    J.p = p;
+    J.label = cast(int *, buff);
+    J.branches = cast(JitBranch *, J.label + p->sizecode + 1);
+    J.mcode = cast(lu_byte *, J.branches + MAXBRANCHES * (p->sizecode + 1));
+    J.size = 0;
+    for (pc = 0; pc < p->sizecode; pc++) {
+        Instruction i = p->code[pc];
+        if (GET_OPCODE(i) == OP_FORPREP) {
+            JitLoop *loop = &jc->loops[jc->nloops];
+            loop->start = pc + 1;
+            loop->end = pc + 1 + GETARG_sBx(i);
+            if (compileloop(&J, loop->start, loop->end)) {
+                loop->body = J.label[loop->start];
+                loop->forloop = J.label[loop->end];
+                jc->nloops++;
+            }
+        }
+    }
+    if (jc->nloops > 0) {
+        void *mcode = mmap(NULL, cast(size_t, J.size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mcode != MAP_FAILED) {
+            memcpy(mcode, J.mcode, cast(size_t, J.size));
+            if (mprotect(mcode, cast(size_t, J.size), PROT_READ | PROT_EXEC) == 0) {
+                jc->mcode = mcode;
+                jc->sizemcode = cast(size_t, J.size);
+            } else {
+                munmap(mcode, cast(size_t, J.size));
+            }
+        }
+    }
+    luaM_freemem(L, buff, sizebuff);
+    if (jc->mcode == NULL) {
+        luaJ_free(L, p);
+    }
+}
+
+int luaJ_execute (LClosure *cl, int pc, StkId base) {
+    const JitCode *jc = cl->p->jit;
+    int n;
+    for (n = 0; n < jc->nloops; n++) {
+        const JitLoop *loop = &jc->loops[n];
+        if (pc == loop->end) {
+            return jitentry(jc, loop->forloop)(base, cl->upvals);
+        } else if (pc == loop->start) {
+            return jitentry(jc, loop->body)(base, cl->upvals);
+        }
+    }
+    return -1;
+}
+
+void luaJ_free (lua_State *L, Proto *p) {
+    JitCode *jc = p->jit;
+    if (jc != NULL) {
+        if (jc->mcode != NULL) {
+            munmap(jc->mcode, jc->sizemcode);
+        }
+        luaM_freemem(L, jc, sizejitcode(jc->sizeloops));
+        p->jit = NULL;
+    }
+}
+
+#endif
@@ -0,0 +1,35 @@
+/* Licensed under the terms of the MIT License; see full copyright information
+ * in the "LICENSE" file or at <http://www.lua.org/license.html> */
+
+#ifndef ljit_h
+#define ljit_h
+
+#include "lobject.h"
+
+#if defined(LUA_USE_JIT)
+
+/* native code of a compiled loop; returns the pc at which to continue */
+typedef int (*JitFunction)(TValue *base, UpVal **upvals);
+
+typedef struct JitLoop {
+    int start; /* pc of the first instruction of the loop body */
+    int end; /* pc of the loop's OP_FORLOOP */
+    int body; /* offset of the code for `start' */
+    int forloop; /* offset of the code for `end' */
+} JitLoop;
+
+typedef struct JitCode {
+    void *mcode; /* executable mapping holding the native code */
+    size_t sizemcode;
+    int sizeloops;
+    int nloops;
+    JitLoop loops[1];
+} JitCode;
+
+LUAI_FUNC void luaJ_compile (lua_State *L, Proto *p);
+LUAI_FUNC int luaJ_execute (LClosure *cl, int pc, StkId base);
+LUAI_FUNC void luaJ_free (lua_State *L, Proto *p);
+
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+/* Licensed under the terms of the MIT License; see full copyright information
+ * in the "LICENSE" file or at <http://www.lua.org/license.html> */
+
+/*
+** Jump table used by `luaV_execute' for direct-threaded dispatch. This file
+** is only included by lvm.c and must be kept in the same order as the OpCode
+** enumeration in lopcodes.h.
+*/
+
+#undef vmdispatch
+#undef vmcase
+#undef vmbreak
+
+#define vmdispatch(x) goto *disptab[x];
+
+#define vmcase(l) L_##l:
+
+#define vmbreak                                                                                                        \
+    vmfetch();                                                                                                         \
+    vmdispatch(GET_OPCODE(i));
+
+static const void *const disptab[NUM_OPCODES] = {
+    &&L_OP_MOVE,
+    &&L_OP_LOADK,
+    &&L_OP_LOADBOOL,
+    &&L_OP_LOADNIL,
+    &&L_OP_GETUPVAL,
+    &&L_OP_GETGLOBAL,
+    &&L_OP_GETTABLE,
+    &&L_OP_SETGLOBAL,
+    &&L_OP_SETUPVAL,
+    &&L_OP_SETTABLE,
+    &&L_OP_NEWTABLE,
+    &&L_OP_SELF,
+    &&L_OP_ADD,
+    &&L_OP_SUB,
+    &&L_OP_MUL,
+    &&L_OP_DIV,
+    &&L_OP_MOD,
+    &&L_OP_POW,
+    &&L_OP_UNM,
+    &&L_OP_NOT,
+    &&L_OP_LEN,
+    &&L_OP_CONCAT,
+    &&L_OP_JMP,
+    &&L_OP_EQ,
+    &&L_OP_LT,
+    &&L_OP_LE,
+    &&L_OP_TEST,
+    &&L_OP_TESTSET,
+    &&L_OP_CALL,
+    &&L_OP_TAILCALL,
+    &&L_OP_RETURN,
+    &&L_OP_FORLOOP,
+    &&L_OP_FORPREP,
+    &&L_OP_TFORLOOP,
+    &&L_OP_SETLIST,
+    &&L_OP_CLOSE,
+    &&L_OP_CLOSURE,
+    &&L_OP_VARARG,
+    &&L_OP_GETGLOBALTABLE,
+    &&L_OP_GETGLOBALCALL,
+    &&L_OP_GETTABLETEST,
+    &&L_OP_SELFCALL,
+    &&L_OP_LOADKCALL,
+    &&L_OP_ADDNN,
+    &&L_OP_SUBNN,
+    &&L_OP_MULNN,
+    &&L_OP_DIVNN,
+    &&L_OP_MODNN,
+    &&L_OP_POWNN,
+    &&L_OP_UNMN,
+    &&L_OP_EQNUM,
+    &&L_OP_LTNUM,
+    &&L_OP_LENUM,
+};
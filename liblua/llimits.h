@@ -85,6 +85,27 @@ typedef uint_least32_t Instruction;
         lua_lock(L);                                                                                                   \
     }
 
+/* Atomic updates of interrupt words; these may be used from other threads
+ * and from signal handlers (see `lua_interrupt'). The 64-bit loads and stores
+ * are for values shared by all states in the process. */
+#if defined(__GNUC__)
+#define luai_atomicor(p, v) ((void) __atomic_fetch_or((p), (v), __ATOMIC_SEQ_CST))
+#define luai_atomicand(p, v) ((void) __atomic_fetch_and((p), (v), __ATOMIC_SEQ_CST))
+#define luai_atomicload64(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define luai_atomicstore64(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define luai_atomicor(p, v) ((void) _InterlockedOr((volatile long *) (p), (long) (v)))
+#define luai_atomicand(p, v) ((void) _InterlockedAnd((volatile long *) (p), (long) (v)))
+#define luai_atomicload64(p) _InterlockedCompareExchange64((volatile __int64 *) (p), 0, 0)
+#define luai_atomicstore64(p, v) ((void) _InterlockedExchange64((volatile __int64 *) (p), (__int64) (v)))
+#else
+#define luai_atomicor(p, v) ((void) (*(p) |= (v)))
+#define luai_atomicand(p, v) ((void) (*(p) &= (v)))
+#define luai_atomicload64(p) (*(p))
+#define luai_atomicstore64(p, v) ((void) (*(p) = (v)))
+#endif
+
 /* Stack reallocation tests */
 #ifndef HARDSTACKTESTS
 #define condhardstacktests(x) lua_nop()
@@ -29,5 +29,11 @@ extern void sethvalue2s (lua_State *L, StkId dst, Table *src);
 extern void setptvalue2s (lua_State *L, StkId dst, Proto *src);
 extern void setsvalue2n (lua_State *L, TValue *dst, TString *src);
 extern void setsvalue2s (lua_State *L, StkId dst, TString *src);
+extern void setnilvaluem (lua_State *L, TValue *dst, lu_byte mode);
+extern void setnvaluem (lua_State *L, TValue *dst, lua_Number n, lu_byte mode);
+extern void setbvaluem (lua_State *L, TValue *dst, int b, lu_byte mode);
+extern void setclvaluem (lua_State *L, TValue *dst, Closure *cl, lu_byte mode);
+extern void sethvaluem (lua_State *L, TValue *dst, Table *h, lu_byte mode);
+extern void setobj2sm (lua_State *L, StkId dst, const TValue *src, lu_byte mode);
 extern void rawsetnilvalue (TValue *dst);
 extern void rawsetnvalue (TValue *dst, lua_Number n);
@@ -15,73 +15,73 @@
 
 inline void setnilvalue (lua_State *L, TValue *dst) {
     dst->tt = LUA_TNIL;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
 }
 
 inline void setnvalue (lua_State *L, TValue *dst, lua_Number n) {
     dst->value.n = n;
     dst->tt = LUA_TNUMBER;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
 }
 
 inline void setpvalue (lua_State *L, TValue *dst, void *p) {
     dst->value.p = p;
     dst->tt = LUA_TLIGHTUSERDATA;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
 }
 
 inline void setbvalue (lua_State *L, TValue *dst, int b) {
     dst->value.b = b;
     dst->tt = LUA_TBOOLEAN;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
 }
 
 inline void setsvalue (lua_State *L, TValue *dst, TString *s) {
     dst->value.gc = cast(GCObject *, s);
     dst->tt = LUA_TSTRING;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
     checkliveness(G(L), dst);
 }
 
 inline void setuvalue (lua_State *L, TValue *dst, Udata *u) {
     dst->value.gc = cast(GCObject *, u);
     dst->tt = LUA_TUSERDATA;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
     checkliveness(G(L), dst);
 }
 
 inline void setthvalue (lua_State *L, TValue *dst, lua_State *th) {
     dst->value.gc = cast(GCObject *, th);
     dst->tt = LUA_TTHREAD;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
     checkliveness(G(L), dst);
 }
 
 inline void setclvalue (lua_State *L, TValue *dst, Closure *cl) {
     dst->value.gc = cast(GCObject *, cl);
     dst->tt = LUA_TFUNCTION;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
     checkliveness(G(L), dst);
 }
 
 inline void sethvalue (lua_State *L, TValue *dst, Table *h) {
     dst->value.gc = cast(GCObject *, h);
     dst->tt = LUA_TTABLE;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
     checkliveness(G(L), dst);
 }
 
 inline void setptvalue (lua_State *L, TValue *dst, Proto *pt) {
     dst->value.gc = cast(GCObject *, pt);
     dst->tt = LUA_TPROTO;
-    dst->taint = L->writetaint;
+    luaR_initvaluetaint(L, dst);
     checkliveness(G(L), dst);
 }
 
 inline void setobj (lua_State *L, TValue *dst, const TValue *src) {
     dst->value = src->value;
     dst->tt = src->tt;
-    dst->taint = src->taint;
+    luaR_setvaluetaint(dst, luaR_getvaluetaint(src));
     checkliveness(G(L), dst);
 }
 
@@ -93,13 +93,7 @@ inline void setobj (lua_State *L, TValue *dst, const TValue *src) {
 inline void setobj2s (lua_State *L, StkId dst, const TValue *src) {
     dst->value = src->value;
     dst->tt = src->tt;
-    dst->taint = src->taint;
-
-    if (dst->taint == NULL) {
-        dst->taint = L->writetaint;
-    } else {
-        luaR_taintstack(L, src->taint);
-    }
+    luaR_copyvaluetaint(L, dst, src);
 
     checkliveness(G(L), dst);
 }
@@ -165,17 +159,64 @@ inline void setsvalue2s (lua_State *L, StkId dst, TString *src) {
     setsvalue(L, dst, src);
 }
 
+/**
+ * Functions to set values under a fixed taint mode
+ *
+ * These behave identically to their counterparts above when 'mode' matches
+ * the current taint mode of the thread. The VM calls these with a constant
+ * mode so that any propagation that cannot occur is compiled out.
+ */
+
+inline void setnilvaluem (lua_State *L, TValue *dst, lu_byte mode) {
+    dst->tt = LUA_TNIL;
+    luaR_initvaluetaintm(L, dst, mode);
+}
+
+inline void setnvaluem (lua_State *L, TValue *dst, lua_Number n, lu_byte mode) {
+    dst->value.n = n;
+    dst->tt = LUA_TNUMBER;
+    luaR_initvaluetaintm(L, dst, mode);
+}
+
+inline void setbvaluem (lua_State *L, TValue *dst, int b, lu_byte mode) {
+    dst->value.b = b;
+    dst->tt = LUA_TBOOLEAN;
+    luaR_initvaluetaintm(L, dst, mode);
+}
+
+inline void setclvaluem (lua_State *L, TValue *dst, Closure *cl, lu_byte mode) {
+    dst->value.gc = cast(GCObject *, cl);
+    dst->tt = LUA_TFUNCTION;
+    luaR_initvaluetaintm(L, dst, mode);
+    checkliveness(G(L), dst);
+}
+
+inline void sethvaluem (lua_State *L, TValue *dst, Table *h, lu_byte mode) {
+    dst->value.gc = cast(GCObject *, h);
+    dst->tt = LUA_TTABLE;
+    luaR_initvaluetaintm(L, dst, mode);
+    checkliveness(G(L), dst);
+}
+
+inline void setobj2sm (lua_State *L, StkId dst, const TValue *src, lu_byte mode) {
+    dst->value = src->value;
+    dst->tt = src->tt;
+    luaR_copyvaluetaintm(L, dst, src, mode);
+
+    checkliveness(G(L), dst);
+}
+
 /* set nil value (untainted) */
 inline void rawsetnilvalue (TValue *dst) {
     dst->tt = LUA_TNIL;
-    dst->taint = NULL;
+    luaR_setvaluetaint(dst, 0);
 }
 
 /* set numeric value (untainted) */
 inline void rawsetnvalue (TValue *dst, lua_Number n) {
     dst->value.n = n;
     dst->tt = LUA_TNUMBER;
-    dst->taint = NULL;
+    luaR_setvaluetaint(dst, 0);
 }
 
 #endif
@@ -2,6 +2,8 @@
  * in the "LICENSE" file or at <http://www.lua.org/license.html> */
 
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define lmem_c
 #define LUA_CORE
@@ -14,6 +16,12 @@
 #include "lobject.h"
 #include "lstate.h"
 
+#if defined(LUA_USE_POSIX)
+#include <sys/mman.h>
+#elif defined(LUA_USE_WINDOWS)
+#include <malloc.h>
+#endif
+
 /*
 ** About the realloc function:
 ** void * frealloc (void *ud, void *ptr, size_t osize, size_t nsize);
@@ -62,7 +70,11 @@ void *luaM_toobig (lua_State *L) {
 */
 void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
     global_State *g = G(L);
+    int sampled = 0;
     lua_assert((osize == 0) == (block == NULL));
+    if (g->allocsampler != NULL) {
+        sampled = luaG_allocsample(L, block, osize, nsize); /* before the stack can move */
+    }
     block = (*g->frealloc)(g->ud, block, osize, nsize);
     if (block == NULL && nsize > 0) {
         luaD_throw(L, LUA_ERRMEM);
@@ -72,5 +84,325 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
     if (nsize > osize) {
         g->bytesallocated += (nsize - osize);
     }
+    if (sampled) {
+        luaG_allocsampled(L, block, nsize);
+    }
+    return block;
+}
+
+/*
+** {======================================================
+** Pooled allocator
+** =======================================================
+*/
+
+/*
+** Blocks of up to POOLMAXSMALL bytes are served from size classes, each
+** class carving its blocks out of arenas of POOLARENASIZE bytes; larger
+** blocks go to `malloc' and `realloc'. Arenas are cut from chunks aligned to
+** their size, so the chunk holding a pointer is found by masking its address
+** and looking it up in `chunks', and the arena of a pooled block (which
+** records its size class) by masking it further. Chunks are returned to the
+** system only when the pool is freed; an arena left without blocks in use
+** goes to `freearenas', from where any class may take it.
+*/
+
+#define POOLCHUNKSIZE (cast(size_t, 1) << 21) /* a huge page on most systems */
+#define POOLARENASIZE (cast(size_t, 1) << 16)
+#define POOLARENAHEADER 64 /* room for the header, keeping blocks aligned */
+#define POOLMAXSMALL 512
+#define POOLCLASSES 20
+
+/* size class of `s' bytes: steps of 16 bytes up to 256, then of 64 */
+#define sizeclass(s) ((s) <= 256 ? (cast_int(s) - 1) >> 4 : 12 + ((cast_int(s) - 1) >> 6))
+
+#define chunkof(b) cast(char *, cast(size_t, (b)) & ~(POOLCHUNKSIZE - 1))
+#define arenaof(b) cast(PoolArena *, cast(size_t, (b)) & ~(POOLARENASIZE - 1))
+#define chunkslot(p, c) ((cast(size_t, (c)) / POOLCHUNKSIZE) & ((p)->sizechunks - 1))
+
+static const unsigned short classsize[POOLCLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256, 320, 384, 448, 512,
+};
+
+typedef struct PoolArena {
+    struct PoolArena *next; /* next arena in its list */
+    struct PoolArena *prev;
+    void *free; /* list of freed blocks */
+    char *top; /* first block never handed out */
+    char *limit; /* end of the last whole block */
+    int sizeclass;
+    int nused; /* number of blocks in use */
+    int partial; /* whether the arena is in the list of its class */
+} PoolArena;
+
+typedef struct Pool {
+    PoolArena *partial[POOLCLASSES]; /* arenas with free blocks, by class */
+    PoolArena *freearenas; /* arenas without blocks in use */
+    char *nextarena; /* first arena of the newest chunk never used */
+    char *endchunk;
+    char **chunks; /* set of all chunks, hashed by address */
+    size_t sizechunks;
+    size_t nchunks;
+    size_t bytesreserved; /* bytes of all chunks */
+    size_t bytesinuse; /* bytes of the blocks in use, rounded up to their class */
+    size_t bytesrequested; /* bytes asked for the blocks in use */
+    int hugepages;
+} Pool;
+
+static char *allocchunk (Pool *p) {
+#if defined(LUA_USE_POSIX)
+    /* map twice the size and trim it to a chunk aligned to its size */
+    char *c = cast(char *, mmap(NULL, 2 * POOLCHUNKSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    size_t skip;
+    if (c == cast(char *, MAP_FAILED)) {
+        return NULL;
+    }
+    skip = (POOLCHUNKSIZE - (cast(size_t, c) & (POOLCHUNKSIZE - 1))) & (POOLCHUNKSIZE - 1);
+    if (skip > 0) {
+        munmap(c, skip);
+    }
+    munmap(c + skip + POOLCHUNKSIZE, POOLCHUNKSIZE - skip);
+    c += skip;
+#if defined(MADV_HUGEPAGE)
+    if (p->hugepages) {
+        madvise(c, POOLCHUNKSIZE, MADV_HUGEPAGE);
+    }
+#endif
+    lua_unused(p);
+    return c;
+#elif defined(LUA_USE_WINDOWS)
+    lua_unused(p);
+    return cast(char *, _aligned_malloc(POOLCHUNKSIZE, POOLCHUNKSIZE));
+#else
+    lua_unused(p);
+    return cast(char *, aligned_alloc(POOLCHUNKSIZE, POOLCHUNKSIZE));
+#endif
+}
+
+static void freechunk (char *c) {
+#if defined(LUA_USE_POSIX)
+    munmap(c, POOLCHUNKSIZE);
+#elif defined(LUA_USE_WINDOWS)
+    _aligned_free(c);
+#else
+    free(c);
+#endif
+}
+
+static void insertchunk (Pool *p, char *c) {
+    size_t i = chunkslot(p, c);
+    while (p->chunks[i] != NULL) {
+        i = (i + 1) & (p->sizechunks - 1);
+    }
+    p->chunks[i] = c;
+}
+
+static int addchunk (Pool *p, char *c) {
+    if (2 * (p->nchunks + 1) > p->sizechunks) { /* keep the set at most half full */
+        char **old = p->chunks;
+        size_t oldsize = p->sizechunks;
+        size_t i;
+        p->chunks = cast(char **, calloc(oldsize > 0 ? 2 * oldsize : 16, sizeof(char *)));
+        if (p->chunks == NULL) {
+            p->chunks = old;
+            return 0;
+        }
+        p->sizechunks = oldsize > 0 ? 2 * oldsize : 16;
+        for (i = 0; i < oldsize; i++) {
+            if (old[i] != NULL) {
+                insertchunk(p, old[i]);
+            }
+        }
+        free(old);
+    }
+    insertchunk(p, c);
+    p->nchunks++;
+    return 1;
+}
+
+static int ispooled (Pool *p, void *b) {
+    char *c = chunkof(b);
+    size_t i;
+    if (p->nchunks == 0) {
+        return 0;
+    }
+    for (i = chunkslot(p, c); p->chunks[i] != NULL; i = (i + 1) & (p->sizechunks - 1)) {
+        if (p->chunks[i] == c) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void linkarena (Pool *p, PoolArena *a) {
+    a->prev = NULL;
+    a->next = p->partial[a->sizeclass];
+    if (a->next != NULL) {
+        a->next->prev = a;
+    }
+    p->partial[a->sizeclass] = a;
+    a->partial = 1;
+}
+
+static void unlinkarena (Pool *p, PoolArena *a) {
+    if (a->prev != NULL) {
+        a->prev->next = a->next;
+    } else {
+        p->partial[a->sizeclass] = a->next;
+    }
+    if (a->next != NULL) {
+        a->next->prev = a->prev;
+    }
+    a->partial = 0;
+}
+
+static PoolArena *newarena (Pool *p, int c) {
+    PoolArena *a = p->freearenas;
+    if (a != NULL) {
+        p->freearenas = a->next;
+    } else {
+        if (p->nextarena == p->endchunk) { /* newest chunk used up? */
+            char *chunk = allocchunk(p);
+            if (chunk == NULL) {
+                return NULL;
+            } else if (!addchunk(p, chunk)) {
+                freechunk(chunk);
+                return NULL;
+            }
+            p->nextarena = chunk;
+            p->endchunk = chunk + POOLCHUNKSIZE;
+            p->bytesreserved += POOLCHUNKSIZE;
+        }
+        a = cast(PoolArena *, p->nextarena);
+        p->nextarena += POOLARENASIZE;
+    }
+    a->free = NULL;
+    a->top = cast(char *, a) + POOLARENAHEADER;
+    a->limit = a->top + ((POOLARENASIZE - POOLARENAHEADER) / classsize[c]) * classsize[c];
+    a->sizeclass = c;
+    a->nused = 0;
+    linkarena(p, a);
+    return a;
+}
+
+static void *poolmalloc (Pool *p, size_t size) {
+    int c = sizeclass(size);
+    PoolArena *a = p->partial[c];
+    void *b;
+    lua_assert(size <= classsize[c] && (c == 0 || size > classsize[c - 1]));
+    if (a == NULL && (a = newarena(p, c)) == NULL) {
+        return NULL;
+    }
+    if (a->free != NULL) {
+        b = a->free;
+        a->free = *cast(void **, b);
+    } else {
+        b = a->top;
+        a->top += classsize[c];
+    }
+    a->nused++;
+    if (a->free == NULL && a->top == a->limit) { /* arena is full? */
+        unlinkarena(p, a);
+    }
+    p->bytesinuse += classsize[c];
+    p->bytesrequested += size;
+    return b;
+}
+
+static void poolfree (Pool *p, void *b, size_t size) {
+    PoolArena *a = arenaof(b);
+    *cast(void **, b) = a->free;
+    a->free = b;
+    a->nused--;
+    p->bytesinuse -= classsize[a->sizeclass];
+    p->bytesrequested -= size;
+    if (a->nused == 0) { /* let any class reuse the arena */
+        if (a->partial) {
+            unlinkarena(p, a);
+        }
+        a->next = p->freearenas;
+        p->freearenas = a;
+    } else if (!a->partial) {
+        linkarena(p, a);
+    }
+}
+
+void *luaM_poolalloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+    Pool *p = cast(Pool *, ud);
+    int pooled = (ptr != NULL && ispooled(p, ptr));
+    void *block;
+    if (nsize == 0) {
+        if (pooled) {
+            poolfree(p, ptr, osize);
+        } else {
+            free(ptr);
+        }
+        return NULL;
+    } else if (pooled && nsize <= POOLMAXSMALL && sizeclass(nsize) == arenaof(ptr)->sizeclass) {
+        p->bytesrequested = (p->bytesrequested - osize) + nsize;
+        return ptr; /* block already has the right class */
+    } else if (!pooled && nsize > POOLMAXSMALL) {
+        return realloc(ptr, nsize);
+    }
+    block = (nsize <= POOLMAXSMALL) ? poolmalloc(p, nsize) : malloc(nsize);
+    if (block == NULL) {
+        if (ptr != NULL && nsize <= osize) { /* shrinking cannot fail: keep the block */
+            if (pooled) {
+                p->bytesrequested = (p->bytesrequested - osize) + nsize;
+            }
+            return ptr;
+        }
+        return NULL;
+    }
+    if (ptr != NULL) {
+        memcpy(block, ptr, (osize < nsize) ? osize : nsize);
+        if (pooled) {
+            poolfree(p, ptr, osize);
+        } else {
+            free(ptr);
+        }
+    }
     return block;
 }
+
+void *luaM_newpool (int hugepages) {
+    Pool *p = cast(Pool *, malloc(sizeof(Pool)));
+    int c;
+    if (p == NULL) {
+        return NULL;
+    }
+    for (c = 0; c < POOLCLASSES; c++) {
+        p->partial[c] = NULL;
+    }
+    p->freearenas = NULL;
+    p->nextarena = p->endchunk = NULL;
+    p->chunks = NULL;
+    p->sizechunks = 0;
+    p->nchunks = 0;
+    p->bytesreserved = 0;
+    p->bytesinuse = 0;
+    p->bytesrequested = 0;
+    p->hugepages = hugepages;
+    return p;
+}
+
+void luaM_freepool (void *ud) {
+    Pool *p = cast(Pool *, ud);
+    size_t i;
+    for (i = 0; i < p->sizechunks; i++) {
+        if (p->chunks[i] != NULL) {
+            freechunk(p->chunks[i]);
+        }
+    }
+    free(p->chunks);
+    free(p);
+}
+
+void luaM_poolstats (void *ud, lua_GlobalStats *stats) {
+    Pool *p = cast(Pool *, ud);
+    stats->bytesreserved = p->bytesreserved;
+    stats->bytesfree = p->bytesreserved - p->bytesinuse;
+    stats->byteswasted = p->bytesinuse - p->bytesrequested;
+}
+
+/* }====================================================== */
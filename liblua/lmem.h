@@ -35,4 +35,9 @@ LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize, size_t
 LUAI_FUNC void *luaM_toobig (lua_State *L);
 LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int *size, size_t size_elem, int limit, const char *errormsg);
 
+LUAI_FUNC void *luaM_poolalloc (void *ud, void *ptr, size_t osize, size_t nsize);
+LUAI_FUNC void *luaM_newpool (int hugepages);
+LUAI_FUNC void luaM_freepool (void *ud);
+LUAI_FUNC void luaM_poolstats (void *ud, lua_GlobalStats *stats);
+
 #endif
@@ -28,13 +28,28 @@
 typedef union GCObject GCObject;
 typedef union TString TString;
 
+/*
+** Reference to a taint name; an index into the taint registry of the global
+** state, or zero if untainted (see lsec.h)
+*/
+typedef uint_least32_t TaintRef;
+
+/*
+** Taint field of values and objects; omitted in taint-free builds
+*/
+#if defined(LUA_USE_TAINT)
+#define TaintField TaintRef taint;
+#else
+#define TaintField
+#endif
+
 /*
 ** Common Header for all collectable objects (in macro form, to be
 ** included in other objects)
 */
 #define CommonHeader                                                                                                   \
     GCObject *next;                                                                                                    \
-    TString *taint;                                                                                                    \
+    TaintField                                                                                                         \
     lu_byte tt;                                                                                                        \
     lu_byte marked
 
@@ -56,12 +71,13 @@ typedef union {
 } Value;
 
 /*
-** Tagged Values
+** Tagged Values; the taint reference shares the word holding the type tag
+** so that a TValue is no larger than in stock Lua
 */
 
 #define TValuefields                                                                                                   \
     Value value;                                                                                                       \
-    TString *taint;                                                                                                    \
+    TaintField                                                                                                         \
     lu_byte tt
 
 typedef struct lua_TValue {
@@ -116,6 +132,9 @@ typedef union TString {
         CommonHeader;
         lu_byte reserved;
         unsigned int hash;
+#if defined(LUA_USE_TAINT)
+        TaintRef taintref; /* registry index if used as a taint name */
+#endif
         size_t len;
     } tsv;
 } TString;
@@ -136,10 +155,56 @@ typedef union Udata {
 /*
 ** Function Prototypes
 */
+/*
+** Inline cache for table accesses with a string key. Each field is the node
+** index at which the key was last found; they are only hints and are checked
+** against the key on each use, so need no invalidation when tables rehash.
+*/
+typedef struct ICache {
+    unsigned int slot; /* node index in the indexed table */
+    unsigned int hslot; /* node index in its `__index' table */
+} ICache;
+
+#if defined(LUA_USE_PREDECODE)
+/*
+** Pre-decoded form of an instruction, executed by the VM in place of `code'
+** when built with `LUA_USE_PREDECODE'. Constant operands are resolved to
+** pointers into `k' and jumps to pointers to their destination; `code' is
+** left untouched for debug information and dumps.
+*/
+typedef struct DInstruction {
+    Instruction i; /* the instruction; the VM may rewrite its opcode */
+    const Instruction *pc; /* address of the instruction in `code' */
+    TValue *rkb; /* RK(B) or Kst(Bx) if a constant, else NULL */
+    union {
+        TValue *rkc; /* RK(C) if a constant, else NULL */
+        const struct DInstruction *target; /* destination of a jump */
+    } u;
+} DInstruction;
+#endif
+
+/*
+** Line profiling counters of an instruction; `ticks' are sampled once every
+** `LUAI_LINESAMPLE' counted instructions.
+*/
+typedef struct LineStats {
+    uint_least64_t hits; /* number of times the instruction was executed */
+    lua_Clock ticks; /* ticks attributed to the instruction */
+} LineStats;
+
 typedef struct Proto {
     CommonHeader;
     TValue *k; /* constants used by the function */
     Instruction *code;
+    ICache *icache; /* inline caches for table accesses (indexed by pc) */
+#if defined(LUA_USE_PREDECODE)
+    DInstruction *dcode; /* pre-decoded `code' (indexed by pc) */
+#endif
+#if defined(LUA_USE_JIT)
+    struct JitCode *jit; /* native code for the function's loops */
+#endif
+    LineStats *linestats; /* line profiling counters (indexed by pc) */
+    struct ClosureStats *stats; /* profiling counters shared by its closures */
     struct Proto **p; /* functions defined inside the function */
     int *lineinfo; /* map from opcodes to source lines */
     struct LocVar *locvars; /* information about local variables */
@@ -148,11 +213,21 @@ typedef struct Proto {
     int sizeupvalues;
     int sizek; /* size of `k' */
     int sizecode;
+    int sizeicache;
+    int sizelinestats;
+    uint_least32_t lineepoch; /* stats epoch of `linestats' */
+#if defined(LUA_USE_PREDECODE)
+    int sizedcode;
+#endif
+#if defined(LUA_USE_JIT)
+    int jitcount; /* loop iterations left before compiling the loops */
+#endif
     int sizelineinfo;
     int sizep; /* size of `p' */
     int sizelocvars;
     int linedefined;
     int lastlinedefined;
+    size_t sizeowned; /* size accounted to the taint of the function */
     GCObject *gclist;
     lu_byte nups; /* number of upvalues */
     lu_byte numparams;
@@ -195,7 +270,6 @@ typedef struct UpVal {
     CommonHeader;                                                                                                      \
     lu_byte isC;                                                                                                       \
     lu_byte nupvalues;                                                                                                 \
-    uint_least32_t nopencalls;                                                                                         \
     GCObject *gclist;                                                                                                  \
     struct Table *env;                                                                                                 \
     struct ClosureStats *stats
@@ -204,6 +278,8 @@ typedef struct ClosureStats {
     uint_least32_t calls; /* number of calls */
     lua_Clock ownticks; /* ticks spent executing this closure */
     lua_Clock subticks; /* as above but including calls to subroutines */
+    uint_least32_t epoch; /* stats epoch of the counters */
+    uint_least32_t nopencalls; /* number of profiled calls still running */
 } ClosureStats;
 
 typedef struct CClosure {
@@ -9,11 +9,15 @@
 /* ORDER OP */
 
 const char *const luaP_opnames[NUM_OPCODES + 1] = {
-    "MOVE",     "LOADK",    "LOADBOOL", "LOADNIL", "GETUPVAL", "GETGLOBAL", "GETTABLE", "SETGLOBAL",
-    "SETUPVAL", "SETTABLE", "NEWTABLE", "SELF",    "ADD",      "SUB",       "MUL",      "DIV",
-    "MOD",      "POW",      "UNM",      "NOT",     "LEN",      "CONCAT",    "JMP",      "EQ",
-    "LT",       "LE",       "TEST",     "TESTSET", "CALL",     "TAILCALL",  "RETURN",   "FORLOOP",
-    "FORPREP",  "TFORLOOP", "SETLIST",  "CLOSE",   "CLOSURE",  "VARARG",    NULL,
+    "MOVE",           "LOADK",          "LOADBOOL",       "LOADNIL",        "GETUPVAL",       "GETGLOBAL",
+    "GETTABLE",       "SETGLOBAL",      "SETUPVAL",       "SETTABLE",       "NEWTABLE",       "SELF",
+    "ADD",            "SUB",            "MUL",            "DIV",            "MOD",            "POW",
+    "UNM",            "NOT",            "LEN",            "CONCAT",         "JMP",            "EQ",
+    "LT",             "LE",             "TEST",           "TESTSET",        "CALL",           "TAILCALL",
+    "RETURN",         "FORLOOP",        "FORPREP",        "TFORLOOP",       "SETLIST",        "CLOSE",
+    "CLOSURE",        "VARARG",         "GETGLOBALTABLE", "GETGLOBALCALL",  "GETTABLETEST",   "SELFCALL",
+    "LOADKCALL",      "ADDNN",          "SUBNN",          "MULNN",          "DIVNN",          "MODNN",
+    "POWNN",          "UNMN",           "EQNUM",          "LTNUM",          "LENUM",          NULL,
 };
 
 #define opmode(t, a, b, c, m) (((t) << 7) | ((a) << 6) | ((b) << 4) | ((c) << 2) | (m))
@@ -58,4 +62,82 @@ const lu_byte luaP_opmodes[NUM_OPCODES] = {
     opmode(0, 0, OpArgN, OpArgN, iABC), /* OP_CLOSE */
     opmode(0, 1, OpArgU, OpArgN, iABx), /* OP_CLOSURE */
     opmode(0, 1, OpArgU, OpArgN, iABC), /* OP_VARARG */
+    opmode(0, 1, OpArgK, OpArgN, iABx), /* OP_GETGLOBALTABLE */
+    opmode(0, 1, OpArgK, OpArgN, iABx), /* OP_GETGLOBALCALL */
+    opmode(0, 1, OpArgR, OpArgK, iABC), /* OP_GETTABLETEST */
+    opmode(0, 1, OpArgR, OpArgK, iABC), /* OP_SELFCALL */
+    opmode(0, 1, OpArgK, OpArgN, iABx), /* OP_LOADKCALL */
+    opmode(0, 1, OpArgK, OpArgK, iABC), /* OP_ADDNN */
+    opmode(0, 1, OpArgK, OpArgK, iABC), /* OP_SUBNN */
+    opmode(0, 1, OpArgK, OpArgK, iABC), /* OP_MULNN */
+    opmode(0, 1, OpArgK, OpArgK, iABC), /* OP_DIVNN */
+    opmode(0, 1, OpArgK, OpArgK, iABC), /* OP_MODNN */
+    opmode(0, 1, OpArgK, OpArgK, iABC), /* OP_POWNN */
+    opmode(0, 1, OpArgR, OpArgN, iABC), /* OP_UNMN */
+    opmode(1, 0, OpArgK, OpArgK, iABC), /* OP_EQNUM */
+    opmode(1, 0, OpArgK, OpArgK, iABC), /* OP_LTNUM */
+    opmode(1, 0, OpArgK, OpArgK, iABC), /* OP_LENUM */
 };
+
+const lu_byte luaP_opgeneric[NUM_OPCODES] = {
+    OP_MOVE,      OP_LOADK,     OP_LOADBOOL,  OP_LOADNIL,   OP_GETUPVAL,  OP_GETGLOBAL, OP_GETTABLE,  OP_SETGLOBAL,
+    OP_SETUPVAL,  OP_SETTABLE,  OP_NEWTABLE,  OP_SELF,      OP_ADD,       OP_SUB,       OP_MUL,       OP_DIV,
+    OP_MOD,       OP_POW,       OP_UNM,       OP_NOT,       OP_LEN,       OP_CONCAT,    OP_JMP,       OP_EQ,
+    OP_LT,        OP_LE,        OP_TEST,      OP_TESTSET,   OP_CALL,      OP_TAILCALL,  OP_RETURN,    OP_FORLOOP,
+    OP_FORPREP,   OP_TFORLOOP,  OP_SETLIST,   OP_CLOSE,     OP_CLOSURE,   OP_VARARG,    OP_GETGLOBAL, OP_GETGLOBAL,
+    OP_GETTABLE,  OP_SELF,      OP_LOADK,     OP_ADD,       OP_SUB,       OP_MUL,       OP_DIV,       OP_MOD,
+    OP_POW,       OP_UNM,       OP_EQ,        OP_LT,        OP_LE,
+};
+
+/*
+** the superinstruction for a pair of instructions, or the opcode of the first
+** instruction if the pair has none; `next' may already be a superinstruction
+*/
+OpCode luaP_fusedop (Instruction i, Instruction next) {
+    OpCode op = GET_OPCODE(i);
+    OpCode nextop = GET_GENERICOP(next);
+    int a = GETARG_A(i);
+    switch (op) {
+        case OP_GETGLOBAL: {
+            if (nextop == OP_GETTABLE && GETARG_B(next) == a) {
+                return OP_GETGLOBALTABLE;
+            } else if (nextop == OP_CALL && GETARG_A(next) == a && GETARG_B(next) == 1) {
+                return OP_GETGLOBALCALL;
+            }
+            break;
+        }
+        case OP_GETTABLE: {
+            if (nextop == OP_TEST && GETARG_A(next) == a) {
+                return OP_GETTABLETEST;
+            }
+            break;
+        }
+        case OP_SELF: {
+            if (nextop == OP_CALL && GETARG_A(next) == a && GETARG_B(next) == 2) {
+                return OP_SELFCALL;
+            }
+            break;
+        }
+        case OP_LOADK: {
+            if (nextop == OP_CALL && GETARG_B(next) != 0 && GETARG_A(next) + GETARG_B(next) - 1 == a) {
+                return OP_LOADKCALL;
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+    return op;
+}
+
+/*
+** replace common pairs of instructions with superinstructions; `code' must be
+** the complete code of a function
+*/
+void luaP_fuse (Instruction *code, int n) {
+    int pc;
+    for (pc = n - 2; pc >= 0; pc--) { /* backwards, so `next' is final */
+        SET_OPCODE(code[pc], luaP_fusedop(code[pc], code[pc + 1]));
+    }
+}
@@ -170,11 +170,33 @@ typedef enum {
     OP_SETLIST,     /*  A B C               R(A)[(C-1)*FPF+i] := R(A+i), 1 <= i <= B            */
     OP_CLOSE,       /*  A                   close all variables in the stack up to (>=) R(A)    */
     OP_CLOSURE,     /*  A Bx                R(A) := closure(KPROTO[Bx], R(A), ... ,R(A+n))      */
-    OP_VARARG       /*  A B                 R(A), R(A+1), ..., R(A+B-1) = vararg                */
+    OP_VARARG,      /*  A B                 R(A), R(A+1), ..., R(A+B-1) = vararg                */
+
+    /* superinstructions; see note below */
+    OP_GETGLOBALTABLE, /*  A Bx             OP_GETGLOBAL then OP_GETTABLE with B == A           */
+    OP_GETGLOBALCALL, /*  A Bx              OP_GETGLOBAL then OP_CALL with the same A, B == 1   */
+    OP_GETTABLETEST, /*  A B C              OP_GETTABLE then OP_TEST with the same A            */
+    OP_SELFCALL,    /*  A B C               OP_SELF then OP_CALL with the same A, B == 2        */
+    OP_LOADKCALL,   /*  A Bx                OP_LOADK then OP_CALL with A as its last argument   */
+
+    /* specialized variants; see note below */
+    OP_ADDNN,       /*  A B C               R(A) := RK(B) + RK(C)               (numbers)       */
+    OP_SUBNN,       /*  A B C               R(A) := RK(B) - RK(C)               (numbers)       */
+    OP_MULNN,       /*  A B C               R(A) := RK(B) * RK(C)               (numbers)       */
+    OP_DIVNN,       /*  A B C               R(A) := RK(B) / RK(C)               (numbers)       */
+    OP_MODNN,       /*  A B C               R(A) := RK(B) % RK(C)               (numbers)       */
+    OP_POWNN,       /*  A B C               R(A) := RK(B) ^ RK(C)               (numbers)       */
+    OP_UNMN,        /*  A B                 R(A) := -R(B)                       (number)        */
+    OP_EQNUM,       /*  A B C               if ((RK(B) == RK(C)) ~= A) then pc++ (numbers)      */
+    OP_LTNUM,       /*  A B C               if ((RK(B) <  RK(C)) ~= A) then pc++ (numbers)      */
+    OP_LENUM        /*  A B C               if ((RK(B) <= RK(C)) ~= A) then pc++ (numbers)      */
     /* clang-format on */
 } OpCode;
 
-#define NUM_OPCODES (cast(int, OP_VARARG) + 1)
+#define NUM_OPCODES (cast(int, OP_LENUM) + 1)
+
+/* the generic opcode of a specialized instruction, or of the first part of a superinstruction */
+#define GET_GENERICOP(i) (cast(OpCode, luaP_opgeneric[GET_OPCODE(i)]))
 
 /*===========================================================================
   Notes:
@@ -194,6 +216,20 @@ typedef enum {
       (true or false).
 
   (*) All `skips' (pc++) assume that next instruction is a jump
+
+  (*) Superinstructions are generated once the code of a function is
+      complete, by replacing the opcode of the first instruction of a
+      common pair. The second instruction is kept in place and is skipped
+      by the superinstruction after it has executed both, so jumps to it
+      and its line information are unaffected. They are replaced with the
+      opcode of their first part when dumping a function.
+
+  (*) Specialized variants are never generated by the compiler. The VM
+      rewrites a generic instruction in place to its variant once it sees
+      number operands, and back again if that no longer holds. They are
+      replaced with their generic opcode when dumping a function. The
+      comparisons are suffixed NUM rather than NN, as OP_LENN would read
+      as a variant of OP_LEN.
 ===========================================================================*/
 
 /*
@@ -220,6 +256,11 @@ LUAI_DATA const lu_byte luaP_opmodes[NUM_OPCODES];
 #define testAMode(m) (luaP_opmodes[m] & (1 << 6))
 #define testTMode(m) (luaP_opmodes[m] & (1 << 7))
 
+LUAI_DATA const lu_byte luaP_opgeneric[NUM_OPCODES];
+
+LUAI_FUNC OpCode luaP_fusedop (Instruction i, Instruction next);
+LUAI_FUNC void luaP_fuse (Instruction *code, int n);
+
 LUAI_DATA const char *const luaP_opnames[NUM_OPCODES + 1]; /* opcode names */
 
 /* number of list items to accumulate before a SETLIST instruction */
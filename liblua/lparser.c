@@ -355,6 +355,12 @@ static void close_func (LexState *ls) {
     f->sizelocvars = fs->nlocvars;
     luaM_reallocvector(L, f->upvalues, f->sizeupvalues, f->nups, TString *);
     f->sizeupvalues = f->nups;
+    luaP_fuse(f->code, f->sizecode);
+    luaF_newicache(L, f);
+#if defined(LUA_USE_PREDECODE)
+    luaF_predecode(L, f);
+#endif
+    luaF_accountproto(L, f);
     lua_assert(luaG_checkcode(f));
     lua_assert(fs->bl == NULL);
     ls->fs = fs->prev;
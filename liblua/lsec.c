@@ -1,21 +1,85 @@
 /* Licensed under the terms of the MIT License; see full copyright information
  * in the "LICENSE" file or at <http://www.lua.org/license.html> */
 
+#include <string.h>
+
 #define lsec_c
 #define LUA_CORE
 
+#include "lmem.h"
 #include "lsec.h"
+#include "lstring.h"
 
+extern TString *luaR_gettaintname (global_State *g, TaintRef taint);
+extern TaintRef luaR_gettaintref (const TString *name);
+extern SourceStats *luaR_getsourcestats (global_State *g, TaintRef taint);
+extern TaintRef luaR_getstacktaint (lua_State *L);
+extern TaintRef luaR_getnewgctaint (lua_State *L);
+extern TaintRef luaR_getnewcltaint (lua_State *L);
+extern TaintRef luaR_getfixedtaint (lua_State *L);
+extern void luaR_setfixedtaint (lua_State *L, TaintRef taint);
+extern TaintRef luaR_getcalltaint (const CallInfo *ci);
+extern void luaR_setcalltaint (CallInfo *ci, TaintRef taint);
+extern TaintRef luaR_getvaluetaint (const TValue *o);
+extern void luaR_setvaluetaint (TValue *o, TaintRef taint);
+extern TaintRef luaR_getobjecttaint (const GCObject *o);
+extern void luaR_initobjecttaint (GCObject *o);
+extern void luaR_initthreadtaint (lua_State *L);
 extern lu_byte luaR_gettaintmode (lua_State *L);
 extern void luaR_settaintmode (lua_State *L, lu_byte mode);
-extern void luaR_setstacktaint (lua_State *L, TString *taint);
-extern void luaR_setnewgctaint (lua_State *L, TString *taint);
-extern void luaR_setnewcltaint (lua_State *L, TString *taint);
-extern void luaR_setobjecttaint (lua_State *L, GCObject *o, TString *taint);
-extern void luaR_taintstack (lua_State *L, TString *taint);
+extern void luaR_setstacktaint (lua_State *L, TaintRef taint);
+extern void luaR_setnewgctaint (lua_State *L, TaintRef taint);
+extern void luaR_setnewcltaint (lua_State *L, TaintRef taint);
+extern void luaR_setobjecttaint (lua_State *L, GCObject *o, TaintRef taint);
+extern void luaR_taintstack (lua_State *L, TaintRef taint);
+extern TaintRef luaR_getwritetaint (lua_State *L, lu_byte mode);
+extern void luaR_taintstackm (lua_State *L, TaintRef taint, lu_byte mode);
+extern void luaR_initvaluetaint (lua_State *L, TValue *o);
+extern void luaR_initvaluetaintm (lua_State *L, TValue *o, lu_byte mode);
+extern void luaR_copyvaluetaint (lua_State *L, TValue *dst, const TValue *src);
+extern void luaR_copyvaluetaintm (lua_State *L, TValue *dst, const TValue *src, lu_byte mode);
 extern void luaR_taintvalue (lua_State *L, TValue *o);
 extern void luaR_taintobject (lua_State *L, GCObject *o);
 extern void luaR_taintalloc (lua_State *L, GCObject *o);
 extern void luaR_taintthread (lua_State *L, lua_State *from);
+extern void luaR_resizeowned (lua_State *L, const GCObject *o, size_t oldsize, size_t newsize);
 extern void luaR_savetaint (lua_State *L, struct TaintState *ts);
 extern void luaR_loadtaint (lua_State *L, const struct TaintState *ts);
+
+#if defined(LUA_USE_TAINT)
+
+TaintRef luaR_newtaint (lua_State *L, const char *name) {
+    global_State *g = G(L);
+    TString *ts;
+
+    if (name == NULL) {
+        return 0;
+    }
+
+    ts = luaS_new(L, name);
+
+    if (ts->tsv.taintref == 0) {
+        SourceStats *st;
+        luaM_growvector(L, g->taints, g->ntaints, g->sizetaints, SourceStats *, LUA_INT_MAX, "too many taints");
+        st = luaM_new(L, SourceStats);
+        st->owner = ts;
+        st->execticks = 0;
+        st->bytesowned = 0;
+        st->epoch = g->statsepoch;
+        luaS_fix(ts); /* taint names are never collected */
+        g->taints[g->ntaints++] = st;
+        ts->tsv.taintref = cast(TaintRef, g->ntaints);
+    }
+
+    return ts->tsv.taintref;
+}
+
+#else
+
+TaintRef luaR_newtaint (lua_State *L, const char *name) {
+    lua_unused(L);
+    lua_unused(name);
+    return 0;
+}
+
+#endif
@@ -4,6 +4,8 @@
 #ifndef lsec_h
 #define lsec_h
 
+#include "ldebug.h"
+#include "lgc.h"
 #include "lobject.h"
 #include "lstate.h"
 
@@ -16,70 +18,202 @@ enum TaintFlags {
 
 struct TaintState {
     lu_byte mode;
-    TString *stacktaint;
-    TString *newgctaint;
-    TString *newcltaint;
+    TaintRef stacktaint;
+    TaintRef newgctaint;
+    TaintRef newcltaint;
 };
 
+/*
+** Taint registry
+**
+** Taints are referenced from values, objects and threads by a TaintRef which
+** indexes the registry of taint names held by the global state. Taint names
+** are fixed strings and are never collected, so a reference once issued
+** remains valid for the lifetime of the state.
+*/
+
+LUAI_FUNC TaintRef luaR_newtaint (lua_State *L, const char *name);
+
+#if defined(LUA_USE_TAINT)
+
+inline TString *luaR_gettaintname (global_State *g, TaintRef taint) {
+    return (taint != 0) ? g->taints[taint - 1]->owner : NULL;
+}
+
+inline TaintRef luaR_gettaintref (const TString *name) {
+    return name->tsv.taintref;
+}
+
+inline SourceStats *luaR_getsourcestats (global_State *g, TaintRef taint) {
+    return (taint != 0) ? g->taints[taint - 1] : &g->securestats;
+}
+
+inline TaintRef luaR_getstacktaint (lua_State *L) {
+    return L->stacktaint;
+}
+
+inline TaintRef luaR_getnewgctaint (lua_State *L) {
+    return L->newgctaint;
+}
+
+inline TaintRef luaR_getnewcltaint (lua_State *L) {
+    return L->newcltaint;
+}
+
+inline TaintRef luaR_getfixedtaint (lua_State *L) {
+    return L->fixedtaint;
+}
+
+inline void luaR_setfixedtaint (lua_State *L, TaintRef taint) {
+    L->fixedtaint = taint;
+}
+
+inline TaintRef luaR_getcalltaint (const CallInfo *ci) {
+    return ci->savedtaint;
+}
+
+inline void luaR_setcalltaint (CallInfo *ci, TaintRef taint) {
+    ci->savedtaint = taint;
+}
+
+inline TaintRef luaR_getvaluetaint (const TValue *o) {
+    return o->taint;
+}
+
+inline void luaR_setvaluetaint (TValue *o, TaintRef taint) {
+    o->taint = taint;
+}
+
+inline TaintRef luaR_getobjecttaint (const GCObject *o) {
+    return o->gch.taint;
+}
+
+inline void luaR_initobjecttaint (GCObject *o) {
+    o->gch.taint = 0;
+}
+
+inline void luaR_initthreadtaint (lua_State *L) {
+    L->taintflags = 0;
+    L->stacktaint = 0;
+    L->writetaint = 0;
+    L->fixedtaint = 0;
+    L->newgctaint = 0;
+    L->newcltaint = 0;
+}
+
 inline lu_byte luaR_gettaintmode (lua_State *L) {
     return (L->taintflags & LUA_TAINTMASK_MODE);
 }
 
 inline void luaR_settaintmode (lua_State *L, lu_byte mode) {
+    lu_byte oldmode = luaR_gettaintmode(L);
+
     L->taintflags = (mode & LUA_TAINTMASK_MODE) | (L->taintflags & ~LUA_TAINTMASK_MODE);
-    L->writetaint = (L->taintflags & LUA_TAINTFLAG_WR) ? L->stacktaint : NULL;
+    L->writetaint = (L->taintflags & LUA_TAINTFLAG_WR) ? L->stacktaint : 0;
+
+    if (luaR_gettaintmode(L) != oldmode) { /* running VM instance must switch */
+        luai_atomicor(&G(L)->interrupt, LUAI_INTERRUPTRESELECT);
+    }
 }
 
-inline void luaR_setstacktaint (lua_State *L, TString *taint) {
+inline void luaR_setstacktaint (lua_State *L, TaintRef taint) {
+    if (L->stacktaint != taint) {
+        luaG_trace(L, TRACE_TAINT, NULL, cast_int(taint));
+    }
+
     L->stacktaint = taint;
-    L->writetaint = (L->taintflags & LUA_TAINTFLAG_WR) ? taint : NULL;
+    L->writetaint = (L->taintflags & LUA_TAINTFLAG_WR) ? taint : 0;
 }
 
-inline void luaR_setnewgctaint (lua_State *L, TString *taint) {
+inline void luaR_setnewgctaint (lua_State *L, TaintRef taint) {
     L->newgctaint = taint;
 }
 
-inline void luaR_setnewcltaint (lua_State *L, TString *taint) {
+inline void luaR_setnewcltaint (lua_State *L, TaintRef taint) {
     L->newcltaint = taint;
 }
 
-inline void luaR_setobjecttaint (lua_State *L, GCObject *o, TString *taint) {
-    lua_unused(L);
-    o->gch.taint = taint;
+inline void luaR_setobjecttaint (lua_State *L, GCObject *o, TaintRef taint) {
+    if (o->gch.taint != taint) { /* move the object's size to its new owner */
+        size_t size = luaC_ownedsize(o);
+        luaR_getsourcestats(G(L), o->gch.taint)->bytesowned -= size;
+        luaR_getsourcestats(G(L), taint)->bytesowned += size;
+        o->gch.taint = taint;
+    }
 }
 
-inline void luaR_taintstack (lua_State *L, TString *taint) {
-    if (taint != NULL && L->fixedtaint == NULL && (L->taintflags & LUA_TAINTFLAG_RD)) {
+inline void luaR_taintstack (lua_State *L, TaintRef taint) {
+    if (taint != 0 && L->fixedtaint == 0 && (L->taintflags & LUA_TAINTFLAG_RD)) {
         luaR_setstacktaint(L, taint);
     }
 }
 
+inline TaintRef luaR_getwritetaint (lua_State *L, lu_byte mode) {
+    return (mode & LUA_TAINTFLAG_WR) ? L->writetaint : 0;
+}
+
+inline void luaR_taintstackm (lua_State *L, TaintRef taint, lu_byte mode) {
+    if (mode & LUA_TAINTFLAG_RD) {
+        luaR_taintstack(L, taint);
+    }
+}
+
+/* set the taint of a value written to the stack */
+inline void luaR_initvaluetaint (lua_State *L, TValue *o) {
+    o->taint = L->writetaint;
+}
+
+inline void luaR_initvaluetaintm (lua_State *L, TValue *o, lu_byte mode) {
+    o->taint = luaR_getwritetaint(L, mode);
+}
+
+/* copy the taint of a value read into the stack, propagating it to the stack */
+inline void luaR_copyvaluetaint (lua_State *L, TValue *dst, const TValue *src) {
+    dst->taint = src->taint;
+
+    if (dst->taint == 0) {
+        dst->taint = L->writetaint;
+    } else {
+        luaR_taintstack(L, src->taint);
+    }
+}
+
+inline void luaR_copyvaluetaintm (lua_State *L, TValue *dst, const TValue *src, lu_byte mode) {
+    dst->taint = src->taint;
+
+    if (dst->taint == 0) {
+        dst->taint = luaR_getwritetaint(L, mode);
+    } else {
+        luaR_taintstackm(L, src->taint, mode);
+    }
+}
+
 inline void luaR_taintvalue (lua_State *L, TValue *o) {
-    TString *taint = L->writetaint;
+    TaintRef taint = L->writetaint;
 
-    if (taint != NULL) {
+    if (taint != 0) {
         o->taint = taint;
     }
 }
 
 inline void luaR_taintobject (lua_State *L, GCObject *o) {
-    TString *taint = L->writetaint;
+    TaintRef taint = L->writetaint;
 
-    if (taint != NULL) {
+    if (taint != 0) {
         luaR_setobjecttaint(L, o, taint);
     }
 }
 
 inline void luaR_taintalloc (lua_State *L, GCObject *o) {
-    TString *taint = NULL;
+    TaintRef taint = 0;
 
     lua_assert(iscollectable(&o->gch));
 
-    if (L->newgctaint != NULL) {
+    if (L->newgctaint != 0) {
         taint = L->newgctaint;
-    } else if (L->writetaint != NULL) {
+    } else if (L->writetaint != 0) {
         taint = L->writetaint;
-    } else if (L->newcltaint != NULL && ttisfunction(&o->gch)) {
+    } else if (L->newcltaint != 0 && ttisfunction(&o->gch)) {
         taint = L->newcltaint;
     }
 
@@ -87,8 +221,8 @@ inline void luaR_taintalloc (lua_State *L, GCObject *o) {
 }
 
 inline void luaR_taintthread (lua_State *L, lua_State *from) {
-    lua_assert(from->fixedtaint == NULL);
-    lua_assert(L->fixedtaint == NULL);
+    lua_assert(from->fixedtaint == 0);
+    lua_assert(L->fixedtaint == 0);
 
     luaR_settaintmode(L, luaR_gettaintmode(from));
     luaR_setstacktaint(L, from->stacktaint);
@@ -110,4 +244,208 @@ inline void luaR_loadtaint (lua_State *L, const struct TaintState *ts) {
     luaR_setnewcltaint(L, ts->newcltaint);
 }
 
+#else
+
+/*
+** Taint-free build
+**
+** Values, objects and threads carry no taint. The functions below keep the
+** same signatures as above so that callers need no conditional code; all of
+** them report an untainted state and discard any taint given to them.
+*/
+
+inline TString *luaR_gettaintname (global_State *g, TaintRef taint) {
+    lua_unused(g);
+    lua_unused(taint);
+    return NULL;
+}
+
+inline TaintRef luaR_gettaintref (const TString *name) {
+    lua_unused(name);
+    return 0;
+}
+
+inline SourceStats *luaR_getsourcestats (global_State *g, TaintRef taint) {
+    lua_unused(taint);
+    return &g->securestats;
+}
+
+inline TaintRef luaR_getstacktaint (lua_State *L) {
+    lua_unused(L);
+    return 0;
+}
+
+inline TaintRef luaR_getnewgctaint (lua_State *L) {
+    lua_unused(L);
+    return 0;
+}
+
+inline TaintRef luaR_getnewcltaint (lua_State *L) {
+    lua_unused(L);
+    return 0;
+}
+
+inline TaintRef luaR_getfixedtaint (lua_State *L) {
+    lua_unused(L);
+    return 0;
+}
+
+inline void luaR_setfixedtaint (lua_State *L, TaintRef taint) {
+    lua_unused(L);
+    lua_unused(taint);
+}
+
+inline TaintRef luaR_getcalltaint (const CallInfo *ci) {
+    lua_unused(ci);
+    return 0;
+}
+
+inline void luaR_setcalltaint (CallInfo *ci, TaintRef taint) {
+    lua_unused(ci);
+    lua_unused(taint);
+}
+
+inline TaintRef luaR_getvaluetaint (const TValue *o) {
+    lua_unused(o);
+    return 0;
+}
+
+inline void luaR_setvaluetaint (TValue *o, TaintRef taint) {
+    lua_unused(o);
+    lua_unused(taint);
+}
+
+inline TaintRef luaR_getobjecttaint (const GCObject *o) {
+    lua_unused(o);
+    return 0;
+}
+
+inline void luaR_initobjecttaint (GCObject *o) {
+    lua_unused(o);
+}
+
+inline void luaR_initthreadtaint (lua_State *L) {
+    lua_unused(L);
+}
+
+inline lu_byte luaR_gettaintmode (lua_State *L) {
+    lua_unused(L);
+    return LUA_TAINTDISABLED;
+}
+
+inline void luaR_settaintmode (lua_State *L, lu_byte mode) {
+    lua_unused(L);
+    lua_unused(mode);
+}
+
+inline void luaR_setstacktaint (lua_State *L, TaintRef taint) {
+    lua_unused(L);
+    lua_unused(taint);
+}
+
+inline void luaR_setnewgctaint (lua_State *L, TaintRef taint) {
+    lua_unused(L);
+    lua_unused(taint);
+}
+
+inline void luaR_setnewcltaint (lua_State *L, TaintRef taint) {
+    lua_unused(L);
+    lua_unused(taint);
+}
+
+inline void luaR_setobjecttaint (lua_State *L, GCObject *o, TaintRef taint) {
+    lua_unused(L);
+    lua_unused(o);
+    lua_unused(taint);
+}
+
+inline void luaR_taintstack (lua_State *L, TaintRef taint) {
+    lua_unused(L);
+    lua_unused(taint);
+}
+
+inline TaintRef luaR_getwritetaint (lua_State *L, lu_byte mode) {
+    lua_unused(L);
+    lua_unused(mode);
+    return 0;
+}
+
+inline void luaR_taintstackm (lua_State *L, TaintRef taint, lu_byte mode) {
+    lua_unused(L);
+    lua_unused(taint);
+    lua_unused(mode);
+}
+
+inline void luaR_initvaluetaint (lua_State *L, TValue *o) {
+    lua_unused(L);
+    lua_unused(o);
+}
+
+inline void luaR_initvaluetaintm (lua_State *L, TValue *o, lu_byte mode) {
+    lua_unused(L);
+    lua_unused(o);
+    lua_unused(mode);
+}
+
+inline void luaR_copyvaluetaint (lua_State *L, TValue *dst, const TValue *src) {
+    lua_unused(L);
+    lua_unused(dst);
+    lua_unused(src);
+}
+
+inline void luaR_copyvaluetaintm (lua_State *L, TValue *dst, const TValue *src, lu_byte mode) {
+    lua_unused(L);
+    lua_unused(dst);
+    lua_unused(src);
+    lua_unused(mode);
+}
+
+inline void luaR_taintvalue (lua_State *L, TValue *o) {
+    lua_unused(L);
+    lua_unused(o);
+}
+
+inline void luaR_taintobject (lua_State *L, GCObject *o) {
+    lua_unused(L);
+    lua_unused(o);
+}
+
+inline void luaR_taintalloc (lua_State *L, GCObject *o) {
+    lua_unused(L);
+    lua_unused(o);
+}
+
+inline void luaR_taintthread (lua_State *L, lua_State *from) {
+    lua_unused(L);
+    lua_unused(from);
+}
+
+inline void luaR_savetaint (lua_State *L, struct TaintState *ts) {
+    lua_unused(L);
+    ts->mode = LUA_TAINTDISABLED;
+    ts->stacktaint = 0;
+    ts->newgctaint = 0;
+    ts->newcltaint = 0;
+}
+
+inline void luaR_loadtaint (lua_State *L, const struct TaintState *ts) {
+    lua_unused(L);
+    lua_unused(ts);
+}
+
+#endif /* LUA_USE_TAINT */
+
+/*
+** Memory ownership
+**
+** Objects are owned by their taint. The total size of the objects owned by
+** each taint is adjusted as objects are created, resized, freed and assigned
+** a new taint, so that it can be read at any time without visiting the heap.
+*/
+
+inline void luaR_resizeowned (lua_State *L, const GCObject *o, size_t oldsize, size_t newsize) {
+    SourceStats *st = luaR_getsourcestats(G(L), luaR_getobjecttaint(o));
+    st->bytesowned = (st->bytesowned - oldsize) + newsize;
+}
+
 #endif
@@ -35,20 +35,23 @@ typedef struct LG {
 static void stack_init (lua_State *L1, lua_State *L) {
     /* initialize CallInfo array */
     L1->base_ci = luaM_newvector(L, BASIC_CI_SIZE, CallInfo);
+    luaR_resizeowned(L1, obj2gco(L1), 0, sizeof(CallInfo) * BASIC_CI_SIZE);
     L1->ci = L1->base_ci;
     L1->size_ci = BASIC_CI_SIZE;
     L1->end_ci = L1->base_ci + L1->size_ci - 1;
     /* initialize stack array */
     L1->stack = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, TValue);
+    luaR_resizeowned(L1, obj2gco(L1), 0, sizeof(TValue) * (BASIC_STACK_SIZE + EXTRA_STACK));
     L1->stacksize = BASIC_STACK_SIZE + EXTRA_STACK;
     L1->top = L1->stack;
     L1->stack_last = L1->stack + (L1->stacksize - EXTRA_STACK) - 1;
     /* initialize first ci */
     L1->ci->func = L1->top;
+    L1->ci->stats = NULL;
     setnilvalue(L1, L1->top++); /* `function' entry for this `ci' */
     L1->base = L1->ci->base = L1->top;
     L1->ci->top = L1->top + LUA_MINSTACK;
-    L1->ci->savedtaint = NULL;
+    luaR_setcalltaint(L1->ci, 0);
 }
 
 static void freestack (lua_State *L, lua_State *L1) {
@@ -106,33 +109,39 @@ static void preinit_state (lua_State *L, global_State *g) {
     L->base_ci = L->ci = NULL;
     L->savedpc = NULL;
     L->errfunc = 0;
-    L->taintflags = 0;
-    L->stacktaint = NULL;
-    L->writetaint = NULL;
-    L->fixedtaint = NULL;
-    L->newgctaint = NULL;
-    L->newcltaint = NULL;
+    luaR_initthreadtaint(L);
     setnilvalue(L, gt(L));
 }
 
-static void freesourcestats (global_State *g) {
-    SourceStats *st;
+#if defined(LUA_USE_TAINT)
+static void freetaints (global_State *g) {
+    int i;
 
-    for (st = g->sourcestats; st != NULL; st = g->sourcestats) {
-        g->sourcestats = st->next;
-        luaM_free(g->mainthread, st);
+    for (i = 0; i < g->ntaints; i++) {
+        luaM_free(g->mainthread, g->taints[i]);
     }
+
+    luaM_freearray(g->mainthread, g->taints, g->sizetaints, SourceStats *);
 }
+#endif
 
 static void close_state (lua_State *L) {
     global_State *g = G(L);
+    luaG_freesampler(L); /* stop sampling before its stacks are collected */
+    luaG_freeallocsampler(L);
+    luaG_freetracer(L);
+    luaG_freestats(L);
     luaF_close(L, L->stack); /* close all upvalues for this thread */
     luaC_freeall(L); /* collect all objects */
     lua_assert(g->rootgc == obj2gco(L));
     lua_assert(g->strt.nuse == 0);
-    freesourcestats(g);
-    lua_assert(g->sourcestats == NULL);
     luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size, TString *);
+    luaM_freearray(L, G(L)->strt.young, sizeyoungmap(G(L)->strt.size), uint_least32_t);
+    luaM_freearray(L, G(L)->strt.oldhash, G(L)->strt.oldsize, TString *);
+    luaM_freearray(L, G(L)->strt.oldyoung, sizeyoungmap(G(L)->strt.oldsize), uint_least32_t);
+#if defined(LUA_USE_TAINT)
+    freetaints(g);
+#endif
     luaZ_freebuffer(L, &g->buff);
     freestack(L, L);
     lua_assert(g->totalbytes == sizeof(LG));
@@ -143,6 +152,7 @@ lua_State *luaE_newthread (lua_State *L) {
     lua_State *L1 = tostate(luaM_malloc(L, state_size(lua_State)));
     luaC_link(L, obj2gco(L1), LUA_TTHREAD);
     preinit_state(L1, G(L));
+    luaR_resizeowned(L1, obj2gco(L1), 0, sizeof(lua_State));
     stack_init(L1, L); /* init stack */
     setobj2n(L, gt(L1), gt(L)); /* share table of globals */
     L1->compatmask = L->compatmask;
@@ -151,6 +161,7 @@ lua_State *luaE_newthread (lua_State *L) {
     L1->basehookcount = L->basehookcount;
     L1->baseexeclimit = L->baseexeclimit;
     L1->baseexeccount = L->baseexeccount;
+    L1->execcount = L->baseexeccount;
     L1->hook = L->hook;
     luaR_taintthread(L1, L);
     resethookcount(L1);
@@ -177,15 +188,26 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
     L = tostate(l);
     g = &((LG *) L)->g;
     L->next = NULL;
-    L->taint = NULL;
+    luaR_initobjecttaint(obj2gco(L));
     L->tt = LUA_TTHREAD;
     g->enablestats = 0;
+    g->enablelinestats = 0;
+    g->enableclosurestats = 0;
+    g->enablecallgraph = 0;
+    g->lineticks = 0;
+    g->linecount = LUAI_LINESAMPLE;
+    g->statsepoch = 0;
+    g->cfuncstats = NULL;
+    g->ncfuncstats = 0;
+    g->sizecfuncstats = 0;
+    g->callgraph = NULL;
     g->currentwhite = bit2mask(WHITE0BIT, FIXEDBIT);
     L->marked = luaC_white(g);
     set2bits(L->marked, FIXEDBIT, SFIXEDBIT);
     preinit_state(L, g);
     g->frealloc = f;
     g->ud = ud;
+    g->pool = NULL;
     g->mainthread = L;
     g->uvhead.u.l.prev = &g->uvhead;
     g->uvhead.u.l.next = &g->uvhead;
@@ -193,11 +215,19 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
     g->strt.size = 0;
     g->strt.nuse = 0;
     g->strt.hash = NULL;
+    g->strt.young = NULL;
+    g->strt.oldhash = NULL;
+    g->strt.oldyoung = NULL;
+    g->strt.oldsize = 0;
+    g->strt.rehashpos = 0;
     setnilvalue(L, registry(L));
     setnilvalue(L, &g->l_errfunc);
     luaZ_initbuffer(L, &g->buff);
     g->panic = NULL;
     g->gcstate = GCSpause;
+    g->gckind = KGC_INC;
+    g->interrupt = 0;
+    g->jitbudget = 0;
     g->rootgc = obj2gco(L);
     g->sweepstrgc = 0;
     g->sweepgc = &g->rootgc;
@@ -208,10 +238,24 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
     g->totalbytes = sizeof(LG);
     g->gcpause = LUAI_GCPAUSE;
     g->gcstepmul = LUAI_GCMUL;
+    g->genminormul = LUAI_GENMINORMUL;
+    g->genmajormul = LUAI_GENMAJORMUL;
+    g->gcmarkthreads = 0;
     g->gcdept = 0;
     luaG_init(g);
     g->bytesallocated = g->totalbytes;
-    g->sourcestats = NULL;
+    g->securestats.owner = NULL;
+    g->securestats.execticks = 0;
+    g->securestats.bytesowned = sizeof(lua_State); /* main thread */
+    g->securestats.epoch = 0;
+    g->sampler = NULL;
+    g->allocsampler = NULL;
+    g->tracer = NULL;
+#if defined(LUA_USE_TAINT)
+    g->taints = NULL;
+    g->ntaints = 0;
+    g->sizetaints = 0;
+#endif
     for (i = 0; i < NUM_TAGS; i++) {
         g->mt[i] = NULL;
     }
@@ -225,12 +269,28 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
     return L;
 }
 
+LUA_API lua_State *lua_newpoolstate (int hugepages) {
+    void *pool = luaM_newpool(hugepages);
+    lua_State *L;
+    if (pool == NULL) {
+        return NULL;
+    }
+    L = lua_newstate(luaM_poolalloc, pool);
+    if (L == NULL) {
+        luaM_freepool(pool);
+    } else {
+        G(L)->pool = pool;
+    }
+    return L;
+}
+
 static void callallgcTM (lua_State *L, void *ud) {
     lua_unused(ud);
     luaC_callGCTM(L); /* call GC metamethods for all udata */
 }
 
 LUA_API void lua_close (lua_State *L) {
+    void *pool;
     L = G(L)->mainthread; /* only the main thread can be closed */
     lua_lock(L);
     luaF_close(L, L->stack); /* close all upvalues for this thread */
@@ -243,5 +303,9 @@ LUA_API void lua_close (lua_State *L) {
     } while (luaD_rawrunprotected(L, callallgcTM, NULL) != 0);
     lua_assert(G(L)->tmudata == NULL);
     luai_userstateclose(L);
+    pool = G(L)->pool;
     close_state(L);
+    if (pool != NULL) { /* pool outlives the state's own block */
+        luaM_freepool(pool);
+    }
 }
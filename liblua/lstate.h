@@ -27,8 +27,13 @@ struct lua_longjmp; /* defined in ldo.c */
 
 typedef struct stringtable {
     GCObject **hash;
+    uint_least32_t *young; /* bitmap of chains that may start with young strings */
     uint_least32_t nuse; /* number of elements */
     int size;
+    GCObject **oldhash; /* chains not yet moved by an incremental resize */
+    uint_least32_t *oldyoung;
+    int oldsize; /* size of `oldhash'; 0 if no resize is in progress */
+    int rehashpos; /* chains of `oldhash' below this index have been moved */
 } stringtable;
 
 /*
@@ -39,11 +44,14 @@ typedef struct CallInfo {
     StkId func; /* function index in the stack */
     StkId top; /* top for this function */
     const Instruction *savedpc;
-    TString *savedtaint; /* saved taint for this call; informational only */
+#if defined(LUA_USE_TAINT)
+    TaintRef savedtaint; /* saved taint for this call; informational only */
+#endif
     lua_Clock entryticks; /* tick count on first initial entry or resumption of this call */
     lua_Clock startticks; /* tick count on last reentry of this function */
     int nresults; /* expected number of results from this function */
     int tailcalls; /* number of tail calls lost under this entry */
+    struct ClosureStats *stats; /* counters holding this call as open, if profiled */
 } CallInfo;
 
 #define curr_func(L) (clvalue(L->ci->func))
@@ -55,12 +63,152 @@ typedef struct CallInfo {
 ** Profiling Stats
 */
 typedef struct SourceStats {
-    TString *owner;
+    TString *owner; /* taint name; NULL for untainted objects */
     lua_Clock execticks; /* ticks spent executing owned functions */
-    size_t bytesowned; /* total size of owned allocations */
-    struct SourceStats *next;
+    size_t bytesowned; /* total size of owned objects */
+    uint_least32_t epoch; /* stats epoch of `execticks' */
 } SourceStats;
 
+/*
+** Profiling counters are cleared lazily; `lua_resetstats' only advances the
+** stats epoch, and counters last updated in an earlier epoch read as zero
+** and are cleared before they are next updated.
+*/
+#define iscurrentstats(g, s) ((s)->epoch == (g)->statsepoch)
+
+/* profiling counters shared by the closures of a C function */
+typedef struct CFunctionStats {
+    ClosureStats s;
+    lua_CFunction f;
+    struct CFunctionStats *next; /* next function in the same bucket */
+} CFunctionStats;
+
+/*
+** Sampling Profilers
+*/
+typedef struct SampleFrame {
+    struct Proto *p; /* prototype of a sampled Lua function */
+    lua_CFunction f; /* sampled C function if `p' is NULL */
+    int line; /* line being executed, or where the function is defined */
+} SampleFrame;
+
+typedef struct SampleStack {
+    unsigned int hash;
+    unsigned int tag; /* additional key of the stack */
+    int start; /* index in `frames' of the innermost call */
+    int depth; /* number of calls in this stack */
+    int count; /* number of samples of this stack; 0 if the slot is free */
+} SampleStack;
+
+typedef struct SampleTable {
+    SampleFrame *frames; /* calls of all distinct stacks, innermost first */
+    int sizeframes;
+    int nframes;
+    SampleStack *stacks; /* hash table of distinct stacks */
+    int sizestacks;
+    int nstacks;
+} SampleTable;
+
+typedef struct Sampler {
+    SampleTable t;
+    int nsamples; /* number of samples recorded */
+    int ndropped; /* number of samples lost to full buffers */
+    void *timer; /* platform timer handle, if any */
+} Sampler;
+
+typedef struct AllocSite {
+    lua_Number allocbytes; /* estimated bytes allocated */
+    lua_Number allocobjects; /* estimated number of allocations */
+    lua_Number livebytes; /* as above for the allocations not yet freed */
+    lua_Number liveobjects;
+} AllocSite;
+
+typedef struct AllocBlock {
+    void *block; /* sampled block; NULL if the slot is free */
+    int site; /* slot of its stack in `stacks' */
+    lua_Number bytes; /* estimated bytes represented by the sample */
+    lua_Number objects; /* estimated allocations represented by the sample */
+} AllocBlock;
+
+typedef struct AllocSampler {
+    SampleTable t; /* stacks tagged with the type and taint of the allocation */
+    AllocSite *sites; /* statistics of each stack (indexed like `stacks') */
+    int *order; /* slots of `stacks' in the order they were filled */
+    AllocBlock *blocks; /* hash table of sampled blocks still allocated */
+    int sizeblocks;
+    int nblocks;
+    size_t interval; /* mean number of bytes between samples */
+    size_t countdown; /* bytes left to allocate before the next sample */
+    uint_least64_t seed; /* state of the generator of sampling intervals */
+    void *pending; /* sampled block whose type isn't known yet */
+    size_t pendingsize;
+    int pendingdepth; /* number of calls recorded after `frames' for `pending' */
+    int nsamples; /* number of samples recorded */
+    int ndropped; /* number of samples lost to full buffers */
+    lu_byte busy; /* set while reporting, to not sample the profiler itself */
+    Mbuffer out; /* buffers used to encode reports */
+    Mbuffer msg;
+    Mbuffer ids;
+} AllocSampler;
+
+/*
+** Call Graph
+*/
+typedef struct CallEdge {
+    SampleFrame caller; /* calling function and line of the call; no function for calls made by the host */
+    SampleFrame callee; /* called function and the line where it's defined */
+    unsigned int hash;
+    int next; /* next edge in the same bucket; -1 at the end */
+    uint_least32_t calls; /* number of calls */
+    lua_Clock ownticks; /* ticks spent executing the callee */
+    lua_Clock subticks; /* as above but including calls to subroutines */
+} CallEdge;
+
+typedef struct CallGraph {
+    CallEdge *edges; /* edges in the order they were first seen */
+    int sizeedges;
+    int nedges;
+    int *buckets; /* first edge of each hash bucket; -1 if empty */
+    int sizebuckets;
+    uint_least32_t epoch; /* stats epoch of the edges */
+} CallGraph;
+
+/*
+** Timeline Tracing
+*/
+enum TraceEventType {
+    TRACE_CALL,
+    TRACE_RETURN,
+    TRACE_RESUME,
+    TRACE_YIELD,
+    TRACE_GCSTEP,
+    TRACE_GCSTEPEND,
+    TRACE_GCTM,
+    TRACE_GCTMEND,
+    TRACE_TAINT,
+};
+
+typedef struct TraceEvent {
+    lua_Clock ticks;
+    const struct lua_State *thread; /* thread of the event; only used to identify it */
+    struct Proto *p; /* called Lua function */
+    lua_CFunction f; /* called C function */
+    int arg; /* new stack taint of taint transitions */
+    lu_byte type;
+} TraceEvent;
+
+typedef struct Tracer {
+    TraceEvent *events; /* ring buffer of the most recent events */
+    int sizeevents;
+    size_t nevents; /* number of events recorded since tracing started */
+} Tracer;
+
+/*
+** Internal interrupt reasons; the public reasons are defined in lua.h
+*/
+#define LUAI_INTERRUPTRESELECT (1 << 9) /* hook mask or taint mode has changed */
+#define LUAI_INTERRUPTSAMPLE (1 << 10) /* record the call stack for the sampling profiler */
+
 /*
 ** `global state', shared by all threads of this state
 */
@@ -68,9 +216,16 @@ typedef struct global_State {
     stringtable strt; /* hash table for strings */
     lua_Alloc frealloc; /* function to reallocate memory */
     void *ud; /* auxiliary data to `frealloc' */
+    void *pool; /* pooled allocator owned by the state, even if `frealloc' wraps it */
     lu_byte enablestats;
+    lu_byte enablelinestats;
+    lu_byte enableclosurestats; /* keep separate counters for each closure */
+    lu_byte enablecallgraph;
     lu_byte currentwhite;
     lu_byte gcstate; /* state of garbage collector */
+    lu_byte gckind; /* kind of collector: incremental or generational */
+    volatile int interrupt; /* pending interrupt reasons */
+    int jitbudget; /* loop iterations native code may run before the script timeout is checked */
     int sweepstrgc; /* position of sweep in `strt' */
     GCObject *rootgc; /* list of all collectable objects */
     GCObject **sweepgc; /* position of sweep in `rootgc' */
@@ -85,10 +240,29 @@ typedef struct global_State {
     size_t gcdept; /* how much GC is `behind schedule' */
     int gcpause; /* size of pause between successive GCs */
     int gcstepmul; /* GC `granularity' */
+    int genminormul; /* growth between minor collections, as a percentage of `estimate' */
+    int genmajormul; /* growth that triggers a major collection, as a percentage of `estimate' */
+    int gcmarkthreads; /* threads that mark the heap in full collections */
+    lua_Clock (*clocktime)(void); /* clock source; selected on startup */
     lua_Clock startticks; /* tick count at startup */
     lua_Clock tickfreq; /* tick frequency; cached on startup */
+    lua_Clock lineticks; /* tick count at the last line profiling sample */
+    int linecount; /* instructions left until the next line profiling sample */
+    uint_least32_t statsepoch; /* advanced by `lua_resetstats' */
+    CFunctionStats **cfuncstats; /* hash table of C function counters */
+    int ncfuncstats; /* number of entries in `cfuncstats' */
+    int sizecfuncstats; /* size of `cfuncstats' */
+    CallGraph *callgraph; /* NULL until the call graph is first enabled */
     size_t bytesallocated; /* total number of bytes allocated */
-    SourceStats *sourcestats; /* list of source-specific statistics */
+    SourceStats securestats; /* statistics of untainted objects */
+    Sampler *sampler; /* sampling profiler state; NULL when not sampling */
+    AllocSampler *allocsampler; /* allocation profiler state; NULL when not sampling */
+    Tracer *tracer; /* timeline recorder; NULL when not tracing */
+#if defined(LUA_USE_TAINT)
+    SourceStats **taints; /* registry of taints and their statistics, indexed by TaintRef - 1 */
+    int ntaints; /* number of registered taint names */
+    int sizetaints; /* size of `taints' */
+#endif
     lua_CFunction panic; /* to be called in unprotected errors */
     TValue l_registry;
     TValue l_errfunc; /* global error handler */
@@ -104,12 +278,14 @@ typedef struct global_State {
 struct lua_State {
     CommonHeader;
     lu_byte status;
+#if defined(LUA_USE_TAINT)
     lu_byte taintflags; /* user-controlled taint propagation mode flags */
-    TString *stacktaint; /* current stack taint */
-    TString *writetaint; /* taint applied to values on stack writes */
-    TString *fixedtaint; /* taint applied from currently executing Lua closure */
-    TString *newgctaint; /* taint applied to newly allocated objects */
-    TString *newcltaint; /* taint applied to newly allocated closures */
+    TaintRef stacktaint; /* current stack taint */
+    TaintRef writetaint; /* taint applied to values on stack writes */
+    TaintRef fixedtaint; /* taint applied from currently executing Lua closure */
+    TaintRef newgctaint; /* taint applied to newly allocated objects */
+    TaintRef newcltaint; /* taint applied to newly allocated closures */
+#endif
     StkId top; /* first free slot in the stack */
     StkId base; /* base of current function */
     global_State *l_G;
@@ -56,11 +56,25 @@ static int statslib_getglobalstats (lua_State *L) {
     lua_GlobalStats stats;
     lua_getglobalstats(L, &stats);
 
-    lua_createtable(L, 0, 5);
+    lua_createtable(L, 0, 9);
     lua_pushnumber(L, (lua_Number) stats.bytesused);
     lua_setfield(L, -2, "bytesused");
     lua_pushnumber(L, (lua_Number) stats.bytesallocated);
     lua_setfield(L, -2, "bytesallocated");
+    lua_pushnumber(L, (lua_Number) stats.bytesreserved);
+    lua_setfield(L, -2, "bytesreserved");
+    lua_pushnumber(L, (lua_Number) stats.bytesfree);
+    lua_setfield(L, -2, "bytesfree");
+    lua_pushnumber(L, (lua_Number) stats.byteswasted);
+    lua_setfield(L, -2, "byteswasted");
+    lua_pushinteger(L, stats.samples);
+    lua_setfield(L, -2, "samples");
+    lua_pushinteger(L, stats.samplesdropped);
+    lua_setfield(L, -2, "samplesdropped");
+    lua_pushinteger(L, stats.allocsamples);
+    lua_setfield(L, -2, "allocsamples");
+    lua_pushinteger(L, stats.allocsamplesdropped);
+    lua_setfield(L, -2, "allocsamplesdropped");
 
     return 1;
 }
@@ -95,6 +109,186 @@ static int statslib_getsourcestats (lua_State *L) {
     return 1;
 }
 
+static int statslib_getlinestats (lua_State *L) {
+    lua_LineStats *stats;
+    int nlines;
+    int i;
+
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    nlines = lua_getlinestats(L, 1, NULL, 0);
+    stats = (lua_LineStats *) lua_newuserdata(L, sizeof(lua_LineStats) * (nlines + 1));
+    nlines = lua_getlinestats(L, 1, stats, nlines);
+
+    lua_createtable(L, 0, nlines);
+
+    for (i = 0; i < nlines; i++) {
+        lua_createtable(L, 0, 2);
+        lua_pushnumber(L, (lua_Number) stats[i].hits);
+        lua_setfield(L, -2, "hits");
+        lua_pushnumber(L, (lua_Number) stats[i].ticks);
+        lua_setfield(L, -2, "ticks");
+        lua_rawseti(L, -2, stats[i].line);
+    }
+
+    return 1;
+}
+
+static int statslib_islineprofilingenabled (lua_State *L) {
+    lua_pushboolean(L, lua_islineprofilingenabled(L));
+    return 1;
+}
+
+static int statslib_setlineprofilingenabled (lua_State *L) {
+    luaL_checkany(L, 1);
+    lua_setlineprofilingenabled(L, lua_toboolean(L, 1));
+    return 0;
+}
+
+static int statslib_startsampling (lua_State *L) {
+    int hz = luaL_optint(L, 1, 1000);
+    int started;
+    luaL_argcheck(L, hz > 0, 1, "frequency must be positive");
+    started = lua_startsampling(L, hz);
+
+    if (started < 0) {
+        return luaL_error(L, "the profiling timer is in use by another state");
+    }
+
+    lua_pushboolean(L, started);
+    return 1;
+}
+
+static int aux_writesamples (lua_State *L, const void *p, size_t sz, void *ud) {
+    lua_unused(L);
+    luaL_addlstring((luaL_Buffer *) ud, (const char *) p, sz);
+    return 0;
+}
+
+static int statslib_stopsampling (lua_State *L) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    lua_stopsampling(L, aux_writesamples, &b);
+    luaL_pushresult(&b);
+    return 1;
+}
+
+static int statslib_starttracing (lua_State *L) {
+    int size = luaL_optint(L, 1, 0);
+    luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+    lua_pushboolean(L, lua_starttracing(L, size));
+    return 1;
+}
+
+static int statslib_stoptracing (lua_State *L) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    lua_stoptracing(L, aux_writesamples, &b);
+    luaL_pushresult(&b);
+    return 1;
+}
+
+static int statslib_startallocsampling (lua_State *L) {
+    lua_Number interval = luaL_optnumber(L, 1, 524288);
+    luaL_argcheck(L, interval >= 1, 1, "interval must be positive"); /* also rejects nan */
+    luaL_argcheck(L, interval < (lua_Number) (~(size_t) 0), 1, "interval is too large");
+    lua_pushboolean(L, lua_startallocsampling(L, (size_t) interval));
+    return 1;
+}
+
+static int statslib_stopallocsampling (lua_State *L) {
+    lua_stopallocsampling(L);
+    return 0;
+}
+
+static int statslib_getallocstats (lua_State *L) {
+    lua_AllocStats stats;
+    int site;
+
+    lua_newtable(L);
+
+    for (site = 1; lua_getallocstats(L, site, &stats); site++) {
+        lua_createtable(L, 0, 7);
+        lua_insert(L, -2);
+        lua_setfield(L, -2, "stack");
+        lua_pushstring(L, stats.type);
+        lua_setfield(L, -2, "type");
+        lua_pushstring(L, stats.taint);
+        lua_setfield(L, -2, "taint");
+        lua_pushnumber(L, stats.allocbytes);
+        lua_setfield(L, -2, "allocbytes");
+        lua_pushnumber(L, stats.allocobjects);
+        lua_setfield(L, -2, "allocobjects");
+        lua_pushnumber(L, stats.livebytes);
+        lua_setfield(L, -2, "livebytes");
+        lua_pushnumber(L, stats.liveobjects);
+        lua_setfield(L, -2, "liveobjects");
+        lua_rawseti(L, -2, site);
+    }
+
+    return 1;
+}
+
+static int statslib_dumpallocprofile (lua_State *L) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    lua_dumpallocprofile(L, aux_writesamples, &b);
+    luaL_pushresult(&b);
+    return 1;
+}
+
+static int statslib_iscallgraphenabled (lua_State *L) {
+    lua_pushboolean(L, lua_iscallgraphenabled(L));
+    return 1;
+}
+
+static int statslib_setcallgraphenabled (lua_State *L) {
+    luaL_checkany(L, 1);
+    lua_setcallgraphenabled(L, lua_toboolean(L, 1));
+    return 0;
+}
+
+static int statslib_getcallgraph (lua_State *L) {
+    lua_FunctionStats stats;
+    int edge;
+
+    lua_newtable(L);
+
+    for (edge = 1; lua_getcallgraph(L, edge, &stats); edge++) {
+        lua_createtable(L, 0, 5);
+        lua_insert(L, -3);
+        lua_setfield(L, -3, "callee");
+        lua_setfield(L, -2, "caller");
+        lua_pushnumber(L, stats.calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, (lua_Number) stats.ownticks);
+        lua_setfield(L, -2, "ownticks");
+        lua_pushnumber(L, (lua_Number) stats.subticks);
+        lua_setfield(L, -2, "subticks");
+        lua_rawseti(L, -2, edge);
+    }
+
+    return 1;
+}
+
+static int statslib_dumpcallgraph (lua_State *L) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    lua_dumpcallgraph(L, aux_writesamples, &b);
+    luaL_pushresult(&b);
+    return 1;
+}
+
+static int statslib_isclosureprofilingenabled (lua_State *L) {
+    lua_pushboolean(L, lua_isclosureprofilingenabled(L));
+    return 1;
+}
+
+static int statslib_setclosureprofilingenabled (lua_State *L) {
+    luaL_checkany(L, 1);
+    lua_setclosureprofilingenabled(L, lua_toboolean(L, 1));
+    return 0;
+}
+
 static int statslib_isprofilingenabled (lua_State *L) {
     lua_pushboolean(L, lua_isprofilingenabled(L));
     return 1;
@@ -108,16 +302,33 @@ static int statslib_setprofilingenabled (lua_State *L) {
 
 const luaL_Reg statslib_funcs[] = {
     { "collectstats", statslib_collectstats },
+    { "dumpallocprofile", statslib_dumpallocprofile },
+    { "dumpcallgraph", statslib_dumpcallgraph },
+    { "getallocstats", statslib_getallocstats },
+    { "getcallgraph", statslib_getcallgraph },
     { "getelapsedtime", statslib_getelapsedtime },
     { "getfunctionstats", statslib_getfunctionstats },
     { "getglobalstats", statslib_getglobalstats },
+    { "getlinestats", statslib_getlinestats },
     { "getsourcestats", statslib_getsourcestats },
     { "gettickcount", statslib_gettickcount },
     { "gettickfrequency", statslib_gettickfrequency },
     { "gettime", statslib_gettime },
+    { "iscallgraphenabled", statslib_iscallgraphenabled },
+    { "isclosureprofilingenabled", statslib_isclosureprofilingenabled },
+    { "islineprofilingenabled", statslib_islineprofilingenabled },
     { "isprofilingenabled", statslib_isprofilingenabled },
     { "resetstats", statslib_resetstats },
+    { "setcallgraphenabled", statslib_setcallgraphenabled },
+    { "setclosureprofilingenabled", statslib_setclosureprofilingenabled },
+    { "setlineprofilingenabled", statslib_setlineprofilingenabled },
     { "setprofilingenabled", statslib_setprofilingenabled },
+    { "startallocsampling", statslib_startallocsampling },
+    { "startsampling", statslib_startsampling },
+    { "starttracing", statslib_starttracing },
+    { "stopallocsampling", statslib_stopallocsampling },
+    { "stopsampling", statslib_stopsampling },
+    { "stoptracing", statslib_stoptracing },
     /* clang-format off */
     { NULL, NULL },
     /* clang-format on */
@@ -8,40 +8,101 @@
 
 #include "lua.h"
 
+#include "ldebug.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lsec.h"
 #include "lstate.h"
 #include "lstring.h"
 
+/*
+** The string table is resized incrementally. `luaS_resize' installs the new
+** table and keeps the old one in `oldhash'; each later call to
+** `luaS_newlstr' and each sweep step of the collector then moves a few of its
+** chains, and lookups search both tables until all have moved. The collector
+** sweeps the chains of the old table before those of the new one, so while
+** it sweeps strings only chains it has already swept are moved, and the old
+** table is kept until the sweep is over.
+*/
+
+#define RESIZESTEP 4 /* chains moved by each string lookup during a resize */
+
+/* move a string into the new table; old strings go after young ones */
+static void rehashstring (stringtable *tb, GCObject *p) {
+    int h = lmod(gco2ts(p)->hash, tb->size);
+    lua_assert(cast_int(gco2ts(p)->hash % tb->size) == h);
+    if (isold(p)) {
+        GCObject **q = &tb->hash[h];
+        while (*q != NULL) {
+            q = &(*q)->gch.next;
+        }
+        p->gch.next = NULL;
+        *q = p;
+    } else {
+        p->gch.next = tb->hash[h]; /* chain it */
+        tb->hash[h] = p;
+        markyoungchain(tb->young, h);
+    }
+}
+
+/* move up to `n' chains of the old table, freeing it once all have moved */
+void luaS_rehashstep (lua_State *L, int n) {
+    global_State *g = G(L);
+    stringtable *tb = &g->strt;
+    int sweeping = (g->gcstate == GCSsweepstring);
+    if (tb->oldhash == NULL) {
+        return; /* no resize in progress */
+    }
+    for (; n > 0 && tb->rehashpos < tb->oldsize; n--) {
+        GCObject *p;
+        if (sweeping && tb->rehashpos >= g->sweepstrgc) {
+            break; /* chain not swept yet */
+        }
+        p = tb->oldhash[tb->rehashpos];
+        tb->oldhash[tb->rehashpos++] = NULL;
+        while (p) { /* for each node in the list */
+            GCObject *next = p->gch.next; /* save next */
+            rehashstring(tb, p);
+            p = next;
+        }
+    }
+    if (tb->rehashpos >= tb->oldsize && !sweeping) {
+        luaM_freearray(L, tb->oldhash, tb->oldsize, TString *);
+        luaM_freearray(L, tb->oldyoung, sizeyoungmap(tb->oldsize), uint_least32_t);
+        tb->oldhash = NULL;
+        tb->oldyoung = NULL;
+        tb->oldsize = 0;
+        tb->rehashpos = 0;
+    }
+}
+
 void luaS_resize (lua_State *L, int newsize) {
     GCObject **newhash;
-    stringtable *tb;
+    uint_least32_t *newyoung;
+    stringtable *tb = &G(L)->strt;
     int i;
     if (G(L)->gcstate == GCSsweepstring) {
         return; /* cannot resize during GC traverse */
     }
+    luaS_rehashstep(L, tb->oldsize); /* finish the previous resize */
     newhash = luaM_newvector(L, newsize, GCObject *);
-    tb = &G(L)->strt;
+    newyoung = luaM_newvector(L, sizeyoungmap(newsize), uint_least32_t);
     for (i = 0; i < newsize; i++) {
         newhash[i] = NULL;
     }
-    /* rehash */
-    for (i = 0; i < tb->size; i++) {
-        GCObject *p = tb->hash[i];
-        while (p) { /* for each node in the list */
-            GCObject *next = p->gch.next; /* save next */
-            unsigned int h = gco2ts(p)->hash;
-            int h1 = lmod(h, newsize); /* new position */
-            lua_assert(cast_int(h % newsize) == lmod(h, newsize));
-            p->gch.next = newhash[h1]; /* chain it */
-            newhash[h1] = p;
-            p = next;
-        }
+    for (i = 0; i < sizeyoungmap(newsize); i++) {
+        newyoung[i] = 0;
     }
-    luaM_freearray(L, tb->hash, tb->size, TString *);
-    tb->size = newsize;
+    tb->oldhash = tb->hash;
+    tb->oldyoung = tb->young;
+    tb->oldsize = tb->size;
+    tb->rehashpos = 0;
     tb->hash = newhash;
+    tb->young = newyoung;
+    tb->size = newsize;
+    if (tb->nuse == 0) {
+        luaS_rehashstep(L, tb->oldsize); /* nothing to move */
+    }
 }
 
 static TString *newlstr (lua_State *L, const char *str, size_t l, unsigned int h) {
@@ -56,13 +117,19 @@ static TString *newlstr (lua_State *L, const char *str, size_t l, unsigned int h
     ts->tsv.marked = luaC_white(G(L));
     ts->tsv.tt = LUA_TSTRING;
     ts->tsv.reserved = 0;
+#if defined(LUA_USE_TAINT)
+    ts->tsv.taintref = 0;
+#endif
     luaR_taintalloc(L, obj2gco(ts));
+    luaR_resizeowned(L, obj2gco(ts), 0, sizestring(&ts->tsv));
+    luaG_allocobject(L, obj2gco(ts));
     memcpy(ts + 1, str, l * sizeof(char));
     ((char *) (ts + 1))[l] = '\0'; /* ending 0 */
     tb = &G(L)->strt;
     h = lmod(h, tb->size);
     ts->tsv.next = tb->hash[h]; /* chain new entry */
     tb->hash[h] = obj2gco(ts);
+    markyoungchain(tb->young, h);
     tb->nuse++;
     if (tb->nuse > cast(uint_least32_t, tb->size) && tb->size <= LUA_INT_MAX / 2) {
         luaS_resize(L, tb->size * 2); /* too crowded */
@@ -70,25 +137,37 @@ static TString *newlstr (lua_State *L, const char *str, size_t l, unsigned int h
     return ts;
 }
 
-TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
-    GCObject *o;
-    unsigned int h = cast(unsigned int, l); /* seed */
-    size_t step = (l >> 5) + 1; /* if string is too long, don't hash all its chars */
-    size_t l1;
-    for (l1 = l; l1 >= step; l1 -= step) { /* compute hash */
-        h = h ^ ((h << 5) + (h >> 2) + cast(unsigned char, str[l1 - 1]));
-    }
-    for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)]; o != NULL; o = o->gch.next) {
+static TString *findstring (global_State *g, GCObject *o, const char *str, size_t l) {
+    for (; o != NULL; o = o->gch.next) {
         TString *ts = rawgco2ts(o);
         if (ts->tsv.len == l && (memcmp(str, getstr(ts), l) == 0)) {
             /* string may be dead */
-            if (isdead(G(L), o)) {
+            if (isdead(g, o)) {
                 changewhite(o);
             }
             return ts;
         }
     }
-    return newlstr(L, str, l, h); /* not found */
+    return NULL;
+}
+
+TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
+    stringtable *tb = &G(L)->strt;
+    TString *ts;
+    unsigned int h = cast(unsigned int, l); /* seed */
+    size_t step = (l >> 5) + 1; /* if string is too long, don't hash all its chars */
+    size_t l1;
+    for (l1 = l; l1 >= step; l1 -= step) { /* compute hash */
+        h = h ^ ((h << 5) + (h >> 2) + cast(unsigned char, str[l1 - 1]));
+    }
+    if (tb->oldhash != NULL) {
+        luaS_rehashstep(L, RESIZESTEP);
+    }
+    ts = findstring(G(L), tb->hash[lmod(h, tb->size)], str, l);
+    if (ts == NULL && tb->oldhash != NULL) {
+        ts = findstring(G(L), tb->oldhash[lmod(h, tb->oldsize)], str, l);
+    }
+    return (ts != NULL) ? ts : newlstr(L, str, l, h);
 }
 
 Udata *luaS_newudata (lua_State *L, size_t s, Table *e) {
@@ -103,6 +182,8 @@ Udata *luaS_newudata (lua_State *L, size_t s, Table *e) {
     u->uv.metatable = NULL;
     u->uv.env = e;
     luaR_taintalloc(L, obj2gco(u));
+    luaR_resizeowned(L, obj2gco(u), 0, sizeudata(&u->uv));
+    luaG_allocobject(L, obj2gco(u));
     /* chain it on udata list (after main thread) */
     u->uv.next = G(L)->mainthread->next;
     G(L)->mainthread->next = obj2gco(u);
@@ -17,7 +17,15 @@
 
 #define luaS_fix(s) l_setbit((s)->tsv.marked, FIXEDBIT)
 
+#define sizeyoungmap(n) (((n) + 31) / 32)
+#define markyoungchain(m, i) ((m)[(i) / 32] |= (cast(uint_least32_t, 1) << ((i) % 32)))
+
+/* chains of the string table; those of the old table come first while it is resized */
+#define sizestrchains(tb) ((tb)->oldsize + (tb)->size)
+#define strchain(tb, i) (((i) < (tb)->oldsize) ? &(tb)->oldhash[i] : &(tb)->hash[(i) - (tb)->oldsize])
+
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
+LUAI_FUNC void luaS_rehashstep (lua_State *L, int n);
 LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, Table *e);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 
@@ -28,6 +28,7 @@
 #include "lmanip.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lsec.h"
 #include "lstate.h"
 #include "ltable.h"
 
@@ -63,8 +64,8 @@
 #define dummynode (&dummynode_)
 
 static const Node dummynode_ = {
-    { { NULL }, NULL, LUA_TNIL }, /* value */
-    { { { NULL }, NULL, LUA_TNIL, NULL } } /* key */
+    .i_val = { .value = { NULL }, .tt = LUA_TNIL },
+    .i_key = { .nk = { .value = { NULL }, .tt = LUA_TNIL, .next = NULL } },
 };
 
 /*
@@ -250,6 +251,7 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
 static void setarrayvector (lua_State *L, Table *t, int size) {
     int i;
     luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
+    luaR_resizeowned(L, obj2gco(t), sizeof(TValue) * t->sizearray, sizeof(TValue) * size);
     for (i = t->sizearray; i < size; i++) {
         rawsetnilvalue(&t->array[i]);
     }
@@ -276,6 +278,7 @@ static void setnodevector (lua_State *L, Table *t, int size) {
             rawsetnilvalue(gval(n));
         }
     }
+    luaR_resizeowned(L, obj2gco(t), sizeof(Node) * sizenode(t), sizeof(Node) * twoto(lsize));
     t->lsizenode = cast_byte(lsize);
     t->lastfree = gnode(t, size); /* all positions are free */
 }
@@ -291,6 +294,7 @@ static void resize (lua_State *L, Table *t, int nasize, int nhsize) {
     /* create new hash part with appropriate size */
     setnodevector(L, t, nhsize);
     if (nasize < oldasize) { /* array part must shrink? */
+        luaR_resizeowned(L, obj2gco(t), sizeof(TValue) * oldasize, sizeof(TValue) * nasize);
         t->sizearray = nasize;
         /* re-insert elements from vanishing slice */
         for (i = nasize; i < oldasize; i++) {
@@ -353,6 +357,7 @@ Table *luaH_new (lua_State *L, int narray, int nhash) {
     t->sizearray = 0;
     t->lsizenode = 0;
     t->node = cast(Node *, dummynode);
+    luaR_resizeowned(L, obj2gco(t), 0, luaC_objectsize(obj2gco(t)));
     setarrayvector(L, t, narray);
     setnodevector(L, t, nhash);
     return t;
@@ -451,6 +456,23 @@ const TValue *luaH_getstr (Table *t, TString *key) {
     return luaO_nilobject;
 }
 
+/*
+** search function for strings that also records the node index of `key' in
+** `slot' when found, for use by the inline caches of the VM
+*/
+const TValue *luaH_getstrslot (Table *t, TString *key, unsigned int *slot) {
+    Node *n = hashstr(t, key);
+    do { /* check whether `key' is somewhere in the chain */
+        if (ttisstring(gkey(n)) && rawtsvalue(gkey(n)) == key) {
+            *slot = cast(unsigned int, n - t->node);
+            return gval(n); /* that's it */
+        } else {
+            n = gnext(n);
+        }
+    } while (n);
+    return luaO_nilobject;
+}
+
 /*
 ** main search function
 */
@@ -14,6 +14,7 @@
 #include "lmanip.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstring.h"
 #include "lundump.h"
 #include "lzio.h"
@@ -181,6 +182,12 @@ static Proto *LoadFunction (LoadState *S, TString *p) {
     LoadConstants(S, f);
     LoadDebug(S, f);
     IF(!luaG_checkcode(f), "bad code");
+    luaP_fuse(f->code, f->sizecode);
+    luaF_newicache(S->L, f);
+#if defined(LUA_USE_PREDECODE)
+    luaF_predecode(S->L, f);
+#endif
+    luaF_accountproto(S->L, f);
     S->L->top--;
     S->L->nCcalls--;
     return f;
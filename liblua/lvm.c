@@ -14,6 +14,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmanip.h"
 #include "lobject.h"
 #include "lopcodes.h"
@@ -51,6 +52,21 @@ int luaV_tostring (lua_State *L, StkId obj) {
     }
 }
 
+/*
+** attribute the ticks elapsed since the last sample to the instruction about
+** to be executed; the clock is only read once every `LUAI_LINESAMPLE'
+** instructions on average to keep line profiling cheap. The interval is
+** jittered by the low bits of the clock so that samples don't stay in step
+** with loops whose length divides it.
+*/
+static void sampleline (lua_State *L, LineStats *ls) {
+    global_State *g = G(L);
+    lua_Clock now = luaG_clocktime(g);
+    ls->ticks += (now - g->lineticks);
+    g->lineticks = now;
+    g->linecount = (LUAI_LINESAMPLE / 2) + cast_int(now % LUAI_LINESAMPLE);
+}
+
 static void traceexec (lua_State *L, const Instruction *pc) {
     lu_byte mask = L->hookmask;
     const Instruction *oldpc = L->savedpc;
@@ -137,7 +153,7 @@ void luaV_settable (lua_State *L, const TValue *t, TValue *key, StkId val) {
         } else if (ttisnil(tm = luaT_gettmbyobj(L, t, TM_NEWINDEX))) {
             luaG_typeerror(L, t, "index");
         }
-        luaR_taintstack(L, tm->taint); /* propagate 'tm' taint to stack */
+        luaR_taintstack(L, luaR_getvaluetaint(tm)); /* propagate 'tm' taint to stack */
         if (ttisfunction(tm)) {
             callTM(L, tm, t, key, val);
             return;
@@ -149,6 +165,56 @@ void luaV_settable (lua_State *L, const TValue *t, TValue *key, StkId val) {
     luaG_runerror(L, "loop in settable");
 }
 
+/*
+** Table accesses with a string key first check the node recorded in the
+** inline cache of the instruction, and otherwise fall back to the full lookup
+** and update the cache. A table reached through an `__index' table is cached
+** separately so that method lookups through a class table avoid a second
+** hash probe. Anything else is left to `luaV_gettable' and `luaV_settable'.
+*/
+static const TValue *getstrcached (Table *h, TString *key, unsigned int *slot) {
+    const Node *n = gnode(h, lmod(*slot, sizenode(h)));
+    if (ttisstring(gkey(n)) && rawtsvalue(gkey(n)) == key) {
+        return gval(n);
+    }
+    return luaH_getstrslot(h, key, slot);
+}
+
+static void gettablecached (lua_State *L, const TValue *t, TValue *key, StkId val, ICache *ic) {
+    if (ttistable(t)) {
+        Table *h = hvalue(t);
+        const TValue *res = getstrcached(h, rawtsvalue(key), &ic->slot);
+        const TValue *tm;
+        if (!ttisnil(res) || (tm = fasttm(L, h->metatable, TM_INDEX)) == NULL) {
+            setobjt2s(L, t, key, val, res);
+            return;
+        }
+        if (ttistable(tm)) { /* `__index' is a table? */
+            h = hvalue(tm);
+            res = getstrcached(h, rawtsvalue(key), &ic->hslot);
+            if (!ttisnil(res) || fasttm(L, h->metatable, TM_INDEX) == NULL) {
+                setobjt2s(L, tm, key, val, res);
+                return;
+            }
+        }
+    }
+    luaV_gettable(L, t, key, val);
+}
+
+static void settablecached (lua_State *L, const TValue *t, TValue *key, StkId val, ICache *ic) {
+    if (ttistable(t)) {
+        Table *h = hvalue(t);
+        TValue *oldval = cast(TValue *, getstrcached(h, rawtsvalue(key), &ic->slot));
+        if (oldval != luaO_nilobject && (!ttisnil(oldval) || fasttm(L, h->metatable, TM_NEWINDEX) == NULL)) {
+            setobj2t(L, t, key, oldval, val);
+            h->flags = 0;
+            luaC_barriert(L, h, val);
+            return;
+        }
+    }
+    luaV_settable(L, t, key, val);
+}
+
 static int call_binTM (lua_State *L, const TValue *p1, const TValue *p2, StkId res, TMS event) {
     const TValue *tm = luaT_gettmbyobj(L, p1, event); /* try first operand */
     if (ttisnil(tm)) {
@@ -387,19 +453,67 @@ static void Arith (lua_State *L, StkId ra, const TValue *rb, const TValue *rc, T
 
 #define runtime_check(L, c)                                                                                            \
     {                                                                                                                  \
-        if (!(c))                                                                                                      \
-            break;                                                                                                     \
+        if (!(c)) {                                                                                                    \
+            vmbreak;                                                                                                   \
+        }                                                                                                              \
     }
 
 #define RA(i) (base + GETARG_A(i))
 /* to be used after possible stack reallocation */
 #define RB(i) check_exp(getBMode(GET_OPCODE(i)) == OpArgR, base + GETARG_B(i))
 #define RC(i) check_exp(getCMode(GET_OPCODE(i)) == OpArgR, base + GETARG_C(i))
+
+#if defined(LUA_USE_PREDECODE)
+
+/*
+** the VM executes the pre-decoded instructions in `dcode' rather than `code';
+** `pc' addresses an entry of `dcode' and is converted to the matching address
+** in `code' whenever it is stored in `savedpc'
+*/
+typedef DInstruction VMInstruction;
+
+#define RKB(i)                                                                                                         \
+    check_exp(getBMode(GET_OPCODE(i)) == OpArgK, (pc - 1)->rkb != NULL ? (pc - 1)->rkb : base + GETARG_B(i))
+#define RKC(i)                                                                                                         \
+    check_exp(getCMode(GET_OPCODE(i)) == OpArgK, (pc - 1)->u.rkc != NULL ? (pc - 1)->u.rkc : base + GETARG_C(i))
+#define KBx(i) check_exp(getBMode(GET_OPCODE(i)) == OpArgK, (pc - 1)->rkb)
+#define ICACHE() check_exp(cl->p->icache != NULL, &cl->p->icache[cast_int(pc - cl->p->dcode) - 1])
+
+#define vmloadpc(p, savedpc) ((p)->dcode + ((savedpc) - (p)->code))
+#define vmsavedpc(pc) ((pc)->pc)
+#define vminstr(pc) ((pc)->i)
+
+/* take the jump of the instruction being executed */
+#define vmjump(L, pc, i)                                                                                               \
+    {                                                                                                                  \
+        (pc) = ((pc) - 1)->u.target;                                                                                   \
+        luai_threadyield(L);                                                                                           \
+    }
+
+/* take the jump of the OP_JMP addressed by `pc' */
+#define vmjumpnext(L, pc)                                                                                              \
+    {                                                                                                                  \
+        (pc) = (pc)->u.target;                                                                                         \
+        luai_threadyield(L);                                                                                           \
+    }
+
+/* rewrite the instruction being executed to opcode `o'; `code' is unchanged */
+#define vmrewrite(o) SET_OPCODE(cast(VMInstruction *, pc - 1)->i, o)
+
+#else
+
+typedef Instruction VMInstruction;
+
 #define RKB(i)                                                                                                         \
     check_exp(getBMode(GET_OPCODE(i)) == OpArgK, ISK(GETARG_B(i)) ? k + INDEXK(GETARG_B(i)) : base + GETARG_B(i))
 #define RKC(i)                                                                                                         \
     check_exp(getCMode(GET_OPCODE(i)) == OpArgK, ISK(GETARG_C(i)) ? k + INDEXK(GETARG_C(i)) : base + GETARG_C(i))
 #define KBx(i) check_exp(getBMode(GET_OPCODE(i)) == OpArgK, k + GETARG_Bx(i))
+#define ICACHE() check_exp(cl->p->icache != NULL, &cl->p->icache[pcRel(pc, cl->p)])
+
+#define vmloadpc(p, savedpc) (savedpc)
+#define vmsavedpc(pc) (pc)
+#define vminstr(pc) (*(pc))
 
 #define dojump(L, pc, i)                                                                                               \
     {                                                                                                                  \
@@ -407,449 +521,353 @@ static void Arith (lua_State *L, StkId ra, const TValue *rb, const TValue *rc, T
         luai_threadyield(L);                                                                                           \
     }
 
-#define Protect(x)                                                                                                     \
+/* take the jump of the instruction being executed */
+#define vmjump(L, pc, i) dojump(L, pc, GETARG_sBx(i))
+
+/* take the jump of the OP_JMP addressed by `pc' */
+#define vmjumpnext(L, pc) dojump(L, pc, GETARG_sBx(*(pc)) + 1)
+
+/*
+** rewrite the instruction being executed to opcode `o'; this is used to switch
+** instructions between their generic and number specialized variants
+*/
+#define vmrewrite(o) SET_OPCODE(*cast(Instruction *, pc - 1), o)
+
+#endif
+
+/* take the jump of the OP_JMP following a test; backward jumps are safepoints */
+#define condjump(L, pc)                                                                                                \
+    {                                                                                                                  \
+        int offset = GETARG_sBx(vminstr(pc));                                                                          \
+        vmjumpnext(L, pc);                                                                                             \
+        if (offset < 0) {                                                                                              \
+            vmsafepoint(L->savedpc);                                                                                   \
+        }                                                                                                              \
+    }
+
+/*
+** run `x', which may call back into Lua, with the current instruction saved for
+** error reporting; instructions that still have work to do afterwards use this
+** directly and check for a taint mode change themselves once they are done
+*/
+#define ProtectNoSwitch(x)                                                                                             \
     {                                                                                                                  \
-        L->savedpc = pc;                                                                                               \
+        L->savedpc = vmsavedpc(pc);                                                                                    \
         { x; };                                                                                                        \
         base = L->base;                                                                                                \
     }
 
-#define arith_op(op, tm)                                                                                               \
+/*
+** if the taint mode was changed by a metamethod or another call made by the
+** current instruction, continue from the next instruction in the instance for
+** the new mode; the traced instance reads the taint mode at run time instead
+*/
+#define vmtaintswitch()                                                                                                \
+    if (luaR_gettaintmode(L) != VM_TAINTMODE) {                                                                        \
+        L->savedpc = vmsavedpc(pc);                                                                                    \
+        *pnexeccalls = nexeccalls;                                                                                     \
+        return 1;                                                                                                      \
+    }
+
+#define Protect(x)                                                                                                     \
+    {                                                                                                                  \
+        ProtectNoSwitch(x);                                                                                            \
+        vmtaintswitch();                                                                                               \
+    }
+
+#define arith_op(op, tm, nnop)                                                                                         \
     {                                                                                                                  \
         TValue *rb = RKB(i);                                                                                           \
         TValue *rc = RKC(i);                                                                                           \
         if (ttisnumber(rb) && ttisnumber(rc)) {                                                                        \
             lua_Number nb = nvalue(rb), nc = nvalue(rc);                                                               \
+            vmrewrite(nnop);                                                                                           \
             setnvalue(L, ra, op(nb, nc));                                                                              \
         } else                                                                                                         \
             Protect(Arith(L, ra, rb, rc, tm));                                                                         \
     }
 
-void luaV_execute (lua_State *L, int nexeccalls) {
-    LClosure *cl;
-    StkId base;
-    TValue *k;
-    const Instruction *pc;
-    const lua_Clock tickstart = luaG_clocktime(G(L));
-reentry: /* entry point */
-    lua_assert(isLua(L->ci));
-    pc = L->savedpc;
-    cl = &clvalue(L->ci->func)->l;
-    base = L->base;
-    k = cl->p->k;
+#define arith_opnn(op, tm, genop)                                                                                      \
+    {                                                                                                                  \
+        TValue *rb = RKB(i);                                                                                           \
+        TValue *rc = RKC(i);                                                                                           \
+        if (ttisnumber(rb) && ttisnumber(rc)) {                                                                        \
+            lua_Number nb = nvalue(rb), nc = nvalue(rc);                                                               \
+            setnvalue(L, ra, op(nb, nc));                                                                              \
+        } else {                                                                                                       \
+            vmrewrite(genop);                                                                                          \
+            Protect(Arith(L, ra, rb, rc, tm));                                                                         \
+        }                                                                                                              \
+    }
+
+#define comp_op(numop, cmp, nnop)                                                                                      \
+    {                                                                                                                  \
+        TValue *rb = RKB(i);                                                                                           \
+        TValue *rc = RKC(i);                                                                                           \
+        if (ttisnumber(rb) && ttisnumber(rc)) {                                                                        \
+            vmrewrite(nnop);                                                                                           \
+            if (numop(nvalue(rb), nvalue(rc)) == GETARG_A(i)) {                                                        \
+                condjump(L, pc);                                                                                       \
+            } else {                                                                                                   \
+                pc++;                                                                                                  \
+            }                                                                                                          \
+        } else {                                                                                                       \
+            Protect(if (cmp(L, rb, rc) == GETARG_A(i)) { condjump(L, pc); } else { pc++; });                           \
+        }                                                                                                              \
+    }
 
-    /* propagate closure taint upon (re)entering a lua stack frame */
-    L->fixedtaint = NULL;
-    luaR_taintstack(L, cl->taint);
-    L->fixedtaint = cl->taint;
+#define comp_opnn(numop, cmp, genop)                                                                                   \
+    {                                                                                                                  \
+        TValue *rb = RKB(i);                                                                                           \
+        TValue *rc = RKC(i);                                                                                           \
+        if (ttisnumber(rb) && ttisnumber(rc)) {                                                                        \
+            if (numop(nvalue(rb), nvalue(rc)) == GETARG_A(i)) {                                                        \
+                condjump(L, pc);                                                                                       \
+            } else {                                                                                                   \
+                pc++;                                                                                                  \
+            }                                                                                                          \
+        } else {                                                                                                       \
+            vmrewrite(genop);                                                                                          \
+            Protect(if (cmp(L, rb, rc) == GETARG_A(i)) { condjump(L, pc); } else { pc++; });                           \
+        }                                                                                                              \
+    }
 
-    luaG_profileenter(L);
+/*
+** fetch the next instruction; instances built for tracing also count the
+** instruction for line profiling, allocating the function's counters on its
+** first counted instruction, and run the line and count hooks here, as these
+** must be checked for every instruction
+*/
+#define vmfetch()                                                                                                      \
+    {                                                                                                                  \
+        i = vminstr(pc);                                                                                               \
+        pc++;                                                                                                          \
+        if (VM_TRACEEXEC && G(L)->enablelinestats) {                                                                   \
+            LineStats *ls;                                                                                             \
+            if (cl->p->linestats == NULL) { /* first instruction counted for this function */                          \
+                L->savedpc = vmsavedpc(pc);                                                                            \
+                luaF_newlinestats(L, cl->p);                                                                           \
+            } else if (cl->p->lineepoch != G(L)->statsepoch) {                                                         \
+                luaF_resetlinestats(L, cl->p);                                                                         \
+            }                                                                                                          \
+            ls = &cl->p->linestats[pcRel(vmsavedpc(pc), cl->p)];                                                       \
+            ls->hits++;                                                                                                \
+            if (--G(L)->linecount <= 0) {                                                                              \
+                sampleline(L, ls);                                                                                     \
+            }                                                                                                          \
+        }                                                                                                              \
+        if (VM_TRACEEXEC &&                                                                                            \
+            (((L->hookmask & LUA_MASKCOUNT) && (--L->hookcount == 0)) || (L->hookmask & LUA_MASKLINE))) {              \
+            luaG_profileleave(L);                                                                                      \
+            traceexec(L, vmsavedpc(pc));                                                                               \
+            if (L->status == LUA_YIELD) { /* did any hook yield? */                                                    \
+                L->savedpc = vmsavedpc(pc - 1);                                                                        \
+                return 0;                                                                                              \
+            }                                                                                                          \
+            base = L->base;                                                                                            \
+            luaG_profileenter(L);                                                                                      \
+        }                                                                                                              \
+        L->savedpc = vmsavedpc(pc); /* update savedpc for per-op taint logging */                                      \
+        ra = RA(i); /* warning!! several calls may realloc the stack and invalidate `ra' */                            \
+        lua_assert(base == L->base && L->base == L->ci->base);                                                         \
+        lua_assert(base <= L->top && L->top <= L->stack + L->stacksize);                                               \
+        lua_assert(L->top == L->ci->top || luaG_checkopenop(i));                                                       \
+    }
 
-    /* main loop of interpreter */
-    for (;;) {
-        const Instruction i = *pc++;
-        StkId ra;
+/*
+** continue a superinstruction with the instruction that follows it, skipping
+** its dispatch; instances built for tracing execute both separately so that
+** hooks still see each instruction
+*/
+#define vmfuse(l)                                                                                                      \
+    if (!VM_TRACEEXEC) {                                                                                               \
+        i = vminstr(pc);                                                                                               \
+        pc++;                                                                                                          \
+        L->savedpc = vmsavedpc(pc);                                                                                    \
+        ra = RA(i);                                                                                                    \
+        goto l;                                                                                                        \
+    }
+
+/*
+** check for pending interrupts; this is done only at safepoints (entry into
+** a Lua frame, after calls to C functions and on backward jumps) where `pc'
+** addresses the next instruction to be executed. The script timeout is counted
+** down here too, so the clock is only read once the count runs out. Errors and hooks raised by
+** the interrupt are reported against `reportpc'; for backward jumps this is
+** the jump itself rather than its target. If the interrupt requires a
+** different interpreter instance this one returns 1 and `luaV_execute'
+** continues from the same point in the matching instance.
+*/
+#define vmsafepoint(reportpc)                                                                                          \
+    {                                                                                                                  \
+        if (G(L)->interrupt != 0 || (L->baseexeccount > 0 && --L->execcount <= 0)) {                                   \
+            L->savedpc = (reportpc);                                                                                   \
+            if (!interrupt(L, tickstart)) { /* did any hook yield? */                                                  \
+                L->savedpc = vmsavedpc(pc);                                                                            \
+                return 0;                                                                                              \
+            }                                                                                                          \
+            L->savedpc = vmsavedpc(pc);                                                                                \
+            base = L->base;                                                                                            \
+            if (istracing(L) != VM_TRACEEXEC || luaR_gettaintmode(L) != VM_TAINTMODE) {                                \
+                *pnexeccalls = nexeccalls;                                                                             \
+                return 1;                                                                                              \
+            }                                                                                                          \
+        }                                                                                                              \
+    }
 
-        if (((L->hookmask & LUA_MASKCOUNT) && (--L->hookcount == 0)) || (L->hookmask & LUA_MASKLINE)) {
+#if defined(LUA_USE_JIT)
+
+/*
+** loops are compiled to native code once the function has run enough
+** iterations, estimated from the trip count of each loop as it starts. The
+** native code is only entered by the instances without hooks and with taint
+** disabled, either at the OP_FORLOOP (after OP_FORPREP) or at the start of the
+** loop body (after an interpreted OP_FORLOOP), and returns the instruction at
+** which the interpreter continues. Native loops count iterations against
+** `jitbudget', which carries the script timeout count of the running thread.
+*/
+#define vmjitcount(ra)                                                                                                 \
+    if (!VM_TRACEEXEC && VM_TAINTMODE == LUA_TAINTDISABLED && cl->p->jitcount > 0) {                                   \
+        lua_Number trips = luai_numdiv(luai_numsub(nvalue((ra) + 1), nvalue(ra)), nvalue((ra) + 2));                   \
+        cl->p->jitcount -= (trips >= 1) ? ((trips < LUAI_JITTHRESHOLD) ? cast_int(trips) : LUAI_JITTHRESHOLD) : 1;     \
+        if (cl->p->jitcount <= 0) {                                                                                    \
+            Protect(luaJ_compile(L, cl->p));                                                                           \
+        }                                                                                                              \
+    }
+
+#define vmjitloop()                                                                                                    \
+    if (!VM_TRACEEXEC && VM_TAINTMODE == LUA_TAINTDISABLED && cl->p->jit != NULL && L->exceptmask == 0) {              \
+        int n;                                                                                                         \
+        G(L)->jitbudget = (L->baseexeccount > 0) ? L->execcount : LUA_INT_MAX;                                         \
+        n = luaJ_execute(cl, cast_int(vmsavedpc(pc) - cl->p->code), base);                                             \
+        if (L->baseexeccount > 0) {                                                                                    \
+            L->execcount = G(L)->jitbudget;                                                                            \
+        }                                                                                                              \
+        if (n >= 0) {                                                                                                  \
+            pc = vmloadpc(cl->p, cl->p->code + n);                                                                     \
+        }                                                                                                              \
+    }
+
+#else
+
+#define vmjitcount(ra) ((void) 0)
+#define vmjitloop() ((void) 0)
+
+#endif
+
+#define istracing(L) ((((L)->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) != 0) || G(L)->enablelinestats)
+
+/*
+** opcode dispatch; by default this is a plain switch statement, but compilers
+** that support labels as values can use direct threading via `ljumptab.h'
+*/
+#define vmdispatch(o) switch (o)
+#define vmcase(l) case l:
+#define vmbreak continue
+
+static void checktimeout (lua_State *L, lua_Clock tickstart) {
+    lua_Clock elapsed = (luaG_clocktime(G(L)) - tickstart);
+    L->execcount = L->baseexeccount;
+
+    if (elapsed > L->baseexeclimit) {
+        luaG_runerror(L, "script ran too long");
+    }
+}
+
+/*
+** handle the pending interrupts at a safepoint; returns 0 if a hook yielded
+*/
+static int interrupt (lua_State *L, lua_Clock tickstart) {
+    global_State *g = G(L);
+    int reason = g->interrupt;
+
+    if (reason & LUAI_INTERRUPTRESELECT) {
+        luai_atomicand(&g->interrupt, ~LUAI_INTERRUPTRESELECT); /* caller checks */
+    }
+
+    if (reason & LUAI_INTERRUPTSAMPLE) {
+        luai_atomicand(&g->interrupt, ~LUAI_INTERRUPTSAMPLE);
+        luaG_sample(L);
+    }
+
+    if (L->baseexeccount > 0 && L->execcount <= 0) {
+        checktimeout(L, tickstart);
+    }
+
+    if (reason & LUA_INTERRUPTBREAK) {
+        luai_atomicand(&g->interrupt, ~LUA_INTERRUPTBREAK);
+        luaG_runerror(L, "interrupted!");
+    }
+
+    if ((reason & LUA_INTERRUPTHOOK) && L->allowhook) { /* else deferred until the running hook returns */
+        luai_atomicand(&g->interrupt, ~LUA_INTERRUPTHOOK);
+
+        if (L->hook != NULL) {
             luaG_profileleave(L);
-            traceexec(L, pc);
+            luaD_callhook(L, LUA_HOOKCOUNT, -1);
 
-            if (L->status == LUA_YIELD) { /* did any hook yield? */
-                L->savedpc = pc - 1;
-                return;
+            if (L->status == LUA_YIELD) {
+                return 0;
             }
 
-            base = L->base;
             luaG_profileenter(L);
         }
+    }
 
-        if (L->baseexeccount > 0 && (--L->execcount == 0)) {
-            lua_Clock elapsed = (luaG_clocktime(G(L)) - tickstart);
-            L->execcount = L->baseexeccount;
+    return 1;
+}
 
-            if (elapsed > L->baseexeclimit) {
-                luaG_runerror(L, "script ran too long");
-            }
-        }
+#define VM_TRACEEXEC 0
+#define VM_TAINTMODE LUA_TAINTDISABLED
+#define VM_EXECUTE execute_disabled
+#include "lvmexec.h"
 
-        /* update savedpc for per-op taint logging */
-        L->savedpc = pc;
-
-        /* warning!! several calls may realloc the stack and invalidate `ra' */
-        ra = RA(i);
-        lua_assert(base == L->base && L->base == L->ci->base);
-        lua_assert(base <= L->top && L->top <= L->stack + L->stacksize);
-        lua_assert(L->top == L->ci->top || luaG_checkopenop(i));
-        switch (GET_OPCODE(i)) {
-            case OP_MOVE: {
-                setobjs2s(L, ra, RB(i));
-                continue;
-            }
-            case OP_LOADK: {
-                setobj2s(L, ra, KBx(i));
-                continue;
-            }
-            case OP_LOADBOOL: {
-                setbvalue(L, ra, GETARG_B(i));
-                if (GETARG_C(i)) {
-                    pc++; /* skip next instruction (if C) */
-                }
-                continue;
-            }
-            case OP_LOADNIL: {
-                TValue *rb = RB(i);
-                do {
-                    setnilvalue(L, rb--);
-                } while (rb >= ra);
-                continue;
-            }
-            case OP_GETUPVAL: {
-                int b = GETARG_B(i);
-                setobjuv2s(L, L->ci->func, ra, cl->upvals[b]->v);
-                continue;
-            }
-            case OP_GETGLOBAL: {
-                TValue g;
-                TValue *rb = KBx(i);
-                sethvalue(L, &g, cl->env);
-                lua_assert(ttisstring(rb));
-                Protect(luaV_gettable(L, &g, rb, ra));
-                continue;
-            }
-            case OP_GETTABLE: {
-                Protect(luaV_gettable(L, RB(i), RKC(i), ra));
-                continue;
-            }
-            case OP_SETGLOBAL: {
-                TValue g;
-                sethvalue(L, &g, cl->env);
-                lua_assert(ttisstring(KBx(i)));
-                Protect(luaV_settable(L, &g, KBx(i), ra));
-                continue;
-            }
-            case OP_SETUPVAL: {
-                UpVal *uv = cl->upvals[GETARG_B(i)];
-                setobj2uv(L, L->ci->func, uv->v, ra);
-                luaC_barrier(L, uv, ra);
-                continue;
-            }
-            case OP_SETTABLE: {
-                Protect(luaV_settable(L, ra, RKB(i), RKC(i)));
-                continue;
-            }
-            case OP_NEWTABLE: {
-                int b = GETARG_B(i);
-                int c = GETARG_C(i);
-                sethvalue(L, ra, luaH_new(L, luaO_fb2int(b), luaO_fb2int(c)));
-                Protect(luaC_checkGC(L));
-                continue;
-            }
-            case OP_SELF: {
-                StkId rb = RB(i);
-                setobjs2s(L, ra + 1, rb);
-                Protect(luaV_gettable(L, rb, RKC(i), ra));
-                continue;
-            }
-            case OP_ADD: {
-                arith_op(luai_numadd, TM_ADD);
-                continue;
-            }
-            case OP_SUB: {
-                arith_op(luai_numsub, TM_SUB);
-                continue;
-            }
-            case OP_MUL: {
-                arith_op(luai_nummul, TM_MUL);
-                continue;
-            }
-            case OP_DIV: {
-                checkfp(L, LUA_EXCEPTFPESTRICT, nvalue(RKB(i)), nvalue(RKC(i)));
-                arith_op(luai_numdiv, TM_DIV);
-                continue;
-            }
-            case OP_MOD: {
-                checkfp(L, LUA_EXCEPTFPESTRICT, nvalue(RKB(i)), nvalue(RKC(i)));
-                arith_op(luai_nummod, TM_MOD);
-                continue;
-            }
-            case OP_POW: {
-                arith_op(luai_numpow, TM_POW);
-                continue;
-            }
-            case OP_UNM: {
-                TValue *rb = RB(i);
-                if (ttisnumber(rb)) {
-                    lua_Number nb = nvalue(rb);
-                    setnvalue(L, ra, luai_numunm(nb));
-                } else {
-                    Protect(Arith(L, ra, rb, rb, TM_UNM));
-                }
-                continue;
-            }
-            case OP_NOT: {
-                /* next assignment may change this value */
-                int res = l_isfalse(RB(i));
-                setbvalue(L, ra, res);
-                continue;
-            }
-            case OP_LEN: {
-                const TValue *rb = RB(i);
-                switch (ttype(rb)) {
-                    case LUA_TTABLE: {
-                        setnvalue(L, ra, cast_num(luaH_getn(hvalue(rb))));
-                        break;
-                    }
-                    case LUA_TSTRING: {
-                        setnvalue(L, ra, cast_num(tsvalue(rb)->len));
-                        break;
-                    }
-                    default: { /* try metamethod */
-                        Protect(if (!call_binTM(L, rb, luaO_nilobject, ra, TM_LEN))
-                                    luaG_typeerror(L, rb, "get length of");)
-                    }
-                }
-                continue;
-            }
-            case OP_CONCAT: {
-                int b = GETARG_B(i);
-                int c = GETARG_C(i);
-                Protect(luaV_concat(L, c - b + 1, c); luaC_checkGC(L));
-                setobjs2s(L, RA(i), base + b);
-                continue;
-            }
-            case OP_JMP: {
-                dojump(L, pc, GETARG_sBx(i));
-                continue;
-            }
-            case OP_EQ: {
-                TValue *rb = RKB(i);
-                TValue *rc = RKC(i);
-                Protect(if (equalobj(L, rb, rc) == GETARG_A(i)) dojump(L, pc, GETARG_sBx(*pc));) pc++;
-                continue;
-            }
-            case OP_LT: {
-                Protect(if (luaV_lessthan(L, RKB(i), RKC(i)) == GETARG_A(i)) dojump(L, pc, GETARG_sBx(*pc));) pc++;
-                continue;
-            }
-            case OP_LE: {
-                Protect(if (lessequal(L, RKB(i), RKC(i)) == GETARG_A(i)) dojump(L, pc, GETARG_sBx(*pc));) pc++;
-                continue;
-            }
-            case OP_TEST: {
-                if (l_isfalse(ra) != GETARG_C(i))
-                    dojump(L, pc, GETARG_sBx(*pc));
-                pc++;
-                continue;
-            }
-            case OP_TESTSET: {
-                TValue *rb = RB(i);
-                if (l_isfalse(rb) != GETARG_C(i)) {
-                    setobjs2s(L, ra, rb);
-                    dojump(L, pc, GETARG_sBx(*pc));
-                }
-                pc++;
-                continue;
-            }
-            case OP_CALL: {
-                int b = GETARG_B(i);
-                int nresults = GETARG_C(i) - 1;
-                if (b != 0) {
-                    L->top = ra + b; /* else previous instruction set top */
-                }
-                luaG_profileleave(L);
-                switch (luaD_precall(L, ra, nresults)) {
-                    case PCRLUA: {
-                        nexeccalls++;
-                        /* restart luaV_execute over new Lua function */
-                        goto reentry;
-                    }
-                    case PCRC: {
-                        /* it was a C function (`precall' called it) */
-                        if (nresults >= 0) {
-                            L->top = L->ci->top;
-                        }
-                        base = L->base;
-                        luaG_profileenter(L);
-                        continue;
-                    }
-                    default: {
-                        return; /* yield */
-                    }
-                }
-            }
-            case OP_TAILCALL: {
-                int b = GETARG_B(i);
-                if (b != 0) {
-                    L->top = ra + b; /* else previous instruction set top */
-                }
-                lua_assert(GETARG_C(i) - 1 == LUA_MULTRET);
-                luaG_profileleave(L);
-                switch (luaD_precall(L, ra, LUA_MULTRET)) {
-                    case PCRLUA: {
-                        /* tail call: put new frame in place of previous one */
-                        CallInfo *ci = luaD_unwindci(L, L->ci, L->ci - 1);
-                        int aux;
-                        StkId func = ci->func;
-                        StkId pfunc = (ci + 1)->func; /* previous function index */
-                        if (L->openupval) {
-                            luaF_close(L, ci->base);
-                        }
-                        L->base = ci->base = ci->func + ((ci + 1)->base - pfunc);
-                        for (aux = 0; pfunc + aux < L->top; aux++) { /* move frame down */
-                            setobjs2s(L, func + aux, pfunc + aux);
-                        }
-                        ci->top = L->top = func + aux; /* correct top */
-                        lua_assert(L->top == L->base + clvalue(func)->l.p->maxstacksize);
-                        ci->savedtaint = (ci + 1)->savedtaint;
-                        ci->startticks = (ci + 1)->startticks;
-                        ci->entryticks = (ci + 1)->entryticks;
-                        ci->savedpc = L->savedpc;
-                        ci->tailcalls++; /* one more call lost */
-                        L->ci--; /* remove new frame */
-                        goto reentry;
-                    }
-                    case PCRC: { /* it was a C function (`precall' called it) */
-                        base = L->base;
-                        luaG_profileenter(L);
-                        continue;
-                    }
-                    default: {
-                        return; /* yield */
-                    }
-                }
-            }
-            case OP_RETURN: {
-                int b = GETARG_B(i);
-                if (b != 0) {
-                    L->top = ra + b - 1;
-                }
-                if (L->openupval) {
-                    luaF_close(L, base);
-                }
-                luaG_profileleave(L);
-                b = luaD_poscall(L, ra);
-                if (--nexeccalls == 0) { /* was previous function running `here'? */
-                    return; /* no: return */
-                } else { /* yes: continue its execution */
-                    if (b) {
-                        L->top = L->ci->top;
-                    }
-                    lua_assert(isLua(L->ci));
-                    lua_assert(GET_OPCODE(*((L->ci)->savedpc - 1)) == OP_CALL);
-                    goto reentry;
-                }
-            }
-            case OP_FORLOOP: {
-                lua_Number step = nvalue(ra + 2);
-                lua_Number idx = luai_numadd(nvalue(ra), step); /* increment index */
-                lua_Number limit = nvalue(ra + 1);
-                if (luai_numlt(0, step) ? luai_numle(idx, limit) : luai_numle(limit, idx)) {
-                    dojump(L, pc, GETARG_sBx(i)); /* jump back */
-                    setnvalue(L, ra, idx); /* update internal index... */
-                    setnvalue(L, ra + 3, idx); /* ...and external index */
-                }
-                continue;
-            }
-            case OP_FORPREP: {
-                const TValue *init = ra;
-                const TValue *plimit = ra + 1;
-                const TValue *pstep = ra + 2;
-                if (!tonumber(L, init, ra)) {
-                    luaG_runerror(L, "'for' initial value must be a number");
-                } else if (!tonumber(L, plimit, ra + 1)) {
-                    luaG_runerror(L, "'for' limit must be a number");
-                } else if (!tonumber(L, pstep, ra + 2)) {
-                    luaG_runerror(L, "'for' step must be a number");
-                }
-                setnvalue(L, ra, luai_numsub(nvalue(ra), nvalue(pstep)));
-                dojump(L, pc, GETARG_sBx(i));
-                continue;
-            }
-            case OP_TFORLOOP: {
-                StkId cb = ra + 3; /* call base */
-                setobjs2s(L, cb + 2, ra + 2);
-                setobjs2s(L, cb + 1, ra + 1);
-                setobjs2s(L, cb, ra);
-                L->top = cb + 3; /* func. + 2 args (state and index) */
-                Protect(luaD_call(L, cb, GETARG_C(i)));
-                L->top = L->ci->top;
-                cb = RA(i) + 3; /* previous call may change the stack */
-                if (!ttisnil(cb)) { /* continue loop? */
-                    setobjs2s(L, cb - 1, cb); /* save control variable */
-                    dojump(L, pc, GETARG_sBx(*pc)); /* jump back */
-                }
-                pc++;
-                continue;
-            }
-            case OP_SETLIST: {
-                int n = GETARG_B(i);
-                int c = GETARG_C(i);
-                int last;
-                Table *h;
-                if (n == 0) {
-                    n = cast_int(L->top - ra) - 1;
-                    L->top = L->ci->top;
-                }
-                if (c == 0) {
-                    c = cast_int(*pc++);
-                }
-                runtime_check(L, ttistable(ra));
-                h = hvalue(ra);
-                last = ((c - 1) * LFIELDS_PER_FLUSH) + n;
-                if (last > h->sizearray) { /* needs more space? */
-                    luaH_resizearray(L, h, last); /* pre-alloc it at once */
-                }
-                for (; n > 0; n--) {
-                    TValue key;
-                    TValue *val = ra + n;
-                    rawsetnvalue(&key, n);
-                    setobj2t(L, ra, &key, luaH_setnum(L, h, last--), val);
-                    luaC_barriert(L, h, val);
-                }
-                continue;
-            }
-            case OP_CLOSE: {
-                luaF_close(L, ra);
-                continue;
-            }
-            case OP_CLOSURE: {
-                Proto *p;
-                Closure *ncl;
-                int j;
-                p = cl->p->p[GETARG_Bx(i)];
-                ncl = luaF_newLclosure(L, p, cl->env);
-                for (j = 0; j < p->nups; j++, pc++) {
-                    if (GET_OPCODE(*pc) == OP_GETUPVAL) {
-                        ncl->l.upvals[j] = cl->upvals[GETARG_B(*pc)];
-                    } else {
-                        lua_assert(GET_OPCODE(*pc) == OP_MOVE);
-                        ncl->l.upvals[j] = luaF_findupval(L, base + GETARG_B(*pc));
-                    }
-                }
-                setclvalue(L, ra, ncl);
-                Protect(luaC_checkGC(L));
-                continue;
-            }
-            case OP_VARARG: {
-                int b = GETARG_B(i) - 1;
-                int j;
-                CallInfo *ci = L->ci;
-                int n = cast_int(ci->base - ci->func) - cl->p->numparams - 1;
-                if (b == LUA_MULTRET) {
-                    Protect(luaD_checkstack(L, n));
-                    ra = RA(i); /* previous call may change the stack */
-                    b = n;
-                    L->top = ra + n;
-                }
-                for (j = 0; j < b; j++) {
-                    if (j < n) {
-                        setobjs2s(L, ra + j, ci->base - n + j);
-                    } else {
-                        setnilvalue(L, ra + j);
-                    }
-                }
-                continue;
-            }
-        }
+#if defined(LUA_USE_TAINT)
+
+#define VM_TRACEEXEC 0
+#define VM_TAINTMODE LUA_TAINTRDONLY
+#define VM_EXECUTE execute_rdonly
+#include "lvmexec.h"
+
+#define VM_TRACEEXEC 0
+#define VM_TAINTMODE LUA_TAINTWRONLY
+#define VM_EXECUTE execute_wronly
+#include "lvmexec.h"
+
+#define VM_TRACEEXEC 0
+#define VM_TAINTMODE LUA_TAINTRDRW
+#define VM_EXECUTE execute_rdrw
+#include "lvmexec.h"
+
+#endif
+
+/* instance used while line or count hooks are set; handles any taint mode */
+#define VM_TRACEEXEC 1
+#define VM_TAINTMODE luaR_gettaintmode(L)
+#define VM_EXECUTE execute_traced
+#include "lvmexec.h"
+
+typedef int (*Executor)(lua_State *L, int *pnexeccalls, lua_Clock tickstart, int resume);
+
+/* interpreter instances indexed by taint mode */
+static const Executor executors[] = {
+    execute_disabled,
+#if defined(LUA_USE_TAINT)
+    execute_rdonly,
+    execute_wronly,
+    execute_rdrw,
+#endif
+};
+
+void luaV_execute (lua_State *L, int nexeccalls) {
+    const lua_Clock tickstart = luaG_clocktime(G(L));
+    int resume = 0;
+
+    if (G(L)->enablelinestats) {
+        G(L)->lineticks = tickstart; /* don't attribute time spent outside of Lua */
+    }
+
+    while ((istracing(L) ? execute_traced : executors[luaR_gettaintmode(L)])(L, &nexeccalls, tickstart, resume)) {
+        resume = 1; /* continue from the safepoint in the matching instance */
     }
 }
@@ -0,0 +1,584 @@
+/* Licensed under the terms of the MIT License; see full copyright information
+ * in the "LICENSE" file or at <http://www.lua.org/license.html> */
+
+/*
+** Main interpreter loop. This file is only included by lvm.c, once for each
+** taint mode and once more for running with line or count hooks, with
+** `VM_TAINTMODE' set to the taint mode, `VM_TRACEEXEC' set if hooks must be
+** checked for each instruction and `VM_EXECUTE' set to the name of the
+** function to define.
+**
+** Within an instance the value setters are replaced with variants that take
+** the taint mode as a constant, which removes any taint propagation checks
+** that cannot apply to that mode. If the taint mode or hooks of the thread
+** change while running an instance it returns 1 at the next safepoint and
+** `luaV_execute' continues from there in the matching instance.
+*/
+
+#define setnilvalue(L, obj) setnilvaluem(L, obj, VM_TAINTMODE)
+#define setnvalue(L, obj, x) setnvaluem(L, obj, x, VM_TAINTMODE)
+#define setbvalue(L, obj, x) setbvaluem(L, obj, x, VM_TAINTMODE)
+#define setclvalue(L, obj, x) setclvaluem(L, obj, x, VM_TAINTMODE)
+#define sethvalue(L, obj, x) sethvaluem(L, obj, x, VM_TAINTMODE)
+#define setobj2s(L, obj1, obj2) setobj2sm(L, obj1, obj2, VM_TAINTMODE)
+#define setobjs2s(L, obj1, obj2) setobj2sm(L, obj1, obj2, VM_TAINTMODE)
+#define setobjuv2s(L, func, obj1, obj2) setobj2sm(L, obj1, obj2, VM_TAINTMODE)
+#define luaR_taintstack(L, taint) luaR_taintstackm(L, taint, VM_TAINTMODE)
+
+static int VM_EXECUTE (lua_State *L, int *pnexeccalls, lua_Clock tickstart, int resume) {
+    LClosure *cl;
+    StkId base;
+#if !defined(LUA_USE_PREDECODE)
+    TValue *k; /* constants are resolved in advance otherwise */
+#endif
+    const VMInstruction *pc;
+    Instruction i;
+    StkId ra;
+    int nexeccalls = *pnexeccalls;
+reentry: /* entry point */
+    lua_assert(isLua(L->ci));
+    cl = &clvalue(L->ci->func)->l;
+    pc = vmloadpc(cl->p, L->savedpc);
+    base = L->base;
+#if !defined(LUA_USE_PREDECODE)
+    k = cl->p->k;
+#endif
+
+#if defined(LUA_USE_COMPUTED_GOTO) && defined(__GNUC__)
+#include "ljumptab.h"
+#endif
+
+    if (resume) { /* continue from a safepoint reached by another instance */
+        resume = 0;
+    } else {
+        /* propagate closure taint upon (re)entering a lua stack frame */
+        luaR_setfixedtaint(L, 0);
+        luaR_taintstack(L, luaR_getobjecttaint(obj2gco(cl)));
+        luaR_setfixedtaint(L, luaR_getobjecttaint(obj2gco(cl)));
+
+        luaG_profileenter(L);
+        vmsafepoint(vmsavedpc(pc));
+    }
+
+    /* main loop of interpreter */
+    for (;;) {
+        vmfetch();
+        vmdispatch (GET_OPCODE(i)) {
+            vmcase(OP_MOVE) {
+                setobjs2s(L, ra, RB(i));
+                vmbreak;
+            }
+            vmcase(OP_LOADK) {
+                setobj2s(L, ra, KBx(i));
+                vmbreak;
+            }
+            vmcase(OP_LOADBOOL) {
+                setbvalue(L, ra, GETARG_B(i));
+                if (GETARG_C(i)) {
+                    pc++; /* skip next instruction (if C) */
+                }
+                vmbreak;
+            }
+            vmcase(OP_LOADNIL) {
+                TValue *rb = RB(i);
+                do {
+                    setnilvalue(L, rb--);
+                } while (rb >= ra);
+                vmbreak;
+            }
+            vmcase(OP_GETUPVAL) {
+                int b = GETARG_B(i);
+                setobjuv2s(L, L->ci->func, ra, cl->upvals[b]->v);
+                vmbreak;
+            }
+            vmcase(OP_GETGLOBAL) {
+                TValue g;
+                TValue *rb = KBx(i);
+                sethvalue(L, &g, cl->env);
+                lua_assert(ttisstring(rb));
+                Protect(gettablecached(L, &g, rb, ra, ICACHE()));
+                vmbreak;
+            }
+            vmcase(OP_GETTABLE) {
+                TValue *rc;
+            fusedgettable:
+                rc = RKC(i);
+                if (ttisstring(rc)) {
+                    Protect(gettablecached(L, RB(i), rc, ra, ICACHE()));
+                } else {
+                    Protect(luaV_gettable(L, RB(i), rc, ra));
+                }
+                vmbreak;
+            }
+            vmcase(OP_SETGLOBAL) {
+                TValue g;
+                sethvalue(L, &g, cl->env);
+                lua_assert(ttisstring(KBx(i)));
+                Protect(settablecached(L, &g, KBx(i), ra, ICACHE()));
+                vmbreak;
+            }
+            vmcase(OP_SETUPVAL) {
+                UpVal *uv = cl->upvals[GETARG_B(i)];
+                setobj2uv(L, L->ci->func, uv->v, ra);
+                luaC_barrier(L, uv, ra);
+                vmbreak;
+            }
+            vmcase(OP_SETTABLE) {
+                TValue *rb = RKB(i);
+                if (ttisstring(rb)) {
+                    Protect(settablecached(L, ra, rb, RKC(i), ICACHE()));
+                } else {
+                    Protect(luaV_settable(L, ra, rb, RKC(i)));
+                }
+                vmbreak;
+            }
+            vmcase(OP_NEWTABLE) {
+                int b = GETARG_B(i);
+                int c = GETARG_C(i);
+                sethvalue(L, ra, luaH_new(L, luaO_fb2int(b), luaO_fb2int(c)));
+                Protect(luaC_checkGC(L));
+                vmbreak;
+            }
+            vmcase(OP_SELF) {
+                StkId rb = RB(i);
+                TValue *rc = RKC(i);
+                setobjs2s(L, ra + 1, rb);
+                if (ttisstring(rc)) {
+                    Protect(gettablecached(L, rb, rc, ra, ICACHE()));
+                } else {
+                    Protect(luaV_gettable(L, rb, rc, ra));
+                }
+                vmbreak;
+            }
+            vmcase(OP_ADD) {
+                arith_op(luai_numadd, TM_ADD, OP_ADDNN);
+                vmbreak;
+            }
+            vmcase(OP_SUB) {
+                arith_op(luai_numsub, TM_SUB, OP_SUBNN);
+                vmbreak;
+            }
+            vmcase(OP_MUL) {
+                arith_op(luai_nummul, TM_MUL, OP_MULNN);
+                vmbreak;
+            }
+            vmcase(OP_DIV) {
+                checkfp(L, LUA_EXCEPTFPESTRICT, nvalue(RKB(i)), nvalue(RKC(i)));
+                arith_op(luai_numdiv, TM_DIV, OP_DIVNN);
+                vmbreak;
+            }
+            vmcase(OP_MOD) {
+                checkfp(L, LUA_EXCEPTFPESTRICT, nvalue(RKB(i)), nvalue(RKC(i)));
+                arith_op(luai_nummod, TM_MOD, OP_MODNN);
+                vmbreak;
+            }
+            vmcase(OP_POW) {
+                arith_op(luai_numpow, TM_POW, OP_POWNN);
+                vmbreak;
+            }
+            vmcase(OP_UNM) {
+                TValue *rb = RB(i);
+                if (ttisnumber(rb)) {
+                    lua_Number nb = nvalue(rb);
+                    vmrewrite(OP_UNMN);
+                    setnvalue(L, ra, luai_numunm(nb));
+                } else {
+                    Protect(Arith(L, ra, rb, rb, TM_UNM));
+                }
+                vmbreak;
+            }
+            vmcase(OP_NOT) {
+                /* next assignment may change this value */
+                int res = l_isfalse(RB(i));
+                setbvalue(L, ra, res);
+                vmbreak;
+            }
+            vmcase(OP_LEN) {
+                const TValue *rb = RB(i);
+                switch (ttype(rb)) {
+                    case LUA_TTABLE: {
+                        setnvalue(L, ra, cast_num(luaH_getn(hvalue(rb))));
+                        break;
+                    }
+                    case LUA_TSTRING: {
+                        setnvalue(L, ra, cast_num(tsvalue(rb)->len));
+                        break;
+                    }
+                    default: { /* try metamethod */
+                        Protect(if (!call_binTM(L, rb, luaO_nilobject, ra, TM_LEN))
+                                    luaG_typeerror(L, rb, "get length of");)
+                    }
+                }
+                vmbreak;
+            }
+            vmcase(OP_CONCAT) {
+                int b = GETARG_B(i);
+                int c = GETARG_C(i);
+                ProtectNoSwitch(luaV_concat(L, c - b + 1, c); luaC_checkGC(L));
+                setobjs2s(L, RA(i), base + b);
+                vmtaintswitch();
+                vmbreak;
+            }
+            vmcase(OP_JMP) {
+                vmjump(L, pc, i);
+                if (GETARG_sBx(i) < 0) {
+                    vmsafepoint(L->savedpc);
+                }
+                vmbreak;
+            }
+            vmcase(OP_EQ) {
+                comp_op(luai_numeq, equalobj, OP_EQNUM);
+                vmbreak;
+            }
+            vmcase(OP_LT) {
+                comp_op(luai_numlt, luaV_lessthan, OP_LTNUM);
+                vmbreak;
+            }
+            vmcase(OP_LE) {
+                comp_op(luai_numle, lessequal, OP_LENUM);
+                vmbreak;
+            }
+            vmcase(OP_TEST) {
+            fusedtest:
+                if (l_isfalse(ra) != GETARG_C(i)) {
+                    condjump(L, pc);
+                } else {
+                    pc++;
+                }
+                vmbreak;
+            }
+            vmcase(OP_TESTSET) {
+                TValue *rb = RB(i);
+                if (l_isfalse(rb) != GETARG_C(i)) {
+                    setobjs2s(L, ra, rb);
+                    condjump(L, pc);
+                } else {
+                    pc++;
+                }
+                vmbreak;
+            }
+            vmcase(OP_CALL) {
+                int b;
+                int nresults;
+            fusedcall:
+                b = GETARG_B(i);
+                nresults = GETARG_C(i) - 1;
+                if (b != 0) {
+                    L->top = ra + b; /* else previous instruction set top */
+                }
+                luaG_profileleave(L);
+                switch (luaD_precall(L, ra, nresults)) {
+                    case PCRLUA: {
+                        nexeccalls++;
+                        /* restart luaV_execute over new Lua function */
+                        goto reentry;
+                    }
+                    case PCRC: {
+                        /* it was a C function (`precall' called it) */
+                        if (nresults >= 0) {
+                            L->top = L->ci->top;
+                        }
+                        base = L->base;
+                        luaG_profileenter(L);
+                        vmsafepoint(vmsavedpc(pc));
+                        vmbreak;
+                    }
+                    default: {
+                        return 0; /* yield */
+                    }
+                }
+            }
+            vmcase(OP_TAILCALL) {
+                int b = GETARG_B(i);
+                if (b != 0) {
+                    L->top = ra + b; /* else previous instruction set top */
+                }
+                lua_assert(GETARG_C(i) - 1 == LUA_MULTRET);
+                luaG_profileleave(L);
+                switch (luaD_precall(L, ra, LUA_MULTRET)) {
+                    case PCRLUA: {
+                        /* tail call: put new frame in place of previous one */
+                        CallInfo *ci = luaD_unwindci(L, L->ci, L->ci - 1);
+                        int aux;
+                        StkId func = ci->func;
+                        StkId pfunc = (ci + 1)->func; /* previous function index */
+                        if (L->openupval) {
+                            luaF_close(L, ci->base);
+                        }
+                        L->base = ci->base = ci->func + ((ci + 1)->base - pfunc);
+                        for (aux = 0; pfunc + aux < L->top; aux++) { /* move frame down */
+                            setobjs2s(L, func + aux, pfunc + aux);
+                        }
+                        ci->top = L->top = func + aux; /* correct top */
+                        lua_assert(L->top == L->base + clvalue(func)->l.p->maxstacksize);
+                        luaR_setcalltaint(ci, luaR_getcalltaint(ci + 1));
+                        ci->startticks = (ci + 1)->startticks;
+                        ci->entryticks = (ci + 1)->entryticks;
+                        ci->stats = (ci + 1)->stats;
+                        ci->savedpc = L->savedpc;
+                        ci->tailcalls++; /* one more call lost */
+                        L->ci--; /* remove new frame */
+                        goto reentry;
+                    }
+                    case PCRC: { /* it was a C function (`precall' called it) */
+                        base = L->base;
+                        luaG_profileenter(L);
+                        vmsafepoint(vmsavedpc(pc));
+                        vmbreak;
+                    }
+                    default: {
+                        return 0; /* yield */
+                    }
+                }
+            }
+            vmcase(OP_RETURN) {
+                int b = GETARG_B(i);
+                if (b != 0) {
+                    L->top = ra + b - 1;
+                }
+                if (L->openupval) {
+                    luaF_close(L, base);
+                }
+                luaG_profileleave(L);
+                b = luaD_poscall(L, ra);
+                if (--nexeccalls == 0) { /* was previous function running `here'? */
+                    return 0; /* no: return */
+                } else { /* yes: continue its execution */
+                    if (b) {
+                        L->top = L->ci->top;
+                    }
+                    lua_assert(isLua(L->ci));
+                    lua_assert(GET_OPCODE(*((L->ci)->savedpc - 1)) == OP_CALL);
+                    goto reentry;
+                }
+            }
+            vmcase(OP_FORLOOP) {
+                lua_Number step = nvalue(ra + 2);
+                lua_Number idx = luai_numadd(nvalue(ra), step); /* increment index */
+                lua_Number limit = nvalue(ra + 1);
+                if (luai_numlt(0, step) ? luai_numle(idx, limit) : luai_numle(limit, idx)) {
+                    vmjump(L, pc, i); /* jump back */
+                    setnvalue(L, ra, idx); /* update internal index... */
+                    setnvalue(L, ra + 3, idx); /* ...and external index */
+                    vmsafepoint(L->savedpc);
+                    vmjitloop();
+                }
+                vmbreak;
+            }
+            vmcase(OP_FORPREP) {
+                const TValue *init = ra;
+                const TValue *plimit = ra + 1;
+                const TValue *pstep = ra + 2;
+                if (!tonumber(L, init, ra)) {
+                    luaG_runerror(L, "'for' initial value must be a number");
+                } else if (!tonumber(L, plimit, ra + 1)) {
+                    luaG_runerror(L, "'for' limit must be a number");
+                } else if (!tonumber(L, pstep, ra + 2)) {
+                    luaG_runerror(L, "'for' step must be a number");
+                }
+                setnvalue(L, ra, luai_numsub(nvalue(ra), nvalue(pstep)));
+                vmjump(L, pc, i);
+                vmjitcount(ra);
+                vmjitloop();
+                vmbreak;
+            }
+            vmcase(OP_TFORLOOP) {
+                StkId cb = ra + 3; /* call base */
+                setobjs2s(L, cb + 2, ra + 2);
+                setobjs2s(L, cb + 1, ra + 1);
+                setobjs2s(L, cb, ra);
+                L->top = cb + 3; /* func. + 2 args (state and index) */
+                ProtectNoSwitch(luaD_call(L, cb, GETARG_C(i))); /* checked at the safepoint below */
+                L->top = L->ci->top;
+                cb = RA(i) + 3; /* previous call may change the stack */
+                if (!ttisnil(cb)) { /* continue loop? */
+                    setobjs2s(L, cb - 1, cb); /* save control variable */
+                    vmjumpnext(L, pc); /* jump back */
+                } else {
+                    pc++;
+                }
+                vmsafepoint(L->savedpc);
+                vmbreak;
+            }
+            vmcase(OP_SETLIST) {
+                int n = GETARG_B(i);
+                int c = GETARG_C(i);
+                int last;
+                Table *h;
+                if (n == 0) {
+                    n = cast_int(L->top - ra) - 1;
+                    L->top = L->ci->top;
+                }
+                if (c == 0) {
+                    c = cast_int(vminstr(pc));
+                    pc++;
+                }
+                runtime_check(L, ttistable(ra));
+                h = hvalue(ra);
+                last = ((c - 1) * LFIELDS_PER_FLUSH) + n;
+                if (last > h->sizearray) { /* needs more space? */
+                    luaH_resizearray(L, h, last); /* pre-alloc it at once */
+                }
+                for (; n > 0; n--) {
+                    TValue key;
+                    TValue *val = ra + n;
+                    rawsetnvalue(&key, n);
+                    setobj2t(L, ra, &key, luaH_setnum(L, h, last--), val);
+                    luaC_barriert(L, h, val);
+                }
+                vmbreak;
+            }
+            vmcase(OP_CLOSE) {
+                luaF_close(L, ra);
+                vmbreak;
+            }
+            vmcase(OP_CLOSURE) {
+                Proto *p;
+                Closure *ncl;
+                int j;
+                p = cl->p->p[GETARG_Bx(i)];
+                ncl = luaF_newLclosure(L, p, cl->env);
+                for (j = 0; j < p->nups; j++, pc++) {
+                    Instruction u = vminstr(pc);
+                    if (GET_OPCODE(u) == OP_GETUPVAL) {
+                        ncl->l.upvals[j] = cl->upvals[GETARG_B(u)];
+                    } else {
+                        lua_assert(GET_OPCODE(u) == OP_MOVE);
+                        ncl->l.upvals[j] = luaF_findupval(L, base + GETARG_B(u));
+                    }
+                }
+                setclvalue(L, ra, ncl);
+                Protect(luaC_checkGC(L));
+                vmbreak;
+            }
+            vmcase(OP_VARARG) {
+                int b = GETARG_B(i) - 1;
+                int j;
+                CallInfo *ci = L->ci;
+                int n = cast_int(ci->base - ci->func) - cl->p->numparams - 1;
+                if (b == LUA_MULTRET) {
+                    ProtectNoSwitch(luaD_checkstack(L, n));
+                    ra = RA(i); /* previous call may change the stack */
+                    b = n;
+                    L->top = ra + n;
+                }
+                for (j = 0; j < b; j++) {
+                    if (j < n) {
+                        setobjs2s(L, ra + j, ci->base - n + j);
+                    } else {
+                        setnilvalue(L, ra + j);
+                    }
+                }
+                vmbreak;
+            }
+            vmcase(OP_GETGLOBALTABLE) {
+                TValue g;
+                TValue *rb = KBx(i);
+                sethvalue(L, &g, cl->env);
+                lua_assert(ttisstring(rb));
+                Protect(gettablecached(L, &g, rb, ra, ICACHE()));
+                vmfuse(fusedgettable);
+                vmbreak;
+            }
+            vmcase(OP_GETGLOBALCALL) {
+                TValue g;
+                TValue *rb = KBx(i);
+                sethvalue(L, &g, cl->env);
+                lua_assert(ttisstring(rb));
+                Protect(gettablecached(L, &g, rb, ra, ICACHE()));
+                vmfuse(fusedcall);
+                vmbreak;
+            }
+            vmcase(OP_GETTABLETEST) {
+                TValue *rc = RKC(i);
+                if (ttisstring(rc)) {
+                    Protect(gettablecached(L, RB(i), rc, ra, ICACHE()));
+                } else {
+                    Protect(luaV_gettable(L, RB(i), rc, ra));
+                }
+                vmfuse(fusedtest);
+                vmbreak;
+            }
+            vmcase(OP_SELFCALL) {
+                StkId rb = RB(i);
+                TValue *rc = RKC(i);
+                setobjs2s(L, ra + 1, rb);
+                if (ttisstring(rc)) {
+                    Protect(gettablecached(L, rb, rc, ra, ICACHE()));
+                } else {
+                    Protect(luaV_gettable(L, rb, rc, ra));
+                }
+                vmfuse(fusedcall);
+                vmbreak;
+            }
+            vmcase(OP_LOADKCALL) {
+                setobj2s(L, ra, KBx(i));
+                vmfuse(fusedcall);
+                vmbreak;
+            }
+            vmcase(OP_ADDNN) {
+                arith_opnn(luai_numadd, TM_ADD, OP_ADD);
+                vmbreak;
+            }
+            vmcase(OP_SUBNN) {
+                arith_opnn(luai_numsub, TM_SUB, OP_SUB);
+                vmbreak;
+            }
+            vmcase(OP_MULNN) {
+                arith_opnn(luai_nummul, TM_MUL, OP_MUL);
+                vmbreak;
+            }
+            vmcase(OP_DIVNN) {
+                checkfp(L, LUA_EXCEPTFPESTRICT, nvalue(RKB(i)), nvalue(RKC(i)));
+                arith_opnn(luai_numdiv, TM_DIV, OP_DIV);
+                vmbreak;
+            }
+            vmcase(OP_MODNN) {
+                checkfp(L, LUA_EXCEPTFPESTRICT, nvalue(RKB(i)), nvalue(RKC(i)));
+                arith_opnn(luai_nummod, TM_MOD, OP_MOD);
+                vmbreak;
+            }
+            vmcase(OP_POWNN) {
+                arith_opnn(luai_numpow, TM_POW, OP_POW);
+                vmbreak;
+            }
+            vmcase(OP_UNMN) {
+                TValue *rb = RB(i);
+                if (ttisnumber(rb)) {
+                    lua_Number nb = nvalue(rb);
+                    setnvalue(L, ra, luai_numunm(nb));
+                } else {
+                    vmrewrite(OP_UNM);
+                    Protect(Arith(L, ra, rb, rb, TM_UNM));
+                }
+                vmbreak;
+            }
+            vmcase(OP_EQNUM) {
+                comp_opnn(luai_numeq, equalobj, OP_EQ);
+                vmbreak;
+            }
+            vmcase(OP_LTNUM) {
+                comp_opnn(luai_numlt, luaV_lessthan, OP_LT);
+                vmbreak;
+            }
+            vmcase(OP_LENUM) {
+                comp_opnn(luai_numle, lessequal, OP_LE);
+                vmbreak;
+            }
+        }
+    }
+}
+
+#undef setnilvalue
+#undef setnvalue
+#undef setbvalue
+#undef setclvalue
+#undef sethvalue
+#undef setobj2s
+#undef setobjs2s
+#undef setobjuv2s
+#undef luaR_taintstack
+
+#undef VM_TAINTMODE
+#undef VM_EXECUTE
+#undef VM_TRACEEXEC
@@ -25,6 +25,8 @@ static lua_State *globalL = NULL;
 
 static const char *progname = LUA_PROGNAME;
 
+static const char *tracename = NULL; /* file written with the timeline trace */
+
 LUALIB_API int luaL_readline (lua_State *L, const char *prompt);
 LUALIB_API void luaL_saveline (lua_State *L, const char *line);
 LUALIB_API void luaL_setreadlinename (lua_State *L, const char *name);
@@ -53,25 +55,15 @@ static int stdinistty (lua_State *L) {
 #endif
 }
 
-/*
-** Hook set by signal function to stop the interpreter.
-*/
-static void lstop (lua_State *L, lua_Debug *ar) {
-    (void) ar; /* unused arg. */
-    lua_sethook(L, NULL, 0, 0); /* reset hook */
-    luaL_error(L, "interrupted!");
-}
-
 /*
 ** Function to be called at a C signal. Because a C signal cannot
 ** just change a Lua state (as there is no proper synchronization),
-** this function only sets a hook that, when called, will stop the
-** interpreter.
+** this function only raises an interrupt that the interpreter will
+** service at its next safepoint.
 */
 static void laction (int i) {
-    int flag = LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE | LUA_MASKCOUNT;
     setsignal(i, SIG_DFL); /* if another SIGINT happens, terminate process */
-    lua_sethook(globalL, lstop, flag, 1);
+    lua_interrupt(globalL, LUA_INTERRUPTBREAK);
 }
 
 static void print_usage (const char *badoption) {
@@ -89,6 +81,7 @@ static void print_usage (const char *badoption) {
         "  -l name    require library 'name'\n"
         "  -i         enter interactive mode after executing 'script'\n"
         "  -p         enable profiling and statistics collection\n"
+        "  -R file    record a timeline trace and write it to 'file' on exit\n"
         "  -t         load and execute scripts insecurely\n"
         "  -v         show version information\n"
         "  -E         ignore environment variables\n"
@@ -355,7 +348,8 @@ static int collectargs (char **argv, int *first) {
             case 'L':
                 args |= has_L;
                 goto check_has_argument;
-            case 'l': /* all three options need an argument */
+            case 'R':
+            case 'l': /* all four options need an argument */
             check_has_argument:
                 if (argv[i][2] == '\0') { /* no concatenated argument? */
                     i++; /* try next 'argv' */
@@ -385,7 +379,7 @@ static int libargs (lua_State *L, char **argv, int n) {
 
         lua_assert(argv[i][0] == '-'); /* already checked */
 
-        if (option == 'L' || option == 'e' || option == 'l') {
+        if (option == 'L' || option == 'R' || option == 'e' || option == 'l') {
             extra = argv[i] + 2; /* all options need an argument */
 
             if (*extra == '\0') {
@@ -422,7 +416,7 @@ static int libargs (lua_State *L, char **argv, int n) {
 }
 
 /*
-** Processes options 'e', 'l', and 't', which involve running Lua code.
+** Processes options 'e', 'l', 'R' and 't', which involve running Lua code.
 ** Returns 0 if some code raises an error.
 */
 static int runargs (lua_State *L, char **argv, int n) {
@@ -432,6 +426,7 @@ static int runargs (lua_State *L, char **argv, int n) {
         lua_assert(argv[i][0] == '-'); /* already checked */
         switch (option) {
             case 'L':
+            case 'R':
             case 'e':
             case 'l': {
                 int status;
@@ -444,6 +439,10 @@ static int runargs (lua_State *L, char **argv, int n) {
                     status = dostring(L, extra, "=(command line)");
                 } else if (option == 'l') {
                     status = dolibrary(L, extra);
+                } else if (option == 'R') {
+                    tracename = extra;
+                    lua_starttracing(L, 0);
+                    status = LUA_OK;
                 } else {
                     status = LUA_OK; /* ignored argument ('-L') */
                 }
@@ -697,6 +696,27 @@ static int pmain (lua_State *L) {
     return 1;
 }
 
+static int writetrace (lua_State *L, const void *p, size_t sz, void *ud) {
+    lua_unused(L);
+    return (fwrite(p, 1, sz, (FILE *) ud) != sz);
+}
+
+/*
+** Writes the timeline trace started by option 'R'
+*/
+static void dumptrace (lua_State *L) {
+    FILE *f = fopen(tracename, "wb");
+    int status;
+    if (f == NULL) {
+        l_message(progname, "cannot open trace file");
+        return;
+    }
+    status = lua_stoptracing(L, writetrace, f);
+    if (fclose(f) != 0 || status != 0) {
+        l_message(progname, "cannot write trace file");
+    }
+}
+
 int main (int argc, char **argv) {
     int status;
     int result;
@@ -711,6 +731,9 @@ int main (int argc, char **argv) {
     status = lua_pcall(L, 2, 1, 0); /* do the call */
     result = lua_toboolean(L, -1); /* get result */
     report(L, status);
+    if (tracename != NULL) {
+        dumptrace(L);
+    }
     lua_close(L);
     return (result && status == LUA_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -380,7 +380,7 @@ static void printcode (const Proto *f) {
                 break;
         }
 
-        switch (o) {
+        switch (GET_GENERICOP(i)) { /* superinstructions as their first part */
             case OP_LOADK:
                 printf("\t; ");
                 printconstant(f, bx);
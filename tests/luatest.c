@@ -11,6 +11,7 @@
 #include "lualib.h"
 
 #include <acutest.h>
+#include <string.h>
 
 static int luatest_panichandler (lua_State *L) {
     acutest_check_(0, __FILE__, __LINE__, "lua panic");
@@ -28,6 +29,43 @@ static lua_State *luatest_newstate (void) {
     return L;
 }
 
+static int luatest_errorhandler (lua_State *L) {
+    acutest_check_(0, __FILE__, __LINE__, "error handler");
+    luaL_traceback(L, L, lua_tostring(L, 1), 2);
+    acutest_message_("%s", lua_tostring(L, -1));
+    return 0;
+}
+
+static int luatest_case (lua_State *L) {
+    acutest_case_("%s", luaL_checkstring(L, 1));
+    lua_pushcclosure(L, &luatest_errorhandler, 0);
+    lua_replace(L, LUA_ERRORHANDLERINDEX);
+    luaL_securecall(L, 0, 0, LUA_ERRORHANDLERINDEX);
+    return 0;
+}
+
+/* cases that observe taint propagation can't pass without taint support */
+static int luatest_taintcase (lua_State *L) {
+#if defined(LUA_USE_TAINT)
+    return luatest_case(L);
+#else
+    acutest_case_("%s (skipped: built without taint support)", luaL_checkstring(L, 1));
+    return 0;
+#endif
+}
+
+/* registers the case functions and runs a file of scripted test cases */
+static void luatest_dofile (lua_State *L, const char *filename) {
+    lua_pushcclosure(L, &luatest_case, 0);
+    lua_setfield(L, LUA_GLOBALSINDEX, "case");
+    lua_pushcclosure(L, &luatest_taintcase, 0);
+    lua_setfield(L, LUA_GLOBALSINDEX, "taintcase");
+
+    if (!TEST_CHECK((luaL_dofile(L, filename) == 0))) {
+        TEST_MSG("%s", (luaL_optstring(L, -1, "<unknown script error>")));
+    }
+}
+
 /*
 ** C API Test Cases
 */
@@ -45,6 +83,7 @@ static void test_protecttaint_secure_normal (void) {
     lua_close(L);
 }
 
+#if defined(LUA_USE_TAINT)
 static void test_protecttaint_tainted_normal (void) {
     lua_State *L = luatest_newstate();
     lua_protecttaint(L, &f_protecttaint_normal, LUA_FORCEINSECURE_TAINT);
@@ -52,6 +91,7 @@ static void test_protecttaint_tainted_normal (void) {
     TEST_CHECK((!luaL_issecurevalue(L, -1)));
     lua_close(L);
 }
+#endif
 
 static void f_protecttaint_error (lua_State *L, void *ud) {
     lua_setstacktaint(L, (const char *) ud);
@@ -74,6 +114,7 @@ static void test_protecttaint_secure_error (void) {
     lua_close(L);
 }
 
+#if defined(LUA_USE_TAINT)
 static void test_protecttaint_tainted_error (void) {
     int status;
 
@@ -84,68 +125,356 @@ static void test_protecttaint_tainted_error (void) {
     TEST_CHECK((!luaL_issecure(L)));
     lua_close(L);
 }
+#endif
 
 /*
-** Scripted Test Cases
+** Interrupt Test Cases
 */
 
-static int luatest_errorhandler (lua_State *L) {
-    acutest_check_(0, __FILE__, __LINE__, "error handler");
-    luaL_traceback(L, L, lua_tostring(L, 1), 2);
-    acutest_message_("%s", lua_tostring(L, -1));
+static int f_interrupt_break (lua_State *L) {
+    lua_interrupt(L, LUA_INTERRUPTBREAK);
     return 0;
 }
 
-static int luatest_case (lua_State *L) {
-    acutest_case_("%s", luaL_checkstring(L, 1));
-    lua_pushcclosure(L, &luatest_errorhandler, 0);
-    lua_replace(L, LUA_ERRORHANDLERINDEX);
-    luaL_securecall(L, 0, 0, LUA_ERRORHANDLERINDEX);
+static void test_interrupt_break_loop (void) {
+    int status;
+
+    lua_State *L = luatest_newstate();
+    lua_pushcclosure(L, &f_interrupt_break, 0);
+    lua_setfield(L, LUA_GLOBALSINDEX, "brk");
+    status = luaL_dostring(L, "brk() while true do end");
+    TEST_CHECK((status != 0));
+    TEST_CHECK((strstr(luaL_optstring(L, -1, ""), "interrupted!") != NULL));
+    lua_close(L);
+}
+
+static void test_interrupt_break_cleared (void) {
+    int status;
+
+    lua_State *L = luatest_newstate();
+    lua_pushcclosure(L, &f_interrupt_break, 0);
+    lua_setfield(L, LUA_GLOBALSINDEX, "brk");
+    (void) luaL_dostring(L, "brk() for i = 1, 10 do end");
+    lua_settop(L, 0);
+    status = luaL_dostring(L, "for i = 1, 10 do end");
+    TEST_CHECK((status == 0));
+    lua_close(L);
+}
+
+static int interrupthookcount;
+
+static void f_interrupt_hook (lua_State *L, lua_Debug *ar) {
+    (void) L;
+    interrupthookcount += (ar->event == LUA_HOOKCOUNT);
+}
+
+static int f_interrupt_raisehook (lua_State *L) {
+    lua_interrupt(L, LUA_INTERRUPTHOOK);
     return 0;
 }
 
-static void test_scriptcases (void) {
+static void test_interrupt_hook (void) {
     lua_State *L = luatest_newstate();
-    luaL_openlibsx(L, LUALIB_ELUNE);
+    interrupthookcount = 0;
+    lua_sethook(L, &f_interrupt_hook, LUA_MASKCALL, 0);
+    lua_pushcclosure(L, &f_interrupt_raisehook, 0);
+    lua_setfield(L, LUA_GLOBALSINDEX, "raise");
+    TEST_CHECK((luaL_dostring(L, "raise() for i = 1, 10 do end") == 0));
+    TEST_CHECK((interrupthookcount == 1));
+    lua_close(L);
+}
 
-    /* Add custom test case registration function to environment. */
-    lua_pushcclosure(L, &luatest_case, 0);
-    lua_setfield(L, LUA_GLOBALSINDEX, "case");
+static void test_interrupt_timeout (void) {
+    static const char *const scripts[] = {
+        "while true do end",
+        "repeat until false",
+        "for i = 1, math.huge do end",
+        "local function f() return f() end f()",
+        "local x = {} repeat x.y = not x.y until x.z",
+    };
+
+    size_t i;
+
+    for (i = 0; i < sizeof(scripts) / sizeof(scripts[0]); ++i) {
+        lua_ScriptTimeout timeout;
+        lua_State *L = luatest_newstate();
+        luaL_openlibs(L);
+        timeout.ticks = lua_clockrate(L) / 20; /* 50ms */
+        timeout.safepoints = 1000;
+        lua_setscripttimeout(L, &timeout);
+        acutest_case_("%s", scripts[i]);
+        TEST_CHECK((luaL_dostring(L, scripts[i]) != 0));
+        TEST_CHECK((strstr(luaL_optstring(L, -1, ""), "script ran too long") != NULL));
+        lua_close(L);
+    }
+}
 
-    if (!TEST_CHECK((luaL_dofile(L, "luatest_scriptcases.lua") == 0))) {
+#if defined(LUA_USE_TAINT)
+static int luatest_enabletaint (lua_State *L) {
+    lua_settaintmode(L, LUA_TAINTRDRW);
+    return 0;
+}
+
+static void test_interrupt_taintmode (void) {
+    lua_State *L = luatest_newstate();
+    luaL_openlibs(L);
+    lua_settaintmode(L, LUA_TAINTDISABLED);
+    lua_register(L, "enabletaint", luatest_enabletaint);
+    lua_setstacktaint(L, LUA_FORCEINSECURE_TAINT);
+    /* the mode changes within a metamethod and must apply to the next instruction, which is not a safepoint */
+    if (!TEST_CHECK((luaL_dostring(L, "local t = setmetatable({}, { __index = function() enabletaint() end })\n"
+                                      "local _, v = t.x, {}\n"
+                                      "result = v\n") == 0))) {
         TEST_MSG("%s", (luaL_optstring(L, -1, "<unknown script error>")));
     }
+    lua_setstacktaint(L, NULL);
+    lua_getglobal(L, "result");
+    TEST_CHECK((!luaL_issecurevalue(L, -1)));
+    lua_close(L);
+}
+#endif
 
+/*
+** Compiled Loop Test Cases
+*/
+
+static void test_compiledloops (void) {
+    lua_ScriptTimeout timeout;
+    lua_State *L = luatest_newstate();
+    lua_settaintmode(L, LUA_TAINTDISABLED); /* compiled loops only run with taint disabled */
+    luaL_openlibs(L);
+    timeout.ticks = lua_clockrate(L) / 20; /* 50ms */
+    timeout.safepoints = 1000;
+    lua_setscripttimeout(L, &timeout);
+    TEST_CHECK((luaL_dostring(L, "local s = 0 for i = 1, math.huge do s = s + i end") != 0));
+    TEST_CHECK((strstr(luaL_optstring(L, -1, ""), "script ran too long") != NULL));
     lua_close(L);
 }
 
-static void test_coroutinescriptcases (void) {
+/*
+** Garbage Collector Test Cases
+*/
+
+static void test_steptimegc (void) {
     lua_State *L = luatest_newstate();
+    int kbytes;
+    int steps = 0;
     luaL_openlibs(L);
+    lua_gc(L, LUA_GCSTOP, 0);
+    TEST_CHECK(luaL_dostring(L, "local t = {} for i = 1, 200000 do t[i] = {} end t = nil") == 0);
+    kbytes = lua_gc(L, LUA_GCCOUNT, 0);
+    while (lua_gc(L, LUA_GCSTEPTIME, 100) == 0) {
+        steps++;
+    }
+    TEST_CHECK(steps > 0);
+    TEST_CHECK(lua_gc(L, LUA_GCCOUNT, 0) < kbytes / 2);
+    /* the collector was stopped and must stay stopped */
+    kbytes = lua_gc(L, LUA_GCCOUNT, 0);
+    TEST_CHECK(luaL_dostring(L, "garbage = {} for i = 1, 200000 do garbage[i] = {} end garbage = nil") == 0);
+    TEST_CHECK(lua_gc(L, LUA_GCCOUNT, 0) > kbytes + 4096);
+    TEST_CHECK(lua_gc(L, LUA_GCSTEPTIME, -1) == 0); /* a negative budget runs a single step */
+    TEST_CHECK(luaL_dostring(L, "assert(not pcall(collectgarbage, 'steptime', -1))\n"
+                                "assert(collectgarbage('generational') == 'incremental')\n"
+                                "assert(collectgarbage('steptime', 100) == true)") == 0);
+    lua_close(L);
+}
 
-    /* Add custom test case registration function to environment. */
-    lua_pushcclosure(L, &luatest_case, 0);
-    lua_setfield(L, LUA_GLOBALSINDEX, "case");
+/*
+** Allocator Test Cases
+*/
 
-    if (!TEST_CHECK((luaL_dofile(L, "luatest_coroutine.lua") == 0))) {
-        TEST_MSG("%s", (luaL_optstring(L, -1, "<unknown script error>")));
+static void test_allocators (void) {
+    static const int allocators[] = { LUAL_ALLOCPOOL, LUAL_ALLOCHUGEPOOL, LUAL_ALLOCSYSTEM };
+    size_t i;
+    for (i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+        lua_State *L = luaL_newstatex(allocators[i]);
+        lua_GlobalStats stats;
+        if (!TEST_CHECK(L != NULL)) {
+            continue;
+        }
+        luaL_openlibs(L);
+        luatest_dofile(L, "luatest_vm.lua");
+        lua_getglobalstats(L, &stats);
+        if (allocators[i] == LUAL_ALLOCSYSTEM) {
+            TEST_CHECK(stats.bytesreserved == 0 && stats.bytesfree == 0 && stats.byteswasted == 0);
+        } else {
+            TEST_CHECK(stats.bytesreserved > stats.bytesfree);
+            TEST_CHECK(stats.bytesreserved - stats.bytesfree > stats.byteswasted);
+            TEST_CHECK(stats.byteswasted < stats.bytesused);
+        }
+        lua_close(L);
+    }
+}
+
+typedef struct luatest_AllocWrapper {
+    lua_Alloc f;
+    void *ud;
+    size_t ncalls;
+    int failin; /* if positive, the number of requests to grow a block until they fail */
+} luatest_AllocWrapper;
+
+static void *luatest_wrappedalloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+    luatest_AllocWrapper *w = (luatest_AllocWrapper *) ud;
+    w->ncalls++;
+    if (nsize > osize && w->failin > 0 && --w->failin == 0) {
+        w->failin = 1; /* until reset */
+        return NULL;
+    }
+    return (*w->f)(w->ud, ptr, osize, nsize);
+}
+
+static void test_wrappedallocator (void) {
+    lua_State *L = luaL_newstate();
+    luatest_AllocWrapper w;
+    lua_GlobalStats stats;
+    w.f = lua_getallocf(L, &w.ud);
+    w.ncalls = 0;
+    w.failin = 0;
+    lua_setallocf(L, luatest_wrappedalloc, &w);
+    luaL_openlibs(L);
+    luatest_dofile(L, "luatest_vm.lua");
+    TEST_CHECK(w.ncalls > 0);
+    lua_getglobalstats(L, &stats);
+    TEST_CHECK(stats.bytesreserved > stats.bytesfree); /* still the pool's */
+    lua_close(L); /* frees the pool: checked by leak sanitizers */
+}
+
+static int luatest_failingstart (lua_State *L) {
+    luatest_AllocWrapper *w = (luatest_AllocWrapper *) lua_touserdata(L, 1);
+    w->failin = 2; /* after allocating the sampler itself */
+    lua_startallocsampling(L, 1);
+    return 0;
+}
+
+static int luatest_failingstats (lua_State *L) {
+    luatest_AllocWrapper *w = (luatest_AllocWrapper *) lua_touserdata(L, 1);
+    lua_AllocStats stats;
+    w->failin = 1;
+    lua_getallocstats(L, 1, &stats);
+    return 0;
+}
+
+static int luatest_failingdump (lua_State *L) {
+    luatest_AllocWrapper *w = (luatest_AllocWrapper *) lua_touserdata(L, 1);
+    w->failin = 1;
+    lua_dumpallocprofile(L, NULL, NULL); /* the writer isn't reached */
+    return 0;
+}
+
+static int luatest_nallocsites (lua_State *L) {
+    lua_AllocStats stats;
+    int site;
+    for (site = 1; lua_getallocstats(L, site, &stats); site++) {
+        lua_pop(L, 1); /* the stack */
     }
+    return site - 1;
+}
 
+static void test_allocsamplingerrors (void) {
+    lua_State *L = luaL_newstate();
+    luatest_AllocWrapper w;
+    lua_GlobalStats stats;
+    int nsites;
+    w.f = lua_getallocf(L, &w.ud);
+    w.ncalls = 0;
+    w.failin = 0;
+    lua_setallocf(L, luatest_wrappedalloc, &w);
+    luaL_openlibs(L);
+    /* a sampler that failed to start is dropped rather than left half set up */
+    TEST_CHECK((lua_cpcall(L, luatest_failingstart, &w) == LUA_ERRMEM));
+    w.failin = 0;
+    if (!TEST_CHECK((lua_startallocsampling(L, 1)))) {
+        lua_close(L);
+        return;
+    }
+    TEST_CHECK((luaL_dostring(L, "local t = {} for i = 1, 100 do t[i] = {} end") == 0));
+    /* reports that run out of memory must leave sampling running */
+    TEST_CHECK((lua_cpcall(L, luatest_failingstats, &w) == LUA_ERRMEM));
+    w.failin = 0;
+    TEST_CHECK((lua_cpcall(L, luatest_failingdump, &w) == LUA_ERRMEM));
+    w.failin = 0;
+    nsites = luatest_nallocsites(L);
+    TEST_CHECK((nsites > 0));
+    TEST_CHECK((luaL_dostring(L, "local function f() return {} end for i = 1, 100 do f() end") == 0));
+    TEST_CHECK((luatest_nallocsites(L) > nsites));
+    lua_getglobalstats(L, &stats);
+    TEST_CHECK((stats.allocsamples > 0));
     lua_close(L);
 }
 
-static void test_profilingscriptcases (void) {
+static int luatest_discardwriter (lua_State *L, const void *p, size_t sz, void *ud) {
+    (void) L;
+    (void) p;
+    (void) sz;
+    (void) ud;
+    return 0;
+}
+
+static void test_samplingowner (void) {
+    lua_State *L1 = luatest_newstate();
+    lua_State *L2 = luatest_newstate();
+    lua_GlobalStats stats;
+    luaL_openlibs(L1);
+    luaL_openlibs(L2);
+    if (lua_startsampling(L1, 1000) != 0) { /* else no profiling timer on this platform */
+#if defined(LUA_USE_POSIX)
+        /* the timer is shared by the process; other states can't sample until it's released */
+        TEST_CHECK((lua_startsampling(L2, 1000) == -1));
+        TEST_CHECK((luaL_dostring(L2, "debug.startsampling()") != 0));
+        TEST_CHECK((strstr(luaL_optstring(L2, -1, ""), "in use by another state") != NULL));
+#endif
+        TEST_CHECK((luaL_dostring(L1, "local t = os.clock() while os.clock() - t < 0.1 do end") == 0));
+        lua_getglobalstats(L1, &stats);
+        TEST_CHECK((stats.samples > 0));
+        TEST_CHECK((stats.samplesdropped == 0));
+        lua_stopsampling(L1, luatest_discardwriter, NULL);
+        lua_getglobalstats(L1, &stats);
+        TEST_CHECK((stats.samples == 0));
+        TEST_CHECK((lua_startsampling(L2, 1000) == 1));
+        lua_stopsampling(L2, luatest_discardwriter, NULL);
+    }
+    lua_close(L1);
+    lua_close(L2);
+}
+
+/*
+** Scripted Test Cases
+*/
+
+static void test_scriptcases (void) {
+    lua_State *L = luatest_newstate();
+    luaL_openlibsx(L, LUALIB_ELUNE);
+    luatest_dofile(L, "luatest_scriptcases.lua");
+    lua_close(L);
+}
+
+static void test_coroutinescriptcases (void) {
     lua_State *L = luatest_newstate();
     luaL_openlibs(L);
+    luatest_dofile(L, "luatest_coroutine.lua");
+    lua_close(L);
+}
 
-    /* Add custom test case registration function to environment. */
-    lua_pushcclosure(L, &luatest_case, 0);
-    lua_setfield(L, LUA_GLOBALSINDEX, "case");
+static void test_profilingscriptcases (void) {
+    lua_State *L = luatest_newstate();
+    luaL_openlibs(L);
+    luatest_dofile(L, "luatest_profiling.lua");
+    lua_close(L);
+}
 
-    if (!TEST_CHECK((luaL_dofile(L, "luatest_profiling.lua") == 0))) {
-        TEST_MSG("%s", (luaL_optstring(L, -1, "<unknown script error>")));
-    }
+static void test_vmscriptcases (void) {
+    lua_State *L = luatest_newstate();
+    luaL_openlibs(L);
+    luatest_dofile(L, "luatest_vm.lua");
+    lua_close(L);
+}
 
+/* the interpreter instance without taint checks has its own specialized paths */
+static void test_vmscriptcases_taintdisabled (void) {
+    lua_State *L = luatest_newstate();
+    lua_settaintmode(L, LUA_TAINTDISABLED);
+    luaL_openlibs(L);
+    luatest_dofile(L, "luatest_vm.lua");
     lua_close(L);
 }
 
@@ -155,12 +484,29 @@ static void test_profilingscriptcases (void) {
 
 TEST_LIST = {
     { "lua_protecttaint: stack remains secure after call", test_protecttaint_secure_normal },
-    { "lua_protecttaint: stack remains tainted after call", test_protecttaint_tainted_normal },
     { "lua_protecttaint: stack restored to secure on error", test_protecttaint_secure_error },
+#if defined(LUA_USE_TAINT)
+    { "lua_protecttaint: stack remains tainted after call", test_protecttaint_tainted_normal },
     { "lua_protecttaint: stack restored to tainted on error", test_protecttaint_tainted_error },
+#endif
+    { "lua_interrupt: break raises an error in a loop", test_interrupt_break_loop },
+    { "lua_interrupt: break is cleared once raised", test_interrupt_break_cleared },
+    { "lua_interrupt: hook request runs the hook once", test_interrupt_hook },
+    { "lua_setscripttimeout: loops and tail calls time out", test_interrupt_timeout },
+#if defined(LUA_USE_TAINT)
+    { "lua_settaintmode: changes made by metamethods apply immediately", test_interrupt_taintmode },
+#endif
+    { "compiled loops: interrupts", test_compiledloops },
+    { "time-budgeted collection steps", test_steptimegc },
+    { "allocators: script tests in pooled and system blocks", test_allocators },
+    { "allocators: pool freed behind a wrapped allocator", test_wrappedallocator },
+    { "allocation sampling: out of memory while reporting", test_allocsamplingerrors },
+    { "sampling: timer ownership and sample counts", test_samplingowner },
     { "scripted test cases", test_scriptcases },
     { "coroutine script tests", test_coroutinescriptcases },
     { "profiling script tests", test_profilingscriptcases },
+    { "interpreter and collector script tests", test_vmscriptcases },
+    { "interpreter and collector script tests: taint disabled", test_vmscriptcases_taintdisabled },
     /* clang-format off */
     { NULL, NULL },
     /* clang-format on */
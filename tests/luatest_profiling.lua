@@ -220,3 +220,343 @@ case("profiling: tailcall unwinding state check", function()
 
     test2(10)
 end)
+
+case("profiling: sampled stacks are folded per call chain", function()
+    local function leaf(n)
+        local s = 0
+        for i = 1, n do
+            s = s + i % 7
+        end
+        return s
+    end
+
+    local function test()
+        local start = os.clock()
+        while os.clock() - start < 0.2 do
+            leaf(10000)
+        end
+    end
+
+    if not debug.startsampling(1000) then
+        return -- No profiling timer on this platform.
+    end
+
+    assert(debug.startsampling(1000) == false)
+    test()
+    assert(debug.getglobalstats().samples > 0)
+
+    local folded = debug.stopsampling()
+    local info = debug.getinfo(leaf, "S")
+    local frame = string.format("%s:%d", info.short_src, info.linedefined)
+    local total, found = 0, false
+
+    for stack, count in string.gmatch(folded, "([^\n]+) (%d+)\n") do
+        total = total + tonumber(count)
+        found = found or string.sub(stack, -#frame - 1) == ";" .. frame
+    end
+
+    assert(total > 0)
+    assert(found)
+    assert(debug.stopsampling() == "")
+end)
+
+case("profiling: line counters count each executed line", function()
+    local function test(n)
+        local s = 0
+        for i = 1, n do
+            if i % 2 == 0 then
+                s = s + i
+            end
+        end
+        return s
+    end
+
+    local line = debug.getinfo(test, "S").linedefined
+
+    debug.setlineprofilingenabled(true)
+    assert(debug.islineprofilingenabled())
+    test(1000)
+    debug.setlineprofilingenabled(false)
+    test(1000) -- Not counted.
+
+    local stats = debug.getlinestats(test)
+    assert(stats[line + 1].hits == 1)
+    assert(stats[line + 3].hits == 1000)
+    assert(stats[line + 4].hits == 500)
+    assert(stats[line + 7].hits == 1)
+    assert(stats[line + 8] == nil)
+
+    debug.resetstats()
+    assert(next(debug.getlinestats(test)) == nil)
+end)
+
+case("profiling: allocation sampling attributes allocations to call stacks", function()
+    local function allocate(n)
+        local t = {}
+        for i = 1, n do
+            t[i] = { i }
+        end
+        return t
+    end
+
+    local frame = debug.getinfo(allocate, "S").short_src .. ":" .. (debug.getinfo(allocate, "S").linedefined + 3)
+
+    assert(not pcall(debug.startallocsampling, -1))
+    assert(not pcall(debug.startallocsampling, 0 / 0))
+    assert(not pcall(debug.startallocsampling, math.huge))
+    assert(debug.startallocsampling(1024))
+    assert(not debug.startallocsampling(1024)) -- Already sampling.
+    local keep = allocate(10000)
+    allocate(10000) -- Garbage.
+    collectgarbage()
+
+    local allocbytes, livebytes = 0, 0
+    for _, site in ipairs(debug.getallocstats()) do
+        if site.type == "table" and string.find(site.stack, frame, 1, true) then
+            allocbytes = allocbytes + site.allocbytes
+            livebytes = livebytes + site.livebytes
+        end
+    end
+
+    -- The estimates are random; allow for a generous margin around the
+    -- expected 2:1 ratio of allocated to live bytes.
+    assert(allocbytes > 0)
+    assert(livebytes > allocbytes / 4 and livebytes < allocbytes * 3 / 4)
+    assert(#debug.dumpallocprofile() > 0)
+    assert(debug.getglobalstats().allocsamples > 0)
+
+    debug.stopallocsampling()
+    assert(#debug.getallocstats() == 0)
+    assert(debug.dumpallocprofile() == "")
+    assert(#keep == 10000)
+end)
+
+taintcase("profiling: source memory is accounted without collecting stats", function()
+    local source = "profiling:bytesowned"
+    local function owned()
+        return debug.getsourcestats(source).bytesowned
+    end
+
+    assert(owned() == 0)
+
+    debug.setnewobjecttaint(source)
+    local t = {}
+    debug.setnewobjecttaint(nil)
+    local empty = owned()
+    assert(empty > 0)
+
+    for i = 1, 100 do
+        t[i] = i -- Grows the table owned by `source'.
+    end
+    assert(owned() > empty)
+
+    debug.setobjecttaint(t, nil)
+    assert(owned() == 0)
+    debug.setobjecttaint(t, source)
+    assert(owned() > empty)
+
+    t = nil
+    collectgarbage()
+    assert(owned() == 0)
+end)
+
+taintcase("profiling: source execution time is charged on return", function()
+    local source = "profiling:execticks"
+    local other = "profiling:execticks:other"
+
+    debug.setnewclosuretaint(source)
+    local function test()
+        for _ = 1, 2 ^ 16 do
+        end
+    end
+    debug.setnewclosuretaint(nil)
+
+    test()
+    local ticks = debug.getsourcestats(source).execticks
+    assert(ticks > 0)
+    assert(ticks == debug.getfunctionstats(test).ownticks)
+
+    debug.setobjecttaint(test, other)
+    test()
+    assert(debug.getsourcestats(source).execticks == ticks)
+    assert(debug.getsourcestats(other).execticks > 0)
+
+    debug.resetstats()
+    assert(debug.getsourcestats(source).execticks == 0)
+    assert(debug.getsourcestats(other).execticks == 0)
+end)
+
+case("profiling: reset clears counters of running calls", function()
+    local inner, outer
+
+    local function sub()
+        for _ = 1, 2 ^ 16 do
+        end
+    end
+
+    local function test()
+        sub()
+        debug.resetstats()
+        inner = debug.getfunctionstats(sub)
+        sub()
+    end
+
+    test()
+    outer = debug.getfunctionstats(test)
+
+    assert(inner.calls == 0)
+    assert(inner.ownticks == 0)
+    assert(debug.getfunctionstats(sub).calls == 1)
+    assert(outer.calls == 0) -- Call began before the reset.
+    assert(outer.ownticks > 0)
+end)
+
+case("profiling: closures of a function share statistics", function()
+    local function make()
+        return function()
+            for _ = 1, 2 ^ 12 do
+            end
+        end
+    end
+
+    local a, b = make(), make()
+    a()
+    b()
+    assert(debug.getfunctionstats(a).calls == 2)
+    assert(debug.getfunctionstats(b).calls == 2)
+    assert(debug.getfunctionstats(tostring).calls == 0)
+    tostring(nil)
+    assert(debug.getfunctionstats(tostring).calls == 1)
+
+    assert(not debug.isclosureprofilingenabled())
+    debug.setclosureprofilingenabled(true)
+    assert(debug.getfunctionstats(a).calls == 0)
+    a()
+    a()
+    b()
+    debug.setclosureprofilingenabled(false)
+    assert(debug.getfunctionstats(a).calls == 2) -- Not shared while enabled.
+
+    debug.setclosureprofilingenabled(true)
+    assert(debug.getfunctionstats(a).calls == 2)
+    assert(debug.getfunctionstats(b).calls == 1)
+    debug.setclosureprofilingenabled(false)
+end)
+
+case("profiling: recursion through another closure is not counted twice", function()
+    local function make()
+        local self
+        self = function(n, other)
+            for _ = 1, 2 ^ 14 do
+            end
+            if n > 0 then
+                other(n - 1, self)
+            end
+        end
+        return self
+    end
+
+    local a, b = make(), make()
+    local callee = debug.getinfo(a, "S").short_src .. ":" .. debug.getinfo(a, "S").linedefined
+
+    debug.setcallgraphenabled(true)
+    local start = debug.gettickcount()
+    a(8, b)
+    local elapsed = debug.gettickcount() - start
+    debug.setcallgraphenabled(false)
+
+    local stats = debug.getfunctionstats(a)
+    assert(stats.calls == 9)
+    assert(stats.subticks >= stats.ownticks)
+    assert(stats.subticks <= elapsed) -- Only the outermost call commits.
+
+    local subticks = 0
+    for _, edge in ipairs(debug.getcallgraph()) do
+        if edge.callee == callee then
+            subticks = subticks + edge.subticks
+        end
+    end
+    assert(subticks <= elapsed)
+    debug.resetstats()
+end)
+
+case("profiling: call graph counts calls from each call site", function()
+    local function leaf()
+        for _ = 1, 2 ^ 12 do
+        end
+    end
+
+    local function test()
+        leaf()
+        for _ = 1, 2 do
+            leaf()
+        end
+    end
+
+    local source = debug.getinfo(leaf, "S").short_src
+    local line = debug.getinfo(test, "S").linedefined
+    local callee = source .. ":" .. debug.getinfo(leaf, "S").linedefined
+
+    debug.setcallgraphenabled(true)
+    assert(debug.iscallgraphenabled())
+    test()
+    debug.setcallgraphenabled(false)
+    test() -- Not counted.
+
+    local edges = {}
+    for _, edge in ipairs(debug.getcallgraph()) do
+        if edge.callee == callee then
+            edges[edge.caller] = edge
+        end
+    end
+
+    local first = edges[source .. ":" .. (line + 1)]
+    local second = edges[source .. ":" .. (line + 3)]
+    assert(first.calls == 1)
+    assert(second.calls == 2)
+    assert(first.ownticks > 0 and first.subticks >= first.ownticks)
+
+    local dump = debug.dumpcallgraph()
+    assert(dump:find("^# callgrind format\n"))
+    assert(dump:find("\ncfn=" .. callee:gsub("%p", "%%%0") .. "\ncalls=2 "))
+
+    debug.resetstats()
+    assert(#debug.getcallgraph() == 0)
+end)
+
+case("profiling: timeline trace records calls, coroutines and collections", function()
+    local function test()
+        local co = coroutine.create(function()
+            coroutine.yield()
+        end)
+        coroutine.resume(co)
+        coroutine.resume(co)
+        collectgarbage("step")
+    end
+
+    local name = debug.getinfo(test, "S").short_src .. ":" .. debug.getinfo(test, "S").linedefined
+
+    assert(debug.starttracing(64))
+    assert(not debug.starttracing())
+    test()
+    local trace = debug.stoptracing()
+    assert(debug.stoptracing():find("^{\"traceEvents\":%[\n"))
+
+    local function count(pattern)
+        local _, n = trace:gsub(pattern, "")
+        return n
+    end
+
+    assert(trace:find("^{\"traceEvents\":%[\n"))
+    assert(trace:find("\n%],\"displayTimeUnit\":\"ms\"}\n$"))
+    assert(count("\"ph\":\"B\",\"cat\":\"call\",\"name\":\"" .. name:gsub("%p", "%%%0") .. "\"") == 1)
+    assert(count("\"name\":\"resume\"") == 2)
+    assert(count("\"name\":\"yield\"") == 1)
+    assert(count("\"ph\":\"B\",\"cat\":\"gc\"") >= 1)
+
+    -- Only the most recent events are kept.
+    debug.starttracing(4)
+    test()
+    trace = debug.stoptracing()
+    assert(count("\"ph\":") == 4 + 1)
+end)
@@ -35,9 +35,13 @@ local case = _G.case
         end
     end
 
+-- Cases that observe taint propagation are registered with 'taintcase', which
+-- skips them in builds without taint support.
+local taintcase = _G.taintcase or case
+
 -- This test verifies that the MOVE operation correctly results in a tainted
 -- assignment if the context is insecure.
-case("OP_MOVE: Copy secure value from tainted context", function()
+taintcase("OP_MOVE: Copy secure value from tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -55,7 +59,7 @@ end)
 
 -- This test verifies that the LOADK operation correctly results in a tainted
 -- assignment if the context is insecure.
-case("OP_LOADK: Load constant into tainted context", function()
+taintcase("OP_LOADK: Load constant into tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -70,7 +74,7 @@ end)
 
 -- This test verifies that the LOADBOOL operation correctly results in a tainted
 -- assignment if the context is insecure.
-case("OP_LOADBOOL: Load boolean value into tainted context", function()
+taintcase("OP_LOADBOOL: Load boolean value into tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -85,7 +89,7 @@ end)
 
 -- This test verifies that the LOADNIL operation correctly results in a tainted
 -- assignment if the context is insecure.
-case("OP_LOADNIL: Load nil value into tainted context", function()
+taintcase("OP_LOADNIL: Load nil value into tainted context", function()
     local _ENV = {}
     collectgarbage("stop") -- GC table traversal can nuke tainted nil values.
 
@@ -114,7 +118,7 @@ end)
 
 -- This test verifies that the GETGLOBAL operation taints the stack if reading
 -- an insecure global variable.
-case("OP_GETGLOBAL: Read tainted value", function()
+taintcase("OP_GETGLOBAL: Read tainted value", function()
     local _ENV = {}
 
     securecall(function()
@@ -132,7 +136,7 @@ end)
 
 -- This test verifies that the GETGLOBAL operation taints the read value if
 -- a secure value is read from a tainted context.
-case("OP_GETGLOBAL: Read secure value from tainted context", function()
+taintcase("OP_GETGLOBAL: Read secure value from tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -148,7 +152,7 @@ end)
 
 -- This test verifies that the GETGLOBAL operation does not trigger taint
 -- if reading values from an insecurely-assigned function environment.
-case("OP_GETGLOBAL: Read from insecure function environment", function()
+taintcase("OP_GETGLOBAL: Read from insecure function environment", function()
     local assert = assert
     local getfenv = getfenv
     local issecure = issecure
@@ -187,7 +191,7 @@ end)
 
 -- This test verifies that the GETTABLE operation taints the stack if reading
 -- an insecure field.
-case("OP_GETTABLE: Read tainted field", function()
+taintcase("OP_GETTABLE: Read tainted field", function()
     local _ENV = {}
 
     securecall(function()
@@ -206,7 +210,7 @@ end)
 
 -- This test verifies that the GETTABLE operation applies taint to secure
 -- values read from tables while the context is tainted.
-case("OP_GETTABLE: Read secure field from tainted context", function()
+taintcase("OP_GETTABLE: Read secure field from tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -224,6 +228,31 @@ case("OP_GETTABLE: Read secure field from tainted context", function()
     assert(not issecurevariable(_ENV, "target"), "expected '_ENV.target' to be tainted")
 end)
 
+-- This test verifies that repeated GETTABLE operations from the same
+-- instruction apply taint according to the table being read on each
+-- execution, rather than the table it last read from.
+taintcase("OP_GETTABLE: Read same field from secure and tainted tables", function()
+    local secure = { field = "test" }
+    local tainted = {}
+
+    securecall(function()
+        forceinsecure() -- GETGLOBAL, CALL
+        -- Stack tainted! --
+        local value = "test" -- LOADK
+        tainted.field = value -- GETUPVAL, SETTABLE
+    end)
+
+    local function read(t)
+        local _ = t.field -- GETTABLE
+        return issecure()
+    end
+
+    for _ = 1, 3 do
+        assert(securecall(read, secure), "expected read of 'secure.field' to be secure")
+        assert(not securecall(read, tainted), "expected read of 'tainted.field' to be tainted")
+    end
+end)
+
 -- This test verifies that the GETUPVAL operation does not taint the stack
 -- if reading a secure upvalue.
 case("OP_GETUPVAL: Read secure upvalue", function()
@@ -243,7 +272,7 @@ end)
 
 -- This test verifies that the GETUPVAL operation taints the stack if reading
 -- a tainted upvalue.
-case("OP_GETUPVAL: Read tainted upvalue", function()
+taintcase("OP_GETUPVAL: Read tainted upvalue", function()
     local _ENV = {}
     local upval
 
@@ -262,7 +291,7 @@ end)
 
 -- This test verifies that the GETUPVAL operation taints read upvalues if
 -- they are secure while the context is currently insecure.
-case("OP_GETUPVAL: Read secure upvalue from tainted context", function()
+taintcase("OP_GETUPVAL: Read secure upvalue from tainted context", function()
     local _ENV = {}
     local upval
 
@@ -292,7 +321,7 @@ end)
 
 -- This test verifies that SETGLOBAL correctly transfers taint to the written
 -- field when writing a tainted value.
-case("OP_SETGLOBAL: Write tainted value", function()
+taintcase("OP_SETGLOBAL: Write tainted value", function()
     securecall(function()
         forceinsecure() -- GETGLOBAL, CALL
         -- Stack tainted! --
@@ -330,7 +359,7 @@ end)
 
 -- This test verifies that SETTABLE correctly stores any taint associated with
 -- a value when writing to the table.
-case("OP_SETTABLE: Write tainted value", function()
+taintcase("OP_SETTABLE: Write tainted value", function()
     local _ENV = {}
 
     securecall(function()
@@ -397,7 +426,7 @@ end)
 
 -- This test verifies that the SETUPVAL operation writes tainted values when
 -- the execution stack is insecure.
-case("OP_SETUPVAL: Write tainted value", function()
+taintcase("OP_SETUPVAL: Write tainted value", function()
     local _ENV = {}
     local upval
 
@@ -436,7 +465,7 @@ end)
 
 -- This test verifies that the ADD operation correctly taints its result if
 -- executed on secure values in an insecure context.
-case("OP_ADD: Evaluate in tainted context", function()
+taintcase("OP_ADD: Evaluate in tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -457,7 +486,7 @@ end)
 
 -- This test verifies that the SUB operation correctly taints its result if
 -- executed on secure values in an insecure context.
-case("OP_SUB: Evaluate in tainted context", function()
+taintcase("OP_SUB: Evaluate in tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -478,7 +507,7 @@ end)
 
 -- This test verifies that the MUL operation correctly taints its result if
 -- executed on secure values in an insecure context.
-case("OP_MUL: Evaluate in tainted context", function()
+taintcase("OP_MUL: Evaluate in tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -499,7 +528,7 @@ end)
 
 -- This test verifies that the DIV operation correctly taints its result if
 -- executed on secure values in an insecure context.
-case("OP_DIV: Evaluate in tainted context", function()
+taintcase("OP_DIV: Evaluate in tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -520,7 +549,7 @@ end)
 
 -- This test verifies that the MOD operation correctly taints its result if
 -- executed on secure values in an insecure context.
-case("OP_MOD: Evaluate in tainted context", function()
+taintcase("OP_MOD: Evaluate in tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -541,7 +570,7 @@ end)
 
 -- This test verifies that the POW operation correctly taints its result if
 -- executed on secure values in an insecure context.
-case("OP_POW: Evaluate in tainted context", function()
+taintcase("OP_POW: Evaluate in tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -562,7 +591,7 @@ end)
 
 -- This test verifies that the UNM operation correctly taints its result if
 -- executed on secure values in an insecure context.
-case("OP_UNM: Evaluate in tainted context", function()
+taintcase("OP_UNM: Evaluate in tainted context", function()
     local _ENV = {}
 
     securecall(function()
@@ -603,7 +632,7 @@ end)
 -- This test verifies that starting a coroutine from a tainted context will
 -- propagate to the child thread. Additionally, this verifies that later
 -- resuming the thread securely does _not_ taint further execution in the thread.
-case("Coroutines: Start coroutine from tainted thread", function()
+taintcase("Coroutines: Start coroutine from tainted thread", function()
     local comain = function()
         assert(not issecure(), "expected coroutine thread to start insecurely")
         coroutine.yield()
@@ -645,7 +674,7 @@ end)
 
 -- This test verifies that taint propagates from an insecure child thread back
 -- to its secure parent when yielding.
-case("Coroutines: Yield coroutine while tainted", function()
+taintcase("Coroutines: Yield coroutine while tainted", function()
     local comain = function()
         assert(issecure(), "expected coroutine thread to start securely")
         forceinsecure()
@@ -661,7 +690,7 @@ end)
 
 -- This test verifies that taint propagates from an insecure child thread back
 -- to its secure parent when returning.
-case("Coroutines: Return from coroutine while tainted", function()
+taintcase("Coroutines: Return from coroutine while tainted", function()
     local comain = function()
         assert(issecure(), "expected coroutine thread to start securely")
         forceinsecure()
@@ -676,7 +705,7 @@ end)
 
 -- This test verifies that resuming a coroutine that previously yielded
 -- insecurely will - if resumed from a secure context - then execute securely.
-case("Coroutines: Resume tainted coroutine from secure thread", function()
+taintcase("Coroutines: Resume tainted coroutine from secure thread", function()
     local comain = function()
         forceinsecure()
         assert(not issecure(), "expected coroutine thread to be tainted before yield")
@@ -695,7 +724,7 @@ end)
 
 -- This test verifies that starting and resuming a closure that has an insecure
 -- closure as its main function will taint execution.
-case("Coroutines: Create secure coroutine with tainted closure", function()
+taintcase("Coroutines: Create secure coroutine with tainted closure", function()
     local comain = securecall(function()
         forceinsecure()
 
@@ -758,7 +787,7 @@ end)
 
 -- This test verifies that reads which go through metatables and access tainted
 -- values will propagate taint back to the caller.
-case("Metatables: Read tainted value from '__index'", function()
+taintcase("Metatables: Read tainted value from '__index'", function()
     local proxy = {}
     local store = {}
 
@@ -776,13 +805,47 @@ case("Metatables: Read tainted value from '__index'", function()
     assert(globalfoo == 1, "expected 'globalfoo' to be '1'")
 end)
 
+-- This test verifies that repeated reads of a field through '__index' see
+-- changes to both the object and its '__index' table, including changes that
+-- cause either table to be resized.
+case("Metatables: Read field through '__index' after changes", function()
+    local class = { foo = 1 }
+    local object = setmetatable({}, { __index = class })
+
+    local function read()
+        return object.foo -- GETTABLE
+    end
+
+    assert(read() == 1, "expected 'object.foo' to be read from 'class'")
+    class.foo = 2
+    assert(read() == 2, "expected 'object.foo' to see update to 'class.foo'")
+
+    for i = 1, 100 do
+        class["key" .. i] = i
+    end
+
+    assert(read() == 2, "expected 'object.foo' to be found after resizing 'class'")
+    object.foo = 3
+    assert(read() == 3, "expected 'object.foo' to be shadowed by the object")
+
+    for i = 1, 100 do
+        object["key" .. i] = i
+    end
+
+    assert(read() == 3, "expected 'object.foo' to be found after resizing 'object'")
+    object.foo = nil
+    assert(read() == 2, "expected 'object.foo' to be read from 'class' after clearing")
+    class.foo = nil
+    assert(read() == nil, "expected 'object.foo' to be nil after clearing 'class.foo'")
+end)
+
 -- This test verifies that writes through a tainted '__newindex' metatable field
 -- will taint the calling context. This differs from '__index' behavior which
 -- does not taint the caller.
 --
 -- One additional thing to note is that while execution will taint, the value
 -- written to the backing 'store' table will _not_ be tainted.
-case("Metatables: Write secure value through tainted '__newindex'", function()
+taintcase("Metatables: Write secure value through tainted '__newindex'", function()
     local proxy = {}
     local store = {}
 
@@ -839,7 +902,7 @@ end)
 -- This test verifies that replacing the environment of a secure function
 -- from a tainted context will taint the function, causing future queries
 -- for the function environment to then taint their accessors.
-case("getfenv: Read tainted environment", function()
+taintcase("getfenv: Read tainted environment", function()
     local function setenv(func)
         local env = {}
         forceinsecure()
@@ -910,7 +973,7 @@ end)
 
 -- This test verifies that querying overridden function environments with
 -- tainted '__environment' metatable keys will taint execution.
-case("getfenv: Read secure environment with tainted '__environment' key", function()
+taintcase("getfenv: Read secure environment with tainted '__environment' key", function()
     local function setenv(func)
         local env = {}
         local meta = {}
@@ -952,7 +1015,7 @@ end)
 --
 -- This differs from behavior when C calls are involved; see the 'ccall'
 -- variant of this test.
-case("setfenv: Taint caller environment with Lua call", function()
+taintcase("setfenv: Taint caller environment with Lua call", function()
     local function inner()
         forceinsecure()
         setfenv(3, _G)
@@ -1091,7 +1154,7 @@ case("securecallfunction: errors forwarded to error handler", function()
 end)
 
 -- Verifies that taint does not propagate back to the caller.
-case("securecallfunction: does not taint caller", function()
+taintcase("securecallfunction: does not taint caller", function()
     securecallfunction(function()
         forceinsecure()
         assert(not issecure())
@@ -1120,7 +1183,7 @@ case("securecallfunction: does not perform global lookup", function()
 end)
 
 -- Verifies that taint is retained by the callee.
-case("securecallfunction: caller taint propagates to callee", function()
+taintcase("securecallfunction: caller taint propagates to callee", function()
     forceinsecure()
     securecallfunction(function()
         assert(not issecure())
@@ -1168,7 +1231,7 @@ case("securecall: errors forwarded to error handler", function()
 end)
 
 -- Verifies that taint does not propagate back to the caller.
-case("securecall: does not taint caller", function()
+taintcase("securecall: does not taint caller", function()
     securecall(function()
         forceinsecure()
         assert(not issecure())
@@ -1199,7 +1262,7 @@ case("securecall: perform global lookup", function()
 end)
 
 -- Verifies that taint on a global lookup doesn't propagate back to the caller.
-case("securecall: global lookups do not taint caller", function()
+taintcase("securecall: global lookups do not taint caller", function()
     securecall(function()
         forceinsecure()
         _G.evilfunction = function() end
@@ -1212,7 +1275,7 @@ end)
 
 -- Verifies that taint applied from the global lookup correctly taints execution
 -- of the function to-be-invoked.
-case("securecall: tainted global propagates to calleee", function()
+taintcase("securecall: tainted global propagates to calleee", function()
     local _ENV = {}
 
     securecall(function()
@@ -1226,7 +1289,7 @@ case("securecall: tainted global propagates to calleee", function()
 end)
 
 -- Verifies that taint is retained by the callee.
-case("securecall: caller taint propagates to callee", function()
+taintcase("securecall: caller taint propagates to callee", function()
     forceinsecure()
     securecall(function()
         assert(not issecure())
@@ -1275,7 +1338,7 @@ case("secureexecuterange: does not propagate taint from calls", function()
     assert(issecure())
 end)
 
-case("secureexecuterange: does not clear taint if called insecurely", function()
+taintcase("secureexecuterange: does not clear taint if called insecurely", function()
     local function exec()
         assert(not issecure())
     end
@@ -1425,7 +1488,7 @@ end)
 -- This test verifies that if the original function encounters taint during
 -- execution then it will propagate that taint to both the posthook and the
 -- caller.
-case("hooksecurefunc: prefunc taint propagates to posthook and caller", function()
+taintcase("hooksecurefunc: prefunc taint propagates to posthook and caller", function()
     _G.hookfunc = function()
         forceinsecure()
     end
@@ -1438,7 +1501,7 @@ end)
 
 -- This test verifies that if the original function is a tainted global closure
 -- then calling it will taint execution of both the posthook and the caller.
-case("hooksecurefunc: tainted prefunc propagates to posthook and caller", function()
+taintcase("hooksecurefunc: tainted prefunc propagates to posthook and caller", function()
     securecall(function()
         forceinsecure()
         _G.hookfunc = function() end
@@ -1470,7 +1533,7 @@ case("hooksecurefunc: prefunc errors propagate", function()
 end)
 
 -- This test verifies that loadstring taints the caller.
-case("loadstring: taints caller", function()
+taintcase("loadstring: taints caller", function()
     assert(issecure())
     loadstring("")
     assert(not issecure())
@@ -1672,7 +1735,7 @@ case("pcallwithenv: disallows calls to functions with protected environments", f
     assert(string.find(err, "protected environment"), "expected 'pcallwithenv' to complain about environments")
 end)
 
-case("pcallwithenv: taints secure closures if called insecurely", function()
+taintcase("pcallwithenv: taints secure closures if called insecurely", function()
     local foo = function() end
 
     securecall(function()
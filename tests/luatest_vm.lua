@@ -0,0 +1,279 @@
+--
+-- Interpreter and Collector Tests
+--
+-- The tests below check that specialized instructions, superinstructions,
+-- compiled loops and the collector modes behave like the generic interpreter.
+-- They are run with taint tracking both enabled and disabled, as each mode has
+-- its own instance of the interpreter.
+--
+
+case("specialized instructions: operands and dumps", function()
+    local function f(a, b)
+        local c = -((a + b - a * b) / 2 % 3 ^ 1)
+        return c, a == b, a < b, a <= b
+    end
+
+    local function g(a, b)
+        return a + b, a < b
+    end
+
+    local before = string.dump(f)
+
+    for i = 1, 10 do
+        f(i, i + 1)
+        g(i, i + 1)
+    end
+
+    assert(string.dump(f) == before, "dump changed")
+
+    local c, eq, lt, le = f("1", "2")
+    assert(c == -0.5 and not eq and lt and le, "string operands")
+    assert(f(1, 2) == -0.5, "number operands")
+
+    local mt = { __add = function() return 42 end, __lt = function() return true end }
+    local o = setmetatable({}, mt)
+    assert(select("#", g(o, o)) == 2 and g(o, o) == 42, "metamethod operands")
+    assert(select(2, g(o, o)), "metamethod operands")
+    assert(g(1, 2) == 3, "number operands")
+    assert(string.dump(f) == before, "dump changed")
+end)
+
+case("superinstructions: results, errors and hooks", function()
+    local o = { x = 1, opt = {} }
+
+    function o:get() return self.x end
+    function getter() return 2 end -- Note: a global, for OP_GETGLOBAL and OP_CALL
+
+    local function f(t)
+        local n = t:get() + getter() + tonumber("3")
+        if t.opt.enabled then
+            n = n + 10
+        end
+        return n + math.floor(0.5)
+    end
+
+    assert(f(o) == 6, "results")
+    o.opt.enabled = true
+    assert(f(o) == 16, "test")
+
+    local _, e = pcall(function() return missing() end)
+    assert(string.find(e, "global 'missing'"), e)
+    _, e = pcall(function() return o:missing() end)
+    assert(string.find(e, "method 'missing'"), e)
+
+    local lines = {}
+    local line = debug.getinfo(1, "l").currentline
+    debug.sethook(function(_, l) lines[#lines + 1] = l end, "l")
+    getter()
+    debug.sethook()
+
+    local expected = { line + 2, debug.getinfo(getter, "S").linedefined, line + 3 }
+    assert(table.concat(lines, ",") == table.concat(expected, ","), table.concat(lines, ","))
+    getter = nil
+end)
+
+case("compiled loops: results and guard exits", function()
+    local total = 0
+
+    local function sum(n)
+        local s = 0
+        for i = 1, n do
+            s = s + i * 2 - 1
+        end
+        return s
+    end
+
+    assert(sum(5000) == 25000000, "arithmetic")
+
+    local function fill(t, n)
+        for i = 1, n do
+            t[i] = 0
+        end
+        for i = 1, n do
+            t[i] = t[i] + i
+        end
+        return t
+    end
+
+    local t = fill({}, 3000)
+    assert(t[3000] == 3000, "array reads and writes")
+
+    local function pick(t)
+        local s = 0
+        for i = #t, 1, -1 do
+            if t[i] > 5 then
+                s = s + t[i]
+            elseif t[i] ~= 1 then
+                s = s - 1
+            end
+        end
+        return s
+    end
+
+    assert(pick(t) == 4501481, "comparisons")
+
+    t[10] = "10"
+    t[20] = nil
+    local ok, e = pcall(pick, t)
+    assert(not ok and string.find(e, "compare"), "guard exits")
+
+    setmetatable(t, { __index = function() return 0 end })
+    t[10] = 10
+    assert(pick(t) == 4501460, "metamethods")
+
+    local function add()
+        for i = 1, 3000 do
+            total = total + 1
+            if i == 2000 then
+                break
+            end
+        end
+    end
+
+    add()
+    assert(total == 2000, "upvalues and breaks")
+
+    local function steps()
+        local s = 0
+        for i = 3000, 1, -0.5 do
+            s = s + -i
+        end
+        return s
+    end
+
+    assert(steps() == -9001499.5, "negative steps")
+end)
+
+case("string table: incremental resizing", function()
+    for _, mode in ipairs({ "incremental", "generational" }) do
+        collectgarbage(mode)
+
+        local keep, keys = {}, {}
+        for i = 1, 100000 do
+            keep[i] = "k" .. i
+            keys[keep[i]] = i
+            if i % 20000 == 0 then
+                collectgarbage("step", 64)
+            end
+        end
+
+        for i = 1, 100000 do
+            assert(keys["k" .. i] == i, "interned strings")
+        end
+
+        local count = collectgarbage("count")
+        keep, keys = nil, nil
+        for _ = 1, 8 do
+            collectgarbage()
+        end
+
+        assert(collectgarbage("count") < count / 8, mode .. ": string table shrinks")
+        collectgarbage("incremental")
+    end
+end)
+
+case("generational collection: barriers, weak tables and finalizers", function()
+    assert(collectgarbage("generational") == "incremental", "mode")
+
+    local old, weak, finalized = {}, setmetatable({}, { __mode = "k" }), 0
+    collectgarbage()
+
+    -- Note: in a function of its own, so no dead register keeps the last proxy alive
+    local function newfinalized()
+        local u = newproxy(true)
+        getmetatable(u).__gc = function() finalized = finalized + 1 end
+    end
+
+    for i = 1, 20000 do
+        local x = { i }
+        old[i % 100 + 1] = function() return x end
+        newfinalized()
+    end
+
+    collectgarbage("stop")
+    for i = 1, 100 do
+        weak[{}] = i
+    end
+    collectgarbage("step")
+
+    for i = 1, 100 do
+        assert(old[i]()[1] % 100 + 1 == i, "barrier")
+    end
+
+    assert(next(weak) == nil, "weak table")
+    assert(finalized > 0, "finalizers")
+    assert(collectgarbage("incremental") == "generational", "mode")
+    collectgarbage()
+    assert(finalized == 20000, "finalizers")
+end)
+
+case("parallel marking: reachability, weak tables and finalizers", function()
+    assert(collectgarbage("setmarkthreads", 4) == 0, "previous count")
+
+    local root, weak, finalized = {}, setmetatable({}, { __mode = "kv" }), 0
+    local mt = { __index = function() return true end }
+
+    local function newfinalized()
+        local u = newproxy(true)
+        getmetatable(u).__gc = function() finalized = finalized + 1 end
+    end
+
+    for i = 1, 40000 do
+        local t = setmetatable({ i, tostring(i), { i } }, mt)
+        root[i] = (i % 2 == 0) and function() return t end or t
+        weak[t], weak[i] = {}, {}
+    end
+
+    for i = 1, 100 do
+        local co = coroutine.wrap(function(x)
+            coroutine.yield()
+            return x
+        end)
+        co({ i })
+        root[-i] = co
+        newfinalized()
+    end
+
+    collectgarbage()
+
+    for i = 1, 40000 do
+        local t = (i % 2 == 0) and root[i]() or root[i]
+        assert(t[1] == i and t[2] == tostring(i) and t[3][1] == i and t.missing, "reachable objects")
+    end
+
+    for i = 1, 100 do
+        assert(root[-i]()[1] == i, "thread stacks")
+    end
+
+    for k in pairs(weak) do
+        assert(type(k) == "table" and k[1], "weak table")
+    end
+
+    assert(finalized == 100, "finalizers")
+    assert(collectgarbage("setmarkthreads", 0) == 4, "previous count")
+end)
+
+case("allocators: pooled and resized blocks", function()
+    local t = {}
+
+    for i = 1, 20000 do
+        local s = string.rep("x", i % 700)
+        t[i] = { s, i, { i } }
+        for j = 1, i % 40 do
+            t[i][j + 3] = j
+        end
+    end
+
+    for i = 1, 20000, 2 do
+        t[i] = nil
+    end
+
+    collectgarbage()
+
+    for i = 2, 20000, 2 do
+        assert(#t[i][1] == i % 700 and t[i][2] == i and t[i][3][1] == i, "pooled blocks")
+        for j = 1, i % 40 do
+            assert(t[i][j + 3] == j, "resized blocks")
+        end
+    end
+end)